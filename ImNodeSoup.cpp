@@ -1,11 +1,15 @@
 
 
 
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
 #include <string>
-#include <unordered_map>
 #include <vector>
-#include <fstream>
-#include <sstream>
 #include <cassert>
 
 #define IMGUI_DEFINE_MATH_OPERATORS
@@ -13,8 +17,17 @@
 #include "imgui_internal.h"
 
 #include <nodesoup.hpp>
+#include "csr_graph.hpp"
+#include "dot_parser.hpp"
 #include "fruchterman_reingold.hpp"
 #include "kamada_kawai.hpp"
+#include "multilevel_fruchterman_reingold.hpp"
+#include "stress_majorization.hpp"
+#include "layout_worker.hpp"
+#include "layout_snapshot.hpp"
+#include "layout_stats.hpp"
+#include "spatial_grid.hpp"
+#include "nodesoup_imgui.hpp"
 
 
 const char* k6_dot=R"str(graph {
@@ -516,87 +529,39 @@ v99
 
 
 
-// Read not-too-complicated dot files
-nodesoup::adj_list_t read_from_dot(const char* aDotData)
-{
-  nodesoup::adj_list_t adj_list;
-
-  std::istringstream ifs(aDotData);
-  if (!ifs.good())
-    {
-      return adj_list;
-    }
-
-  std::unordered_map<std::string, nodesoup::vertex_id_t> names;
-
-  auto name_to_vertex_id = [&adj_list,&names](std::string name) -> nodesoup::vertex_id_t
-  {
-    if(name[name.size() - 1] == ';')
-      {
-        name.erase(name.end() - 1, name.end());
-      }
-
-    nodesoup::vertex_id_t v_id;
-    auto it = names.find(name);
-    if (it != names.end())
-      {
-        return (*it).second;
-      }
-
-    v_id = adj_list.size();
-    names.insert({ name, v_id });
-    adj_list.resize(v_id + 1);
-    return v_id;
-  };
-
-  std::string line;
-  // skip first line
-  std::getline(ifs, line);
-
-  while (std::getline(ifs, line))
-    {
-      if (line[0] == '}')
-        {
-          break;
-        }
-
-      std::istringstream iss(line);
-      std::string name, edge_sign, adj_name;
-      iss >> name >> edge_sign >> adj_name;
-
-      // add vertex if new
-      nodesoup::vertex_id_t v_id = name_to_vertex_id(name);
-
-      assert(edge_sign == "--" || edge_sign.size() == 0);
-      if (edge_sign != "--")
-        {
-          continue;
-        }
-
-      // add adjacent vertex if new
-      nodesoup::vertex_id_t adj_id = name_to_vertex_id(adj_name);
-
-      // add edge if new
-      if (find(adj_list[v_id].begin(),adj_list[v_id].end(), adj_id) == adj_list[v_id].end())
-        {
-          adj_list[v_id].push_back(adj_id);
-          adj_list[adj_id].push_back(v_id);
-        }
-    }
-
-  return adj_list;
-}
-
-
-
-
 constexpr std::size_t kInvadidVertex=static_cast<std::size_t>(-1);
 constexpr float kMinUIDist=9.0f;  // TODO: Calculate this with DPI?
 const float kWindowInitWidth = 800.0f;
 const float kWindowInitHeight= 600.0f;
+// Layout time between two published frames
+constexpr std::chrono::microseconds kLayoutBudget(8000);
+const char* kSnapshotPath="nodesoup_layout.snap";
 static ImVec2 gDisp{0.0f,0.0f};
 static float  gScale=1.0f;
 static nodesoup::vertex_id_t gSelectedVertex=kInvadidVertex;
+static nodesoup::vertex_id_t gHoveredVertex=kInvadidVertex;
+
+// Index of the displayed positions, updated once per new frame of the layout
+static nodesoup::SpatialGrid gGrid;
+static unsigned long long    gGridStep=~0ull;
+
+// Rectangle (left drag) or lasso (ctrl + left drag) selection, in layout coordinates
+static std::vector<uint8_t> gSelected;
+static std::size_t          gSelectedCount=0;
+static std::vector<NsVec2>  gLasso;
+static bool                 gSelecting=false;
+static bool                 gLassoMode=false;
+
+// Vertices in the window, reused across frames
+static std::vector<nodesoup::vertex_id_t> gVisibleVertices;
+
+// Debug info: the worker publishes the engine stats after every step, drawing is timed here
+constexpr int kStatsHistory=120;
+static std::mutex            gStatsMutex;
+static nodesoup::LayoutStats gEngineStats;
+static nodesoup::PhaseTimer  gDrawTimer;
+static std::size_t           gDrawnVertices=0;
+static std::size_t           gDrawnEdges=0;
 
 
 
@@ -605,7 +570,7 @@ struct MoveRes
   bool   m_Moved;
   bool   m_Recalculate;
   nodesoup::vertex_id_t m_Index;
-  ImVec2 m_Disp;
+  NsVec2 m_Disp;
 };
 
 
@@ -628,22 +593,34 @@ static ImVec2 GetStartPos() noexcept
 
 
 
-static nodesoup::vertex_id_t GetPosAt(const ImVec2& aPos,const std::vector<NsPosition>& aPositions)
+static NsVec2 ScreenToLayout(const ImVec2& aPos) noexcept
 {
   ImVec2 origin(kWindowInitWidth / 2.0, kWindowInitHeight / 2.0);
-  ImVec2 cursor_pos=GetStartPos();
+  return ToNsVec2((aPos-GetStartPos()-origin)/gScale);
+}
 
-  for(nodesoup::vertex_id_t v_id=0; v_id<aPositions.size(); v_id++)
-    {
-      ImVec2 v_pos = aPositions[v_id].m_Pos*gScale+origin+cursor_pos;
 
-      if(sq_dist(v_pos,aPos)< 2.0f*aPositions[v_id].m_Radius*aPositions[v_id].m_Radius)
-        {
-          return v_id;
-        }
-    }
 
-  return -1;
+static ImVec2 LayoutToScreen(const NsVec2& aPos) noexcept
+{
+  ImVec2 origin(kWindowInitWidth / 2.0, kWindowInitHeight / 2.0);
+  return ToImVec2(aPos)*gScale+origin+GetStartPos();
+}
+
+
+
+// Vertices keep their size when zooming in and shrink with the layout when zooming out
+static float GetScreenRadius(float aRadius) noexcept
+{
+  return aRadius*std::min(gScale,1.0f);
+}
+
+
+
+// Closest vertex under aPos, circles are picked up to sqrt(2) times their radius
+static nodesoup::vertex_id_t GetPosAt(const ImVec2& aPos)
+{
+  return gGrid.Pick(ScreenToLayout(aPos),1.41421356f*GetScreenRadius(1.0f)/gScale);
 }
 
 
@@ -651,7 +628,7 @@ static nodesoup::vertex_id_t GetPosAt(const ImVec2& aPos,const std::vector<NsPos
 
 
 
-static MoveRes MovePos(const std::vector<NsPosition>& aPositions)
+static MoveRes MovePos()
 {
   MoveRes res;
 
@@ -662,7 +639,7 @@ static MoveRes MovePos(const std::vector<NsPosition>& aPositions)
       if(io.MouseDown[1])
         {
           ImVec2 mouse_pos=io.MousePos;
-          gSelectedVertex=GetPosAt(mouse_pos,aPositions);
+          gSelectedVertex=GetPosAt(mouse_pos);
 
 
           res.m_Index=gSelectedVertex;
@@ -685,7 +662,7 @@ static MoveRes MovePos(const std::vector<NsPosition>& aPositions)
       if(io.MouseDown[1]) // Lo esta moviendo
         {
           res.m_Index=gSelectedVertex;
-          res.m_Disp=io.MouseDelta/gScale;
+          res.m_Disp=ToNsVec2(io.MouseDelta/gScale);
           res.m_Moved=true;
           res.m_Recalculate=false;
           return res;
@@ -702,7 +679,7 @@ static MoveRes MovePos(const std::vector<NsPosition>& aPositions)
             }
           else
             {
-              res.m_Disp=io.MouseDelta/gScale;
+              res.m_Disp=ToNsVec2(io.MouseDelta/gScale);
             }
 
           gSelectedVertex=kInvadidVertex;
@@ -718,9 +695,204 @@ static MoveRes MovePos(const std::vector<NsPosition>& aPositions)
 
 
 
-static void DrawData(const nodesoup::adj_list_t& aAdjList,const std::vector<NsPosition>& aPositions,bool aAllowMove
+// Hovered vertex, and rectangle or lasso selection with the left button.
+// The selection is replaced on release, or extended when shift is down.
+// The drag holds the active id so it does not move the window.
+static void UpdateSelection()
+{
+  ImGuiWindow* w=ImGui::GetCurrentWindow();
+  ImGuiIO& io=ImGui::GetIO();
+  const bool inside=ImGui::IsWindowHovered() && w->InnerClipRect.Contains(io.MousePos);
+  const ImGuiID selection_id=w->GetID("##selection");
+
+  gHoveredVertex=(inside ? GetPosAt(io.MousePos) : kInvadidVertex);
+
+  const NsVec2 mouse_pos=ScreenToLayout(io.MousePos);
+  if(!gSelecting)
+    {
+      if(inside && io.MouseClicked[0] && !ImGui::IsAnyItemHovered())
+        {
+          gSelecting=true;
+          gLassoMode=io.KeyCtrl;
+          gLasso.assign(1,mouse_pos);
+          ImGui::SetActiveID(selection_id,w);
+        }
+      return;
+    }
+
+  if(io.MouseDown[0])
+    {
+      ImGui::KeepAliveID(selection_id);
+      if(!gLassoMode)
+        {
+          gLasso.resize(1);
+          gLasso.push_back(mouse_pos);
+        }
+      else if(sq_dist(LayoutToScreen(gLasso.back()),io.MousePos)>kMinUIDist)
+        {
+          gLasso.push_back(mouse_pos);
+        }
+      return;
+    }
+
+  std::vector<nodesoup::vertex_id_t> hits;
+  if(gLassoMode)
+    {
+      gGrid.QueryLasso(gLasso,hits);
+    }
+  else if(gLasso.size()==2)
+    {
+      const NsVec2 min(std::min(gLasso[0].x,gLasso[1].x),std::min(gLasso[0].y,gLasso[1].y));
+      const NsVec2 max(std::max(gLasso[0].x,gLasso[1].x),std::max(gLasso[0].y,gLasso[1].y));
+      gGrid.QueryRect(min,max,hits);
+    }
+
+  if(!io.KeyShift)
+    {
+      std::fill(gSelected.begin(),gSelected.end(),0);
+    }
+  for(nodesoup::vertex_id_t v_id:hits)
+    {
+      if(v_id<gSelected.size())
+        {
+          gSelected[v_id]=1;
+        }
+    }
+  gSelectedCount=std::count(gSelected.begin(),gSelected.end(),1);
+
+  gSelecting=false;
+  gLasso.clear();
+  ImGui::ClearActiveID();
+}
+
+
+
+
+
+// Quads written straight into the draw list buffers, reserved in batches small enough for
+// 16 bits indices (the draw list moves to a new vertex offset between batches)
+class QuadBatch
+{
+public:
+
+  explicit QuadBatch(ImDrawList* aDrawList)
+      : m_DrawList(aDrawList)
+      , m_Uv(aDrawList->_Data->TexUvWhitePixel)
+      , m_Left(0)
+  {
+  }
+
+  ~QuadBatch()
+  {
+    if(m_Left)
+      {
+        m_DrawList->PrimUnreserve(m_Left*6,m_Left*4);
+      }
+  }
+
+  void Add(const ImVec2& aA,const ImVec2& aB,const ImVec2& aC,const ImVec2& aD,ImU32 aColor)
+  {
+    if(!m_Left)
+      {
+        m_DrawList->PrimReserve(kBatchQuads*6,kBatchQuads*4);
+        m_Left=kBatchQuads;
+      }
+
+    ImDrawVert* vtx=m_DrawList->_VtxWritePtr;
+    vtx[0].pos=aA; vtx[0].uv=m_Uv; vtx[0].col=aColor;
+    vtx[1].pos=aB; vtx[1].uv=m_Uv; vtx[1].col=aColor;
+    vtx[2].pos=aC; vtx[2].uv=m_Uv; vtx[2].col=aColor;
+    vtx[3].pos=aD; vtx[3].uv=m_Uv; vtx[3].col=aColor;
+
+    ImDrawIdx* idx=m_DrawList->_IdxWritePtr;
+    const ImDrawIdx base=static_cast<ImDrawIdx>(m_DrawList->_VtxCurrentIdx);
+    idx[0]=base; idx[1]=base+1; idx[2]=base+2;
+    idx[3]=base; idx[4]=base+2; idx[5]=base+3;
+
+    m_DrawList->_VtxWritePtr+=4;
+    m_DrawList->_IdxWritePtr+=6;
+    m_DrawList->_VtxCurrentIdx+=4;
+    m_Left--;
+  }
+
+private:
+
+  static constexpr int kBatchQuads=8192;
+
+  ImDrawList* m_DrawList;
+  ImVec2      m_Uv;
+  int         m_Left;
+};
+
+
+
+// Segments for a circle of aRadius pixels with at most half a pixel of error
+static int circle_segments(float aRadius) noexcept
+{
+  constexpr float kMaxError=0.5f;
+  if(aRadius<=kMaxError)
+    {
+      return 4;
+    }
+
+  const int segments=static_cast<int>(std::ceil(IM_PI/std::acos(1.0f-kMaxError/aRadius)));
+  return std::max(4,std::min(segments,64));
+}
+
+
+
+// Edges as one pixel wide quads. Edges with both ends on the same side out of aClip,
+// or shorter than half a pixel, are skipped. Returns the number of edges drawn.
+// The frame may have fewer vertices than aGraph, see LayoutWorker::GetPositions().
+static std::size_t DrawEdges(const nodesoup::CsrGraph& aGraph,const std::vector<NsPosition>& aPositions
+                     ,const ImRect& aClip,ImU32 aColor)
+{
+  const ImVec2 offset=LayoutToScreen({0.0f,0.0f});
+  QuadBatch batch(ImGui::GetWindowDrawList());
+  std::size_t drawn=0;
+
+  const std::size_t vertex_count=std::min(aGraph.GetVertexCount(),aPositions.size());
+  for(nodesoup::vertex_id_t v_id=0; v_id<vertex_count; v_id++)
+    {
+      const ImVec2 v_pos=ToImVec2(aPositions[v_id].m_Pos)*gScale+offset;
+
+      for(auto adj_id:aGraph.GetNeighbors(v_id))
+        {
+          if(adj_id < v_id || adj_id>=vertex_count)
+            {
+              continue;
+            }
+
+          const ImVec2 adj_pos=ToImVec2(aPositions[adj_id].m_Pos)*gScale+offset;
+          if((v_pos.x<aClip.Min.x && adj_pos.x<aClip.Min.x) || (v_pos.x>aClip.Max.x && adj_pos.x>aClip.Max.x)
+             || (v_pos.y<aClip.Min.y && adj_pos.y<aClip.Min.y) || (v_pos.y>aClip.Max.y && adj_pos.y>aClip.Max.y))
+            {
+              continue;
+            }
+
+          const ImVec2 delta=adj_pos-v_pos;
+          const float sq_length=delta.x*delta.x+delta.y*delta.y;
+          if(!(sq_length>0.25f))
+            {
+              continue;
+            }
+
+          // Half a pixel on each side
+          const float scale=0.5f/std::sqrt(sq_length);
+          const ImVec2 normal(-delta.y*scale,delta.x*scale);
+          batch.Add(v_pos+normal,adj_pos+normal,adj_pos-normal,v_pos-normal,aColor);
+          drawn++;
+        }
+    }
+  return drawn;
+}
+
+
+
+static void DrawData(const nodesoup::CsrGraph& aGraph,const std::vector<NsPosition>& aPositions,bool aAllowMove
                     ,bool aDrawDebug)
 {
+  NODESOUP_SCOPED_TIMER(gDrawTimer);
   ImGuiWindow* w=ImGui::GetCurrentWindow();
   ImGuiIO& io=ImGui::GetIO();
 
@@ -744,40 +916,76 @@ static void DrawData(const nodesoup::adj_list_t& aAdjList,const std::vector<NsPo
   ImDrawList* draw_list=ImGui::GetWindowDrawList();
   ImVec2 cursor_pos=GetStartPos();
 
-  ImVec2 origin(kWindowInitWidth/2.0,kWindowInitHeight/2.0);
-
   const ImU32 node_col=ImGui::GetColorU32(ImGuiCol_ScrollbarGrabActive);
   const ImU32 node_fix_col=ImGui::GetColorU32(ImGuiCol_NavHighlight);
   const ImU32 arc_col =ImGui::GetColorU32(ImGuiCol_ScrollbarGrab);
   const ImU32 txt_col =ImGui::GetColorU32(ImGuiCol_PlotLinesHovered);
+  const ImU32 sel_col =ImGui::GetColorU32(ImGuiCol_PlotHistogram);
+
+  const ImRect clip=w->InnerClipRect;
+  gDrawnEdges=DrawEdges(aGraph,aPositions,clip,arc_col);
 
+  // Only the vertices in the clip rect (grown by the biggest circle)
+  const float margin=GetScreenRadius(gGrid.GetMaxRadius());
+  std::vector<nodesoup::vertex_id_t>& visible=gVisibleVertices;
+  visible.clear();
+  gGrid.QueryRect(ScreenToLayout(clip.Min-ImVec2(margin,margin)),ScreenToLayout(clip.Max+ImVec2(margin,margin)),visible);
+  gDrawnVertices=visible.size();
 
-  for(nodesoup::vertex_id_t v_id=0; v_id<aAdjList.size(); v_id++)
+  // Vertices under a pixel are single pixel quads. The batch is closed before any other
+  // drawing, which would take the space it reserved.
+  {
+    QuadBatch points(draw_list);
+    for(nodesoup::vertex_id_t v_id:visible)
+      {
+        const NsPosition& curr_pos=aPositions[v_id];
+        if(GetScreenRadius(curr_pos.m_Radius)<1.0f)
+          {
+            const ImVec2 v_pos=LayoutToScreen(curr_pos.m_Pos);
+            const bool selected=v_id<gSelected.size() && gSelected[v_id];
+            const ImU32 col=selected?sel_col:(curr_pos.m_Fixed?node_fix_col:node_col);
+            points.Add(v_pos-ImVec2(0.5f,0.5f),v_pos+ImVec2(0.5f,-0.5f),v_pos+ImVec2(0.5f,0.5f),v_pos+ImVec2(-0.5f,0.5f),col);
+          }
+      }
+  }
+
+  for(nodesoup::vertex_id_t v_id:visible)
     {
       const NsPosition& curr_pos=aPositions[v_id];
-      ImVec2 v_pos=curr_pos.m_Pos*gScale+origin;
-
-      for(auto adj_id:aAdjList[v_id])
+      const float radius=GetScreenRadius(curr_pos.m_Radius);
+      if(radius<1.0f)
         {
-          if(adj_id < v_id)
-            {
-              continue;
-            }
-
-          ImVec2 adj_pos=aPositions[adj_id].m_Pos*gScale+origin;
-          draw_list->AddLine(cursor_pos+v_pos,cursor_pos+adj_pos,arc_col);
+          continue;
         }
 
-
-      draw_list->AddCircleFilled(cursor_pos+ImVec2(v_pos.x,v_pos.y),curr_pos.m_Radius, curr_pos.m_Fixed?node_fix_col:node_col);
+      const ImVec2 v_pos=LayoutToScreen(curr_pos.m_Pos);
+      const bool selected=v_id<gSelected.size() && gSelected[v_id];
+      draw_list->AddCircleFilled(v_pos,radius,selected?sel_col:(curr_pos.m_Fixed?node_fix_col:node_col),circle_segments(radius));
       if(aDrawDebug)
         {
-          draw_list->AddText(cursor_pos+ImVec2(v_pos.x,v_pos.y), txt_col, std::to_string(v_id).c_str());
-          draw_list->AddText(cursor_pos+ImVec2(v_pos.x,v_pos.y+20.0f), txt_col, std::to_string(v_pos.x).c_str());
-          draw_list->AddText(cursor_pos+ImVec2(v_pos.x,v_pos.y+40.0f), txt_col, std::to_string(v_pos.y).c_str());
+          const ImVec2 debug_pos=v_pos-cursor_pos;
+          draw_list->AddText(v_pos, txt_col, std::to_string(v_id).c_str());
+          draw_list->AddText(v_pos+ImVec2(0.0f,20.0f), txt_col, std::to_string(debug_pos.x).c_str());
+          draw_list->AddText(v_pos+ImVec2(0.0f,40.0f), txt_col, std::to_string(debug_pos.y).c_str());
         }
     }
 
+  if(gHoveredVertex<aPositions.size())
+    {
+      draw_list->AddCircle(LayoutToScreen(aPositions[gHoveredVertex].m_Pos),GetScreenRadius(aPositions[gHoveredVertex].m_Radius)+2.0f,txt_col);
+    }
+
+  if(gSelecting && gLassoMode)
+    {
+      std::vector<ImVec2> points(gLasso.size());
+      std::transform(gLasso.begin(),gLasso.end(),points.begin(),LayoutToScreen);
+      draw_list->AddPolyline(points.data(),static_cast<int>(points.size()),txt_col,ImDrawFlags_Closed,1.0f);
+    }
+  else if(gSelecting && gLasso.size()==2)
+    {
+      draw_list->AddRect(LayoutToScreen(gLasso[0]),LayoutToScreen(gLasso[1]),txt_col);
+    }
+
   ImGuiContext& g = *GImGui;
   ImGui::SetCursorPos({20.0f,w->InnerClipRect.GetHeight()-g.FontSize });
   ImGui::Text("x:%.3f  y:%.3f  scale:%.3f",gDisp.x,gDisp.y,gScale);
@@ -786,25 +994,115 @@ static void DrawData(const nodesoup::adj_list_t& aAdjList,const std::vector<NsPo
 
 
 
-void ShowNodeSoup()
+// Worker thread, after each step
+static void PublishStats(const nodesoup::LayoutStats& aStats)
 {
-  static std::vector<NsPosition> positions;
+  std::lock_guard<std::mutex> lock(gStatsMutex);
+  gEngineStats=aStats;
+}
+
+
+
+// Time of every phase per UI frame over the last kStatsHistory frames, from the cumulative
+// stats. Phases the engine does not have are hidden.
+static void ShowStats()
+{
+  if(!nodesoup::kStatsEnabled)
+    {
+      ImGui::Text("Stats compiled out (NODESOUP_STATS=0)");
+      return;
+    }
+
+  struct History
+  {
+    float         m_Ms[kStatsHistory]={};
+    std::uint64_t m_LastNanoseconds=0;
+  };
+  // One per engine phase, then drawing
+  static History history[nodesoup::LayoutStats::kPhaseCount+1];
+  static int offset=0;
+
+  nodesoup::LayoutStats stats;
+  {
+    std::lock_guard<std::mutex> lock(gStatsMutex);
+    stats=gEngineStats;
+  }
+
+  for(int phase=0; phase<=nodesoup::LayoutStats::kPhaseCount; phase++)
+    {
+      const nodesoup::PhaseTimer& timer=phase<nodesoup::LayoutStats::kPhaseCount ? stats.m_Phases[phase] : gDrawTimer;
+      History& h=history[phase];
+      // The stats restart with the engine
+      h.m_Ms[offset]=timer.m_Nanoseconds>=h.m_LastNanoseconds ? static_cast<float>(timer.m_Nanoseconds-h.m_LastNanoseconds)/1e6f : 0.0f;
+      h.m_LastNanoseconds=timer.m_Nanoseconds;
+    }
+  offset=(offset+1)%kStatsHistory;
+
+  const int last=(offset+kStatsHistory-1)%kStatsHistory;
+  for(int phase=0; phase<=nodesoup::LayoutStats::kPhaseCount; phase++)
+    {
+      const bool draw=phase==nodesoup::LayoutStats::kPhaseCount;
+      if(!draw && !stats.m_Phases[phase].m_Calls)
+        {
+          continue;
+        }
 
+      char overlay[32];
+      std::snprintf(overlay,sizeof(overlay),"%.2f ms",history[phase].m_Ms[last]);
+      const char* name=draw ? "Draw" : nodesoup::LayoutStats::GetPhaseName(static_cast<nodesoup::LayoutStats::Phase>(phase));
+      ImGui::PlotHistogram(name,history[phase].m_Ms,kStatsHistory,offset,overlay,0.0f,FLT_MAX,ImVec2(0.0f,40.0f));
+    }
+
+  ImGui::Text("Pairs: %llu  Moved: %llu  Allocated: %.1f MB",static_cast<unsigned long long>(stats.m_PairEvaluations)
+              ,static_cast<unsigned long long>(stats.m_VerticesMoved),static_cast<double>(stats.m_BytesAllocated)/(1024.0*1024.0));
+  ImGui::Text("Drawn: %zu vertices, %zu edges",gDrawnVertices,gDrawnEdges);
+}
+
+
+
+void ShowNodeSoup()
+{
   float k=15.0;
 
-  static nodesoup::adj_list_t adj_list;
-  static nodesoup::FruchtermanReingold fr(adj_list,k);
-  static nodesoup::KamadaKawai ka(adj_list,k);
+  static nodesoup::CsrGraph graph;
+  static nodesoup::FruchtermanReingold fr(graph,k);
+  static nodesoup::KamadaKawai ka(graph,k);
+  static nodesoup::MultilevelFruchtermanReingold ml(graph,k);
+  static nodesoup::StressMajorization sm(graph,k);
+
+  // The engines run on the worker thread, the UI only talks to them through it
+  static nodesoup::LayoutWorker worker;
+  static std::atomic<float> shared_theta{0.0f};
+  static std::atomic<bool> shared_local_relaxation{true};
+  static std::atomic<int> ml_level{0};
+  static std::atomic<int> ml_level_count{0};
+  // Iterations of the layout, vertex moves for Kamada-Kawai
+  static std::atomic<int> layout_iter{0};
+  static std::atomic<double> layout_temperature{0.0};
+
+  // Saved layout, read on load only: the graph owns a copy of its arrays, so saving over
+  // the file never touches a graph the worker is laying out.
+  // Engines warm start from warm_positions when it is not empty, and count their
+  // iterations from warm_iteration.
+  static nodesoup::LayoutSnapshot snapshot;
+  static std::vector<NsPosition> warm_positions;
+  static double warm_temperature=0.0;
+  static int warm_iteration=0;
 
   constexpr int kFruchtermanReingold=0;
   constexpr int kKamadaKawai=1;
+  constexpr int kMultilevel=2;
+  constexpr int kStress=3;
   static int method=kFruchtermanReingold;
 
-  constexpr int kCircle=0;
-  constexpr int kRandom=1;
+  constexpr int kCircle=static_cast<int>(nodesoup::InitMode::kCircle);
+  constexpr int kRandom=static_cast<int>(nodesoup::InitMode::kRandom);
+  constexpr int kPivotMds=static_cast<int>(nodesoup::InitMode::kPivotMds);
   static int init_mode=kCircle;
 
   static bool draw_debug=false;
+  static float theta=0.0f;
+  static bool local_relaxation=true;
 
 
   ImGui::SetNextWindowPos(ImVec2(0.0f, 0.0f), ImGuiCond_Appearing);
@@ -817,6 +1115,8 @@ void ShowNodeSoup()
       ImGui::BeginGroup();
         ImGui::RadioButton("Fruchterman Reingold",&method,kFruchtermanReingold);
         ImGui::RadioButton("Kamada Kawai",&method,kKamadaKawai);
+        ImGui::RadioButton("Multilevel FR",&method,kMultilevel);
+        ImGui::RadioButton("Stress majorization",&method,kStress);
       ImGui::EndGroup();
 
       ImGui::SameLine(350.0f);
@@ -824,6 +1124,7 @@ void ShowNodeSoup()
       ImGui::BeginGroup();
         ImGui::RadioButton("Init circle",&init_mode,kCircle);
         ImGui::RadioButton("Init random",&init_mode,kRandom);
+        ImGui::RadioButton("Init pivot MDS",&init_mode,kPivotMds);
       ImGui::EndGroup();
 
       const char* items[]={"None","K6","K6-2","Small dense","Bin tree","Quad tree"};
@@ -832,60 +1133,204 @@ void ShowNodeSoup()
       bool change=ImGui::Combo("Data", &item_current,items,IM_ARRAYSIZE(items));
       ImGui::SameLine();
       change|=ImGui::SmallButton("R");
+      ImGui::SameLine();
+      const bool save=ImGui::SmallButton("Save");
+      ImGui::SameLine();
+      const bool load=ImGui::SmallButton("Load");
+
+      if(method==kFruchtermanReingold || method==kMultilevel)
+        {
+          ImGui::SliderFloat("Barnes-Hut theta",&theta,0.0f,1.5f);
+          shared_theta.store(theta);
+          ImGui::Checkbox("Local relaxation on drop",&local_relaxation);
+          shared_local_relaxation.store(local_relaxation);
+        }
 
       ImGui::NewLine();
       ImGui::Checkbox("Show debug info",&draw_debug);
       if(draw_debug)
         {
           ImGui::NewLine();
-          ImGui::Text("Energy: %.3f",static_cast<float>(method==kFruchtermanReingold?fr.GetEnergy() : ka.GetEnergy()  ));
+          ImGui::Text("Energy: %.3f",static_cast<float>(worker.GetEnergy()));
+          ImGui::Text("Steps: %llu%s",worker.GetStepCount(),worker.IsIdle() ? " (converged)" : "");
+          ImGui::Text("Iterations: %d",layout_iter.load());
+          ImGui::Text("Selected: %zu",gSelectedCount);
+          if(method==kMultilevel)
+            {
+              ImGui::Text("Level: %d/%d",ml_level.load(),ml_level_count.load());
+            }
+          ShowStats();
         }
 
-      if(prev_method!=method || change)
+      if(save && !graph.IsEmpty())
         {
-          adj_list=read_from_dot(items_data[item_current]);
-          positions.resize(adj_list.size());
-          nodesoup::SetRadiuses(adj_list,positions);
+          nodesoup::LayoutState state;
+          state.m_K=k;
+          state.m_Iteration=layout_iter.load();
+          if(method==kFruchtermanReingold || method==kMultilevel)
+            {
+              state.m_Temperature=layout_temperature.load();
+            }
+          nodesoup::SaveLayoutSnapshot(kSnapshotPath,graph,worker.GetPositions(),state);
+        }
 
+      if(prev_method!=method || change || load)
+        {
+          worker.Stop();
 
-          if(method==kFruchtermanReingold)
+          std::vector<NsPosition> positions;
+          warm_positions.clear();
+          warm_iteration=0;
+          if(load && snapshot.Open(kSnapshotPath))
             {
-              fr.Start(init_mode==kCircle);
+              graph=snapshot.GetGraph();
+              graph.MakeOwned();
+              snapshot.GetPositions(warm_positions);
+              const double temperature=snapshot.GetState().m_Temperature;
+              warm_temperature=(temperature>0.0 ? temperature : k);
+              warm_iteration=snapshot.GetState().m_Iteration;
+              positions=warm_positions;
+              snapshot.Close();
             }
           else
             {
-              ka.Start(init_mode==kCircle);
+              nodesoup::DotGraph dot;
+              nodesoup::ParseDot(items_data[item_current],dot);
+              graph=std::move(dot.m_Graph);
+
+              positions.resize(graph.GetVertexCount());
+              nodesoup::SetRadiuses(graph,positions);
+            }
+          layout_iter.store(warm_iteration);
+          layout_temperature.store(0.0);
+
+          gGridStep=~0ull;
+          gHoveredVertex=kInvadidVertex;
+          gSelected.assign(graph.GetVertexCount(),0);
+          gSelectedCount=0;
+
+          const nodesoup::InitMode init=static_cast<nodesoup::InitMode>(init_mode);
+          if(!graph.IsEmpty())
+            {
+              if(method==kFruchtermanReingold)
+                {
+                  worker.Start(positions,[init]
+                               {
+                                 warm_positions.empty() ? fr.Start(init) : fr.Start(warm_positions,warm_temperature);
+                               }
+                              ,[](std::vector<NsPosition>& aPositions)
+                               {
+                                 fr.SetTheta(shared_theta.load());
+                                 fr.StepFor(kLayoutBudget,aPositions);
+                                 layout_iter.store(warm_iteration+fr.GetCurrIter());
+                                 layout_temperature.store(fr.GetTemperature());
+                                 PublishStats(fr.GetStats());
+                                 return fr.GetEnergy();
+                               }
+                              ,[](nodesoup::vertex_id_t aVertexId,const NsVec2& aDisp,bool aRecalculate)
+                               {
+                                 fr.SetLocalRelaxation(shared_local_relaxation.load());
+                                 fr.MovePos(aVertexId,aDisp,aRecalculate);
+                               }
+                              ,[]
+                               {
+                                 return fr.IsConverged();
+                               });
+                }
+              else if(method==kMultilevel)
+                {
+                  worker.Start(positions,[init]
+                               {
+                                 warm_positions.empty() ? ml.Start(init) : ml.Start(warm_positions,warm_temperature);
+                               }
+                              ,[](std::vector<NsPosition>& aPositions)
+                               {
+                                 ml.SetTheta(shared_theta.load());
+                                 ml.Step(15,0,aPositions);
+                                 layout_iter.store(warm_iteration+ml.GetCurrIter());
+                                 ml_level.store(static_cast<int>(ml.GetLevel()));
+                                 ml_level_count.store(static_cast<int>(ml.GetLevelCount()));
+                                 layout_temperature.store(ml.GetTemperature());
+                                 PublishStats(ml.GetStats());
+                                 return ml.GetEnergy();
+                               }
+                              ,[](nodesoup::vertex_id_t aVertexId,const NsVec2& aDisp,bool aRecalculate)
+                               {
+                                 ml.SetLocalRelaxation(shared_local_relaxation.load());
+                                 ml.MovePos(aVertexId,aDisp,aRecalculate);
+                               }
+                              ,[]
+                               {
+                                 return ml.IsConverged();
+                               });
+                }
+              else if(method==kStress)
+                {
+                  worker.Start(positions,[init]
+                               {
+                                 warm_positions.empty() ? sm.Start(init) : sm.Start(warm_positions);
+                               }
+                              ,[](std::vector<NsPosition>& aPositions)
+                               {
+                                 sm.Step(1,aPositions);
+                                 layout_iter.store(warm_iteration+sm.GetCurrIter());
+                                 PublishStats(sm.GetStats());
+                                 return sm.GetEnergy();
+                               }
+                              ,[](nodesoup::vertex_id_t aVertexId,const NsVec2& aDisp,bool aRecalculate)
+                               {
+                                 sm.MovePos(aVertexId,aDisp,aRecalculate);
+                               }
+                              ,[]
+                               {
+                                 return sm.IsConverged();
+                               });
+                }
+              else
+                {
+                  worker.Start(positions,[init]
+                               {
+                                 warm_positions.empty() ? ka.Start(init) : ka.Start(warm_positions);
+                               }
+                              ,[](std::vector<NsPosition>& aPositions)
+                               {
+                                 const nodesoup::StepProgress progress=ka.StepFor(kLayoutBudget,kWindowInitWidth,kWindowInitHeight,aPositions);
+                                 layout_iter.fetch_add(progress.m_Iterations);
+                                 PublishStats(ka.GetStats());
+                                 return ka.GetEnergy();
+                               }
+                              ,[](nodesoup::vertex_id_t aVertexId,const NsVec2& aDisp,bool aRecalculate)
+                               {
+                                 ka.MovePos(aVertexId,aDisp,aRecalculate);
+                               }
+                              ,[]
+                               {
+                                 return ka.IsConverged();
+                               });
+                }
             }
         }
 
-        if(!adj_list.empty())
-          {
-            if(method==kFruchtermanReingold)
-              {
-                fr.Step(15,0,positions);
-              }
-            else
-              {
-                ka.Step(kWindowInitWidth,kWindowInitHeight,positions);
-              }
-          }
+      // Newest frame of the worker, never waits for a step to finish.
+      // The step count is read first: a frame published in between is indexed on the next call.
+      const unsigned long long step=worker.GetStepCount();
+      const std::vector<NsPosition>& positions=worker.GetPositions();
+      if(step!=gGridStep)
+        {
+          gGrid.Update(positions);
+          gGridStep=step;
+        }
 
-      MoveRes r=MovePos(positions);
+      UpdateSelection();
+      MoveRes r=MovePos();
       if(r.m_Moved)
         {
-          if(method==kFruchtermanReingold)
-            {
-              fr.MovePos(r.m_Index,r.m_Disp,r.m_Recalculate);
-            }
-          else
-            {
-              ka.MovePos(r.m_Index,r.m_Disp,r.m_Recalculate);
-            }
+          worker.MovePos(r.m_Index,r.m_Disp,r.m_Recalculate);
         }
 
-      DrawData(adj_list,positions,!r.m_Moved,draw_debug);
+      DrawData(graph,positions,!r.m_Moved,draw_debug);
 
       ImGui::End();
     }
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <cstddef>
+#include <new>
+
+namespace nodesoup
+{
+
+
+// Allocator for std::vector whose buffer starts on a cache line (or SIMD register) boundary
+template<typename T,std::size_t Alignment=64>
+struct AlignedAllocator
+{
+  using value_type=T;
+
+  template<typename U>
+  struct rebind
+  {
+    using other=AlignedAllocator<U,Alignment>;
+  };
+
+  AlignedAllocator() noexcept=default;
+
+  template<typename U>
+  AlignedAllocator(const AlignedAllocator<U,Alignment>&) noexcept
+  {
+  }
+
+  T* allocate(std::size_t aCount)
+  {
+    return static_cast<T*>(::operator new(aCount*sizeof(T),std::align_val_t(Alignment)));
+  }
+
+  void deallocate(T* aPtr,std::size_t) noexcept
+  {
+    ::operator delete(aPtr,std::align_val_t(Alignment));
+  }
+};
+
+
+template<typename T,typename U,std::size_t Alignment>
+inline bool operator==(const AlignedAllocator<T,Alignment>&,const AlignedAllocator<U,Alignment>&) noexcept
+{
+  return true;
+}
+
+template<typename T,typename U,std::size_t Alignment>
+inline bool operator!=(const AlignedAllocator<T,Alignment>&,const AlignedAllocator<U,Alignment>&) noexcept
+{
+  return false;
+}
+
+
+}
@@ -0,0 +1,500 @@
+#include "barnes_hut.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+namespace nodesoup
+{
+
+
+// Cells with coincident vertices would split forever
+static constexpr int kMaxDepth=24;
+
+
+
+
+template<typename Scalar,typename Index,int Dim>
+void BarnesHutTree<Scalar,Index,Dim>::Build(const BasicSoAPositions<Scalar,Dim>& aPositions)
+{
+  m_Positions=&aPositions;
+  m_Nodes.clear();
+  m_Indices.resize(aPositions.GetCount());
+  m_Scratch.resize(aPositions.GetCount());
+  std::iota(m_Indices.begin(),m_Indices.end(),Index(0));
+  m_Leaves.resize(aPositions.GetCount());
+  m_Slots.resize(aPositions.GetCount());
+  m_Points.resize(aPositions.GetCount());
+  m_FreeCount=0;
+
+  if(!aPositions.GetCount())
+    {
+      return;
+    }
+
+  // find bounding square (cube)
+  vec_t min;
+  vec_t max;
+  Scalar size=0;
+  for(int axis=0; axis<Dim; axis++)
+    {
+      const scalar_array_t<Scalar>& coords=aPositions.m_Coords[axis];
+      min[axis]=*std::min_element(coords.begin(),coords.end());
+      max[axis]=*std::max_element(coords.begin(),coords.end());
+      size=std::max(size,max[axis]-min[axis]);
+    }
+
+  if(size<=0)
+    {
+      size=1;
+    }
+
+  m_Nodes.reserve(2*aPositions.GetCount()/kLeafSize+1);
+  m_Nodes.emplace_back();
+  m_Nodes[0].m_Parent=-1;
+  BuildNode(0,0,static_cast<int32_t>(aPositions.GetCount()),min,size,0);
+}
+
+
+
+
+// Fills node aNodeId and recursively its children, which are stored contiguously
+template<typename Scalar,typename Index,int Dim>
+void BarnesHutTree<Scalar,Index,Dim>::BuildNode(int32_t aNodeId,int32_t aBegin,int32_t aEnd,const vec_t& aMin,Scalar aSize,int aDepth)
+{
+  const BasicSoAPositions<Scalar,Dim>& positions=*m_Positions;
+
+  m_Nodes[aNodeId].m_Min=aMin;
+  m_Nodes[aNodeId].m_Size=aSize;
+  m_Nodes[aNodeId].m_Extent=aSize;
+  m_Nodes[aNodeId].m_Begin=aBegin;
+  m_Nodes[aNodeId].m_End=aEnd;
+  m_Nodes[aNodeId].m_Limit=aEnd;
+  m_Nodes[aNodeId].m_Mass=static_cast<Scalar>(aEnd-aBegin);
+  m_Nodes[aNodeId].m_FirstChild=-1;
+  m_Nodes[aNodeId].m_ChildCount=0;
+
+  if(aEnd-aBegin<=kLeafSize || aDepth>=kMaxDepth)
+    {
+      vec_t center;
+      for(int32_t k=aBegin; k<aEnd; k++)
+        {
+          const Index v_id=m_Indices[k];
+          m_Leaves[v_id]=aNodeId;
+          m_Slots[v_id]=k;
+          m_Points[v_id]=positions.Get(v_id);
+          center+=m_Points[v_id];
+          GrowExtent(m_Nodes[aNodeId],m_Points[v_id],Scalar(0));
+        }
+      m_Nodes[aNodeId].m_Center=center/static_cast<Scalar>(aEnd-aBegin);
+      return;
+    }
+
+  // counting sort of the range by quadrant (octant), bit a set past the middle of axis a
+  Scalar half=aSize*Scalar(0.5);
+  vec_t mid=aMin;
+  for(int axis=0; axis<Dim; axis++)
+    {
+      mid[axis]+=half;
+    }
+
+  auto quadrant=[&positions,&mid](Index aVertexId) -> int
+  {
+    int res=0;
+    for(int axis=0; axis<Dim; axis++)
+      {
+        res+=(positions.m_Coords[axis][aVertexId]>=mid[axis] ? 1<<axis : 0);
+      }
+    return res;
+  };
+
+  int32_t counts[kChildCount]={};
+  for(int32_t k=aBegin; k<aEnd; k++)
+    {
+      counts[quadrant(m_Indices[k])]++;
+    }
+
+  int32_t starts[kChildCount+1]={aBegin};
+  for(int q=0; q<kChildCount; q++)
+    {
+      starts[q+1]=starts[q]+counts[q];
+    }
+
+  int32_t cursor[kChildCount];
+  std::copy(starts,starts+kChildCount,cursor);
+  for(int32_t k=aBegin; k<aEnd; k++)
+    {
+      Index v_id=m_Indices[k];
+      m_Scratch[cursor[quadrant(v_id)]++]=v_id;
+    }
+  std::copy(m_Scratch.begin()+aBegin,m_Scratch.begin()+aEnd,m_Indices.begin()+aBegin);
+
+  // children are reserved first so they stay contiguous
+  int32_t first_child=static_cast<int32_t>(m_Nodes.size());
+  int32_t child_count=0;
+  for(int q=0; q<kChildCount; q++)
+    {
+      if(counts[q])
+        {
+          m_Nodes.emplace_back();
+          m_Nodes.back().m_Parent=aNodeId;
+          child_count++;
+        }
+    }
+  m_Nodes[aNodeId].m_FirstChild=first_child;
+  m_Nodes[aNodeId].m_ChildCount=child_count;
+
+  vec_t center;
+  int32_t child_id=first_child;
+  for(int q=0; q<kChildCount; q++)
+    {
+      if(!counts[q])
+        {
+          continue;
+        }
+
+      vec_t child_min;
+      for(int axis=0; axis<Dim; axis++)
+        {
+          child_min[axis]=(q&(1<<axis)) ? mid[axis] : aMin[axis];
+        }
+      BuildNode(child_id,starts[q],starts[q+1],child_min,half,aDepth+1);
+
+      const Node& child=m_Nodes[child_id];
+      vec_t child_mid=child.m_Min;
+      for(int axis=0; axis<Dim; axis++)
+        {
+          child_mid[axis]+=half*Scalar(0.5);
+        }
+      GrowExtent(m_Nodes[aNodeId],child_mid,child.m_Extent*Scalar(0.5));
+      center+=child.m_Center*child.m_Mass;
+      child_id++;
+    }
+
+  m_Nodes[aNodeId].m_Center=center/m_Nodes[aNodeId].m_Mass;
+}
+
+
+
+
+// An empty tree, or one with as many free slots as vertices, is built again
+template<typename Scalar,typename Index,int Dim>
+void BarnesHutTree<Scalar,Index,Dim>::AddVertex()
+{
+  const Index v_id=static_cast<Index>(m_Leaves.size());
+  assert(m_Positions && m_Positions->GetCount()==m_Leaves.size()+1);
+  if(m_Nodes.empty() || m_FreeCount>m_Leaves.size())
+    {
+      Build(*m_Positions);
+      return;
+    }
+
+  m_Leaves.push_back(-1);
+  m_Slots.push_back(-1);
+  m_Points.push_back(m_Positions->Get(v_id));
+  Insert(v_id);
+}
+
+
+
+
+template<typename Scalar,typename Index,int Dim>
+void BarnesHutTree<Scalar,Index,Dim>::RemoveVertex(Index aVertexId)
+{
+  Erase(aVertexId);
+
+  const Index last=static_cast<Index>(m_Leaves.size()-1);
+  if(aVertexId!=last)
+    {
+      m_Indices[m_Slots[last]]=aVertexId;
+      m_Leaves[aVertexId]=m_Leaves[last];
+      m_Slots[aVertexId]=m_Slots[last];
+      m_Points[aVertexId]=m_Points[last];
+    }
+  m_Leaves.pop_back();
+  m_Slots.pop_back();
+  m_Points.pop_back();
+}
+
+
+
+
+// Inside its cell the vertex only moves the centers of mass, out of it it changes leaf. The
+// tree is built again once the leaves moved to grow left as many free slots as vertices.
+template<typename Scalar,typename Index,int Dim>
+void BarnesHutTree<Scalar,Index,Dim>::MoveVertex(Index aVertexId)
+{
+  const vec_t pos=m_Positions->Get(aVertexId);
+  const Node& leaf=m_Nodes[m_Leaves[aVertexId]];
+  bool inside=true;
+  for(int axis=0; axis<Dim; axis++)
+    {
+      inside=inside && pos[axis]>=leaf.m_Min[axis] && pos[axis]<=leaf.m_Min[axis]+leaf.m_Size;
+    }
+
+  if(inside)
+    {
+      const vec_t delta=pos-m_Points[aVertexId];
+      for(int32_t node_id=m_Leaves[aVertexId]; node_id>=0; node_id=m_Nodes[node_id].m_Parent)
+        {
+          m_Nodes[node_id].m_Center+=delta/m_Nodes[node_id].m_Mass;
+        }
+      m_Points[aVertexId]=pos;
+      return;
+    }
+
+  if(m_FreeCount>m_Leaves.size())
+    {
+      Build(*m_Positions);
+      return;
+    }
+  Erase(aVertexId);
+  m_Points[aVertexId]=pos;
+  Insert(aVertexId);
+}
+
+
+
+
+// Puts aVertexId in the leaf of m_Points[aVertexId]. A full leaf moves to the end of
+// m_Indices with room for as many vertices again, and splits past kLeafSize vertices.
+template<typename Scalar,typename Index,int Dim>
+void BarnesHutTree<Scalar,Index,Dim>::Insert(Index aVertexId)
+{
+  const int32_t leaf_id=FindLeaf(m_Points[aVertexId]);
+  AddToPath(leaf_id,m_Points[aVertexId],Scalar(1));
+
+  Node& leaf=m_Nodes[leaf_id];
+  if(leaf.m_End==leaf.m_Limit)
+    {
+      const int32_t count=leaf.m_End-leaf.m_Begin;
+      const int32_t begin=static_cast<int32_t>(m_Indices.size());
+      m_Indices.resize(m_Indices.size()+std::max<int32_t>(2*count,kLeafSize));
+      for(int32_t k=0; k<count; k++)
+        {
+          const Index v_id=m_Indices[leaf.m_Begin+k];
+          m_Indices[begin+k]=v_id;
+          m_Slots[v_id]=begin+k;
+        }
+      m_FreeCount+=leaf.m_Limit-leaf.m_Begin;
+      leaf.m_Begin=begin;
+      leaf.m_End=begin+count;
+      leaf.m_Limit=static_cast<int32_t>(m_Indices.size());
+    }
+
+  m_Indices[leaf.m_End]=aVertexId;
+  m_Slots[aVertexId]=leaf.m_End;
+  m_Leaves[aVertexId]=leaf_id;
+  leaf.m_End++;
+
+  if(leaf.m_End-leaf.m_Begin>kLeafSize)
+    {
+      SplitLeaf(leaf_id);
+    }
+}
+
+
+
+
+// The last vertex of the leaf takes the slot of aVertexId
+template<typename Scalar,typename Index,int Dim>
+void BarnesHutTree<Scalar,Index,Dim>::Erase(Index aVertexId)
+{
+  const int32_t leaf_id=m_Leaves[aVertexId];
+  Node& leaf=m_Nodes[leaf_id];
+  const int32_t slot=m_Slots[aVertexId];
+  const Index moved_id=m_Indices[--leaf.m_End];
+  m_Indices[slot]=moved_id;
+  m_Slots[moved_id]=slot;
+
+  AddToPath(leaf_id,m_Points[aVertexId],Scalar(-1));
+}
+
+
+
+
+// Adds aMass (1 or -1) at aPos to aNodeId and the nodes above it. Added vertices grow the
+// extents of the cells that do not hold them, removed ones leave them until the next Build().
+template<typename Scalar,typename Index,int Dim>
+void BarnesHutTree<Scalar,Index,Dim>::AddToPath(int32_t aNodeId,const vec_t& aPos,Scalar aMass) noexcept
+{
+  for(int32_t node_id=aNodeId; node_id>=0; node_id=m_Nodes[node_id].m_Parent)
+    {
+      Node& node=m_Nodes[node_id];
+      const Scalar mass=node.m_Mass+aMass;
+      if(mass>0)
+        {
+          node.m_Center=(node.m_Center*node.m_Mass+aPos*aMass)/mass;
+        }
+      node.m_Mass=mass;
+      if(aMass>0)
+        {
+          GrowExtent(node,aPos,Scalar(0));
+        }
+    }
+}
+
+
+
+
+// Grows the extent of aNode to the square (cube) of half side aHalfSide around aCenter
+template<typename Scalar,typename Index,int Dim>
+void BarnesHutTree<Scalar,Index,Dim>::GrowExtent(Node& aNode,const vec_t& aCenter,Scalar aHalfSide) noexcept
+{
+  const Scalar half=aNode.m_Size*Scalar(0.5);
+  for(int axis=0; axis<Dim; axis++)
+    {
+      const Scalar distance=std::abs(aCenter[axis]-(aNode.m_Min[axis]+half))+aHalfSide;
+      aNode.m_Extent=std::max(aNode.m_Extent,2*distance);
+    }
+}
+
+
+
+
+// Down the quadrants (octants) of aPos. Only the quadrants with vertices have a node: past
+// the vertices of the last Build() aPos may fall in an empty one, or out of the root: the
+// nearest child is taken, and Insert() grows the extents of the cells up to it.
+template<typename Scalar,typename Index,int Dim>
+int32_t BarnesHutTree<Scalar,Index,Dim>::FindLeaf(const vec_t& aPos) const noexcept
+{
+  int32_t node_id=0;
+  while(m_Nodes[node_id].m_FirstChild>=0)
+    {
+      const Node& node=m_Nodes[node_id];
+      const Scalar half=node.m_Size*Scalar(0.5);
+      int32_t next_id=-1;
+      Scalar next_distance=std::numeric_limits<Scalar>::max();
+      for(int32_t c=0; c<node.m_ChildCount; c++)
+        {
+          const Node& child=m_Nodes[node.m_FirstChild+c];
+          bool same_quadrant=true;
+          for(int axis=0; axis<Dim; axis++)
+            {
+              same_quadrant=same_quadrant && (aPos[axis]>=node.m_Min[axis]+half)==(child.m_Min[axis]>node.m_Min[axis]);
+            }
+          if(same_quadrant)
+            {
+              next_id=node.m_FirstChild+c;
+              break;
+            }
+
+          const Scalar distance=sq_norm(aPos-child.m_Center);
+          if(distance<next_distance)
+            {
+              next_id=node.m_FirstChild+c;
+              next_distance=distance;
+            }
+        }
+      node_id=next_id;
+    }
+  return node_id;
+}
+
+
+
+
+// The leaf is built again as a subtree from the current positions of its vertices, the
+// nodes above it take the change of its center of mass
+template<typename Scalar,typename Index,int Dim>
+void BarnesHutTree<Scalar,Index,Dim>::SplitLeaf(int32_t aNodeId)
+{
+  int depth=0;
+  for(int32_t node_id=m_Nodes[aNodeId].m_Parent; node_id>=0; node_id=m_Nodes[node_id].m_Parent)
+    {
+      depth++;
+    }
+  if(depth>=kMaxDepth)
+    {
+      return;
+    }
+
+  const Node leaf=m_Nodes[aNodeId];
+  m_FreeCount+=leaf.m_Limit-leaf.m_End;
+  m_Scratch.resize(m_Indices.size());
+  BuildNode(aNodeId,leaf.m_Begin,leaf.m_End,leaf.m_Min,leaf.m_Size,depth);
+
+  const vec_t delta=m_Nodes[aNodeId].m_Center*m_Nodes[aNodeId].m_Mass-leaf.m_Center*leaf.m_Mass;
+  for(int32_t node_id=leaf.m_Parent; node_id>=0; node_id=m_Nodes[node_id].m_Parent)
+    {
+      m_Nodes[node_id].m_Center+=delta/m_Nodes[node_id].m_Mass;
+    }
+}
+
+
+
+
+template<typename Scalar,typename Index,int Dim>
+typename BarnesHutTree<Scalar,Index,Dim>::vec_t BarnesHutTree<Scalar,Index,Dim>::ComputeRepulsion(Index aVertexId,Scalar aKSquared,Scalar aTheta
+                                                                                                  ,[[maybe_unused]] std::uint64_t& aTerms) const noexcept
+{
+  vec_t mvmt;
+  if(m_Nodes.empty())
+    {
+      return mvmt;
+    }
+
+  const BasicSoAPositions<Scalar,Dim>& positions=*m_Positions;
+  const vec_t pos=positions.Get(aVertexId);
+
+  int32_t stack[kChildCount*kMaxDepth+kChildCount];
+  int stack_size=0;
+  stack[stack_size++]=0;
+
+  while(stack_size)
+    {
+      const Node& node=m_Nodes[stack[--stack_size]];
+
+      if(node.m_FirstChild<0)
+        {
+          for(int32_t k=node.m_Begin; k<node.m_End; k++)
+            {
+              Index other_id=m_Indices[k];
+              if(other_id==aVertexId)
+                {
+                  continue;
+                }
+
+              vec_t delta=pos-positions.Get(other_id);
+              Scalar distance=norm(delta);
+              if(distance==0)
+                {
+                  continue;
+                }
+
+              Scalar repulsion=aKSquared/distance;
+              mvmt+=delta/distance*repulsion;
+              NODESOUP_COUNT(aTerms,1);
+            }
+          continue;
+        }
+
+      vec_t delta=pos-node.m_Center;
+      Scalar distance=norm(delta);
+      if(distance>0 && node.m_Extent<aTheta*distance)
+        {
+          Scalar repulsion=node.m_Mass*aKSquared/distance;
+          mvmt+=delta/distance*repulsion;
+          NODESOUP_COUNT(aTerms,1);
+          continue;
+        }
+
+      for(int32_t c=0; c<node.m_ChildCount; c++)
+        {
+          stack[stack_size++]=node.m_FirstChild+c;
+        }
+    }
+
+  return mvmt;
+}
+
+
+
+
+#define NODESOUP_INSTANTIATE_(aScalar,aIndex,aDim) template class BarnesHutTree<aScalar,aIndex,aDim>;
+NODESOUP_FOR_EACH_LAYOUT_TYPE(NODESOUP_INSTANTIATE_)
+#undef NODESOUP_INSTANTIATE_
+
+
+}
@@ -0,0 +1,104 @@
+#pragma once
+#include "nodesoup.hpp"
+#include "force_kernels.hpp"
+#include "layout_stats.hpp"
+#include <cstdint>
+#include <vector>
+
+namespace nodesoup
+{
+// Barnes-Hut approximation of the Fruchterman-Reingold repulsion
+// https://en.wikipedia.org/wiki/Barnes%E2%80%93Hut_simulation
+
+
+
+// Quadtree in 2D, octree in 3D. Index is the type of the vertex ids it sorts.
+template<typename Scalar,typename Index,int Dim>
+class BarnesHutTree
+{
+public:
+
+  using vec_t=NsVec<Scalar,Dim>;
+
+  // Leaves hold up to this number of vertices, computed exactly
+  static constexpr int kLeafSize=8;
+  static constexpr int kChildCount=1<<Dim;
+
+  void Build(const BasicSoAPositions<Scalar,Dim>& aPositions);
+
+  // Updates for a few vertices between two Build(), O(depth) each: the vertices go to the
+  // leaf holding their position and the centers of mass follow. The cells keep their bounds,
+  // their extents grow to the vertices filed under them out of these.
+  // AddVertex() takes the vertex appended to the positions given to Build(), RemoveVertex()
+  // gives the last vertex the removed id as BasicCsrGraph::RemoveVertex() and MoveVertex()
+  // takes the vertex to its current position.
+  void AddVertex();
+  void RemoveVertex(Index aVertexId);
+  void MoveVertex(Index aVertexId);
+  std::size_t GetVertexCount() const noexcept;
+
+  // Sum of K^2/d repulsions on aVertexId. Cells seen under an angle smaller than aTheta
+  // (cell size / distance) are approximated by their center of mass.
+  // Far cells are cheap here, so there is no 1000.0 cutoff as in the exact kernel.
+  // aTerms counts the vertices and cells summed, with NODESOUP_STATS only.
+  vec_t ComputeRepulsion(Index aVertexId,Scalar aKSquared,Scalar aTheta,[[maybe_unused]] std::uint64_t& aTerms) const noexcept;
+
+  std::size_t GetMemorySize() const noexcept;
+
+private:
+
+  struct Node
+  {
+    vec_t   m_Center;       // Center of mass
+    vec_t   m_Min;          // Corner of the cell
+    Scalar  m_Mass;         // Number of vertices below this node
+    Scalar  m_Size;         // Side of the square (cubic) cell
+    Scalar  m_Extent;       // Side of the square centered on the cell holding its vertices, >= m_Size
+    int32_t m_Parent;       // -1 for the root
+    int32_t m_FirstChild;   // -1 for leaves
+    int32_t m_ChildCount;
+    int32_t m_Begin,m_End;  // Range in m_Indices
+    int32_t m_Limit;        // Leaves: room for vertices up to there
+  };
+
+  const BasicSoAPositions<Scalar,Dim>* m_Positions=nullptr;
+  std::vector<Node>  m_Nodes;
+  std::vector<Index> m_Indices;
+  std::vector<Index> m_Scratch;
+
+  // Leaf of each vertex, its place in m_Indices and the position the centers of mass have it at
+  std::vector<int32_t> m_Leaves;
+  std::vector<int32_t> m_Slots;
+  std::vector<vec_t>   m_Points;
+  // Slots of m_Indices in no leaf, left by the leaves moved to grow
+  std::size_t m_FreeCount=0;
+
+  void BuildNode(int32_t aNodeId,int32_t aBegin,int32_t aEnd,const vec_t& aMin,Scalar aSize,int aDepth);
+  void Insert(Index aVertexId);
+  void Erase(Index aVertexId);
+  void AddToPath(int32_t aNodeId,const vec_t& aPos,Scalar aMass) noexcept;
+  static void GrowExtent(Node& aNode,const vec_t& aCenter,Scalar aHalfSide) noexcept;
+  int32_t FindLeaf(const vec_t& aPos) const noexcept;
+  void SplitLeaf(int32_t aNodeId);
+};
+
+using QuadTree=BarnesHutTree<float,csr_id_t,2>;
+
+
+
+
+template<typename Scalar,typename Index,int Dim>
+inline std::size_t BarnesHutTree<Scalar,Index,Dim>::GetVertexCount() const noexcept
+{
+  return m_Leaves.size();
+}
+
+template<typename Scalar,typename Index,int Dim>
+inline std::size_t BarnesHutTree<Scalar,Index,Dim>::GetMemorySize() const noexcept
+{
+  return m_Nodes.capacity()*sizeof(Node)+(m_Indices.capacity()+m_Scratch.capacity())*sizeof(Index)
+        +(m_Leaves.capacity()+m_Slots.capacity())*sizeof(int32_t)+m_Points.capacity()*sizeof(vec_t);
+}
+
+
+}
@@ -0,0 +1,178 @@
+#include "batch_layout.hpp"
+#include "fruchterman_reingold.hpp"
+#include "graph_components.hpp"
+#include "kamada_kawai.hpp"
+#include "stress_majorization.hpp"
+#include <algorithm>
+#include <numeric>
+
+namespace nodesoup
+{
+
+
+// Scales the layout around the origin so the mean edge length is aEdgeLength
+static void scale_to_edge_length_(const CsrGraph& aGraph,double aEdgeLength,std::vector<NsPosition>& aPositions)
+{
+  double length_sum=0.0;
+  std::size_t edge_count=0;
+  for(vertex_id_t v_id=0; v_id<aGraph.GetVertexCount(); v_id++)
+    {
+      for(auto adj_id:aGraph.GetNeighbors(v_id))
+        {
+          if(adj_id>v_id)
+            {
+              length_sum+=norm(aPositions[adj_id].m_Pos-aPositions[v_id].m_Pos);
+              edge_count++;
+            }
+        }
+    }
+
+  if(!edge_count || !(length_sum>0.0))
+    {
+      return;
+    }
+
+  const float scale=static_cast<float>(aEdgeLength*edge_count/length_sum);
+  for(NsPosition& pos:aPositions)
+    {
+      pos.m_Pos*=scale;
+    }
+}
+
+
+
+
+// The engine run on its own, without the radiuses, its parallel loops on aThreadPool
+static void layout_component_(const CsrGraph& aGraph,const LayoutOptions& aOptions,std::vector<NsPosition>& aPositions
+                             ,ThreadPool& aThreadPool)
+{
+  const std::size_t vertex_count=aGraph.GetVertexCount();
+  aPositions.assign(vertex_count,NsPosition{NsVec2(0.0f,0.0f),0.0f,false});
+  if(vertex_count<2)
+    {
+      return;
+    }
+
+  switch(aOptions.m_Engine)
+    {
+      case LayoutEngine::kFruchtermanReingold:
+        {
+          FruchtermanReingold engine(aGraph,aOptions.m_EdgeLength,aOptions.m_Theta);
+          engine.SetThreadPool(aThreadPool);
+          engine.Start(aOptions.m_InitMode);
+          engine.Iterate(aOptions.m_MaxIterations);
+          engine.GetPositions(aPositions);
+        }
+        break;
+
+      case LayoutEngine::kKamadaKawai:
+        {
+          KamadaKawai engine(aGraph);
+          engine.SetThreadPool(aThreadPool);
+          engine.Start(aOptions.m_InitMode);
+          engine.Iterate(static_cast<int>(std::min<std::size_t>(vertex_count*aOptions.m_MaxIterations,1u<<30)));
+          engine.GetPositions(aPositions);
+        }
+        break;
+
+      case LayoutEngine::kStressMajorization:
+        {
+          StressMajorization engine(aGraph,aOptions.m_EdgeLength);
+          engine.SetThreadPool(aThreadPool);
+          engine.Start(aOptions.m_InitMode);
+          engine.Step(aOptions.m_MaxIterations,aPositions);
+        }
+        break;
+    }
+
+  scale_to_edge_length_(aGraph,aOptions.m_EdgeLength,aPositions);
+}
+
+
+
+
+// Components laid out apart and packed, each at the scale it would have alone
+static void layout_components_(const CsrGraph& aGraph,const LayoutOptions& aOptions,std::vector<NsPosition>& aPositions
+                              ,ThreadPool& aThreadPool)
+{
+  GraphComponents components;
+  SplitComponents(aGraph,components);
+  if(components.m_Graphs.size()<2)
+    {
+      layout_component_(aGraph,aOptions,aPositions,aThreadPool);
+      return;
+    }
+
+  // Biggest first: the big ones with parallel engines, then the rest across the pool
+  const std::size_t component_count=components.m_Graphs.size();
+  std::vector<std::vector<NsPosition>> layouts(component_count);
+  std::size_t first_small=0;
+  while(first_small<component_count && components.m_Graphs[first_small].GetVertexCount()>=kMinParallelComponent)
+    {
+      layout_component_(components.m_Graphs[first_small],aOptions,layouts[first_small],aThreadPool);
+      first_small++;
+    }
+  aThreadPool.ParallelFor(component_count-first_small,1,[&](std::size_t aBegin,std::size_t aEnd)
+  {
+    for(std::size_t c=first_small+aBegin; c<first_small+aEnd; c++)
+      {
+        layout_component_(components.m_Graphs[c],aOptions,layouts[c],aThreadPool);
+      }
+  });
+
+  std::vector<NsVec2> offsets;
+  PackLayouts(layouts,static_cast<float>(aOptions.m_ComponentMargin*aOptions.m_EdgeLength),offsets);
+
+  aPositions.assign(aGraph.GetVertexCount(),NsPosition{NsVec2(0.0f,0.0f),0.0f,false});
+  for(std::size_t v_id=0; v_id<aPositions.size(); v_id++)
+    {
+      const csr_id_t component_id=components.m_ComponentIds[v_id];
+      aPositions[v_id].m_Pos=layouts[component_id][components.m_LocalIds[v_id]].m_Pos+offsets[component_id];
+    }
+}
+
+
+
+
+void LayoutGraph(const CsrGraph& aGraph,const LayoutOptions& aOptions,std::vector<NsPosition>& aPositions,ThreadPool& aThreadPool)
+{
+  if(aOptions.m_SplitComponents)
+    {
+      layout_components_(aGraph,aOptions,aPositions,aThreadPool);
+    }
+  else
+    {
+      layout_component_(aGraph,aOptions,aPositions,aThreadPool);
+    }
+  SetRadiuses(aGraph,aPositions);
+}
+
+
+
+
+void LayoutGraphs(const std::vector<CsrGraph>& aGraphs,const LayoutOptions& aOptions
+                  ,std::vector<std::vector<NsPosition>>& aLayouts,ThreadPool& aThreadPool)
+{
+  aLayouts.resize(aGraphs.size());
+
+  // Biggest graphs first, so no long layout starts when the others are done
+  std::vector<std::size_t> order(aGraphs.size());
+  std::iota(order.begin(),order.end(),0);
+  std::stable_sort(order.begin(),order.end(),[&aGraphs](std::size_t aLhs,std::size_t aRhs)
+  {
+    return aGraphs[aLhs].GetVertexCount()+aGraphs[aLhs].GetArcCount()>aGraphs[aRhs].GetVertexCount()+aGraphs[aRhs].GetArcCount();
+  });
+
+  // The engines run inside the pool, where their own parallel loops are serial, and so do
+  // the components of each graph
+  aThreadPool.ParallelFor(order.size(),1,[&](std::size_t aBegin,std::size_t aEnd)
+  {
+    for(std::size_t k=aBegin; k<aEnd; k++)
+      {
+        LayoutGraph(aGraphs[order[k]],aOptions,aLayouts[order[k]],aThreadPool);
+      }
+  });
+}
+
+
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include "nodesoup.hpp"
+#include "csr_graph.hpp"
+#include "thread_pool.hpp"
+#include <vector>
+
+namespace nodesoup
+{
+// Headless layouts run to completion, for offline use without any UI.
+// LayoutGraphs() is made for throughput on many small graphs: each graph is laid out by
+// a single thread and the graphs are spread across the pool, biggest first. LayoutGraph()
+// does the same with the connected components of a graph, then packs them.
+
+
+
+enum class LayoutEngine
+{
+  kFruchtermanReingold,   // until FruchtermanReingold::IsConverged()
+  kKamadaKawai,           // until KamadaKawai::IsConverged()
+  kStressMajorization     // until StressMajorization::IsConverged()
+};
+
+
+struct LayoutOptions
+{
+  LayoutEngine m_Engine=LayoutEngine::kFruchtermanReingold;
+  // kRandom uses rand(), its layouts depend on the order the threads run
+  InitMode     m_InitMode=InitMode::kPivotMds;
+  // Edges are about this long in the result, whatever the engine
+  double       m_EdgeLength=15.0;
+  // FR and stress iterations, KK moves per vertex
+  int          m_MaxIterations=500;
+  // Barnes-Hut for FR, 0.0 for the exact repulsion
+  double       m_Theta=0.0;
+  // Each connected component is laid out on its own, then the layouts are packed
+  // m_ComponentMargin edge lengths apart. Otherwise the engines see one graph: FR pushes
+  // the components apart without limit, and KK springs them to a guessed distance.
+  bool         m_SplitComponents=true;
+  double       m_ComponentMargin=2.0;
+};
+
+
+
+
+// aPositions gets one position per vertex, radiuses from SetRadiuses(). Components of
+// kMinParallelComponent vertices or more are laid out one after the other, each using the
+// whole pool through the engine; the smaller ones are spread across aThreadPool.
+void LayoutGraph(const CsrGraph& aGraph,const LayoutOptions& aOptions,std::vector<NsPosition>& aPositions
+                 ,ThreadPool& aThreadPool=DefaultThreadPool());
+
+constexpr std::size_t kMinParallelComponent=1024;
+
+// aLayouts[i] gets the layout of aGraphs[i], as LayoutGraph() would. The result does not
+// depend on the number of threads (except with InitMode::kRandom).
+void LayoutGraphs(const std::vector<CsrGraph>& aGraphs,const LayoutOptions& aOptions
+                  ,std::vector<std::vector<NsPosition>>& aLayouts,ThreadPool& aThreadPool=DefaultThreadPool());
+
+
+}
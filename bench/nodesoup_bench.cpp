@@ -0,0 +1,579 @@
+// Scaling benchmark of the layout engines on synthetic graphs, without dear imgui.
+// From the repository root:
+//
+//   g++ -O2 -std=c++17 -I. bench/nodesoup_bench.cpp $(ls *.cpp | grep -v ImNodeSoup) -lpthread
+//
+// One result per generator, size and engine, as CSV or JSON, see print_usage_().
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+  #define WIN32_LEAN_AND_MEAN
+  #include <windows.h>
+  #include <psapi.h>
+#else
+  #include <sys/resource.h>
+#endif
+
+#include "nodesoup.hpp"
+#include "csr_graph.hpp"
+#include "fruchterman_reingold.hpp"
+#include "graph_generators.hpp"
+#include "kamada_kawai.hpp"
+#include "shortest_paths.hpp"
+#include "thread_pool.hpp"
+
+using nodesoup::CsrGraph;
+using nodesoup::vertex_id_t;
+using clock_type=std::chrono::steady_clock;
+
+
+
+constexpr double kEdgeLength=15.0;
+constexpr double kBarnesHutTheta=0.8;
+constexpr int    kStressSources=32;
+// KamadaKawai::StepFor() budget between two time limit checks
+constexpr std::chrono::microseconds kKamadaKawaiBudget{50000};
+
+
+
+struct Options
+{
+  std::vector<std::string> m_Generators{"grid","rgg","er","ba","tree","forest"};
+  std::vector<std::size_t> m_Sizes{10,100,1000,10000,100000,1000000};
+  std::vector<std::string> m_Engines{"fr","fr-bh","kk"};
+  std::string   m_Format="csv";
+  std::string   m_Output;
+  std::uint64_t m_Seed=1;
+  unsigned int  m_Threads=0;
+  int           m_MaxIterations=1000;
+  double        m_TimeLimit=60.0;
+  double        m_Tolerance=0.01;
+  std::size_t   m_MaxVertices=0;   // 0: per engine defaults, see get_max_vertices_()
+};
+
+
+
+struct Result
+{
+  std::string  m_Generator;
+  std::size_t  m_Vertices=0;
+  std::size_t  m_Edges=0;
+  std::string  m_Engine;
+  unsigned int m_Threads=0;
+  double       m_StartMs=0.0;        // engine Start(): initial positions, KK hop distances
+  long long    m_Iterations=0;       // FR iterations or KK vertex moves
+  double       m_MsPerIteration=0.0;
+  double       m_ConvergeMs=0.0;     // start and every iteration until converged (or stopped)
+  bool         m_Converged=false;
+  double       m_PeakMemoryMb=0.0;
+  double       m_Stress=0.0;
+  double       m_EdgeLengthCv=0.0;
+};
+
+
+
+
+static void print_usage_()
+{
+  std::fprintf(stderr,
+    "usage: nodesoup_bench [options]\n"
+    "  --generators LIST   grid,rgg,er,ba,tree,forest\n"
+    "  --sizes LIST        vertex counts, default 10,100,1000,10000,100000,1000000\n"
+    "  --engines LIST      fr (exact), fr-bh (Barnes-Hut), kk\n"
+    "  --format csv|json   default csv\n"
+    "  --output FILE       default stdout\n"
+    "  --seed N            graphs and initial positions, default 1\n"
+    "  --threads N         FR threads, 0: all, default 0\n"
+    "  --max-iterations N  FR iterations, default 1000\n"
+    "  --time-limit S      seconds per run, default 60\n"
+    "  --tolerance T       FR converges below T edge lengths of mean move, default 0.01\n"
+    "  --max-vertices N    skip larger graphs, default 10000 for fr and kk, none for fr-bh\n"
+    "\n"
+    "stress: normalized stress on the hop distances from %d random sources, after the best\n"
+    "uniform scaling of the layout, 0 is a perfect layout.\n"
+    "edge_cv: coefficient of variation of the edge lengths.\n",kStressSources);
+}
+
+
+
+
+static std::vector<std::string> split_(const char* aList)
+{
+  std::vector<std::string> items;
+  std::string item;
+  for(const char* c=aList; ; c++)
+    {
+      if(*c==',' || !*c)
+        {
+          if(!item.empty())
+            {
+              items.push_back(item);
+            }
+          item.clear();
+          if(!*c)
+            {
+              break;
+            }
+        }
+      else
+        {
+          item+=*c;
+        }
+    }
+  return items;
+}
+
+
+
+
+static bool parse_options_(int aArgc,char** aArgv,Options& aOptions)
+{
+  for(int i=1; i<aArgc; i++)
+    {
+      const char* arg=aArgv[i];
+      if(i+1>=aArgc)
+        {
+          return false;
+        }
+      const char* value=aArgv[++i];
+
+      if(!std::strcmp(arg,"--generators"))
+        {
+          aOptions.m_Generators=split_(value);
+        }
+      else if(!std::strcmp(arg,"--sizes"))
+        {
+          aOptions.m_Sizes.clear();
+          for(const std::string& size:split_(value))
+            {
+              aOptions.m_Sizes.push_back(std::strtoull(size.c_str(),nullptr,10));
+            }
+        }
+      else if(!std::strcmp(arg,"--engines"))
+        {
+          aOptions.m_Engines=split_(value);
+        }
+      else if(!std::strcmp(arg,"--format"))
+        {
+          aOptions.m_Format=value;
+        }
+      else if(!std::strcmp(arg,"--output"))
+        {
+          aOptions.m_Output=value;
+        }
+      else if(!std::strcmp(arg,"--seed"))
+        {
+          aOptions.m_Seed=std::strtoull(value,nullptr,10);
+        }
+      else if(!std::strcmp(arg,"--threads"))
+        {
+          aOptions.m_Threads=static_cast<unsigned int>(std::strtoul(value,nullptr,10));
+        }
+      else if(!std::strcmp(arg,"--max-iterations"))
+        {
+          aOptions.m_MaxIterations=std::atoi(value);
+        }
+      else if(!std::strcmp(arg,"--time-limit"))
+        {
+          aOptions.m_TimeLimit=std::atof(value);
+        }
+      else if(!std::strcmp(arg,"--tolerance"))
+        {
+          aOptions.m_Tolerance=std::atof(value);
+        }
+      else if(!std::strcmp(arg,"--max-vertices"))
+        {
+          aOptions.m_MaxVertices=std::strtoull(value,nullptr,10);
+        }
+      else
+        {
+          return false;
+        }
+    }
+
+  return aOptions.m_Format=="csv" || aOptions.m_Format=="json";
+}
+
+
+
+
+// Peak resident memory since the last reset_peak_memory_(). Only Linux can reset it,
+// elsewhere this is the peak of the whole process.
+static void reset_peak_memory_()
+{
+#ifdef __linux__
+  if(std::FILE* file=std::fopen("/proc/self/clear_refs","w"))
+    {
+      std::fputs("5",file);
+      std::fclose(file);
+    }
+#endif
+}
+
+static double get_peak_memory_mb_()
+{
+#if defined(_WIN32)
+  PROCESS_MEMORY_COUNTERS counters;
+  if(GetProcessMemoryInfo(GetCurrentProcess(),&counters,sizeof(counters)))
+    {
+      return counters.PeakWorkingSetSize/(1024.0*1024.0);
+    }
+  return 0.0;
+#elif defined(__linux__)
+  double peak_kb=0.0;
+  if(std::FILE* file=std::fopen("/proc/self/status","r"))
+    {
+      char line[256];
+      while(std::fgets(line,sizeof(line),file))
+        {
+          if(!std::strncmp(line,"VmHWM:",6))
+            {
+              peak_kb=std::atof(line+6);
+              break;
+            }
+        }
+      std::fclose(file);
+    }
+  return peak_kb/1024.0;
+#else
+  struct rusage usage;
+  getrusage(RUSAGE_SELF,&usage);
+  #ifdef __APPLE__
+    return usage.ru_maxrss/(1024.0*1024.0);
+  #else
+    return usage.ru_maxrss/1024.0;
+  #endif
+#endif
+}
+
+
+
+
+static double elapsed_ms_(clock_type::time_point aStart,clock_type::time_point aEnd)
+{
+  return std::chrono::duration<double,std::milli>(aEnd-aStart).count();
+}
+
+
+
+
+// Graphs of about aVertexCount vertices (grids are the nearest rectangle)
+static bool generate_(const std::string& aGenerator,std::size_t aVertexCount,std::uint64_t aSeed,CsrGraph& aGraph)
+{
+  if(aGenerator=="grid")
+    {
+      const std::size_t columns=static_cast<std::size_t>(std::ceil(std::sqrt(static_cast<double>(aVertexCount))));
+      aGraph=nodesoup::MakeGridGraph(columns ? (aVertexCount+columns-1)/columns : 0,columns);
+    }
+  else if(aGenerator=="rgg")
+    {
+      aGraph=nodesoup::MakeRandomGeometricGraph(aVertexCount,6.0,aSeed);
+    }
+  else if(aGenerator=="er")
+    {
+      aGraph=nodesoup::MakeErdosRenyiGraph(aVertexCount,4.0,aSeed);
+    }
+  else if(aGenerator=="ba")
+    {
+      aGraph=nodesoup::MakeBarabasiAlbertGraph(aVertexCount,2,aSeed);
+    }
+  else if(aGenerator=="tree")
+    {
+      aGraph=nodesoup::MakeTreeGraph(aVertexCount,3);
+    }
+  else if(aGenerator=="forest")
+    {
+      aGraph=nodesoup::MakeForestGraph(aVertexCount,10,3);
+    }
+  else
+    {
+      return false;
+    }
+  return true;
+}
+
+
+
+
+// Normalized stress sum((s*|p_i-p_j|-d_ij)^2/d_ij^2)/pairs over the pairs reachable from a
+// few random sources, with the scale s minimizing it: layouts of any size compare
+static double sampled_stress_(const CsrGraph& aGraph,const std::vector<NsPosition>& aPositions,std::uint64_t aSeed)
+{
+  const std::size_t vertex_count=aGraph.GetVertexCount();
+  if(vertex_count<2)
+    {
+      return 0.0;
+    }
+
+  std::mt19937_64 random(aSeed);
+  std::vector<nodesoup::hop_t> distances;
+
+  // Sums of l/d, l^2/d^2 and the pair count give s and the stress in one pass
+  double sum_ratio=0.0;
+  double sum_sq_ratio=0.0;
+  double pairs=0.0;
+  for(int source=0; source<kStressSources; source++)
+    {
+      const vertex_id_t s_id=static_cast<vertex_id_t>(random()%vertex_count);
+      nodesoup::HopDistancesFrom(aGraph,static_cast<nodesoup::csr_id_t>(s_id),distances);
+      for(vertex_id_t v_id=0; v_id<vertex_count; v_id++)
+        {
+          const nodesoup::hop_t hops=distances[v_id];
+          if(!hops || hops==nodesoup::kUnreachable)
+            {
+              continue;
+            }
+
+          const double ratio=norm(aPositions[v_id].m_Pos-aPositions[s_id].m_Pos)/hops;
+          sum_ratio+=ratio;
+          sum_sq_ratio+=ratio*ratio;
+          pairs+=1.0;
+        }
+    }
+
+  if(!pairs || !(sum_sq_ratio>0.0))
+    {
+      return pairs ? 1.0 : 0.0;
+    }
+
+  // sum((s*r-1)^2)=s^2*sum(r^2)-2*s*sum(r)+pairs, minimal at s=sum(r)/sum(r^2)
+  const double scale=sum_ratio/sum_sq_ratio;
+  return (scale*scale*sum_sq_ratio-2.0*scale*sum_ratio+pairs)/pairs;
+}
+
+
+
+
+static double edge_length_cv_(const CsrGraph& aGraph,const std::vector<NsPosition>& aPositions)
+{
+  double sum=0.0;
+  double sq_sum=0.0;
+  double count=0.0;
+  for(vertex_id_t v_id=0; v_id<aGraph.GetVertexCount(); v_id++)
+    {
+      for(auto adj_id:aGraph.GetNeighbors(v_id))
+        {
+          if(adj_id>v_id)
+            {
+              const double length=norm(aPositions[adj_id].m_Pos-aPositions[v_id].m_Pos);
+              sum+=length;
+              sq_sum+=length*length;
+              count+=1.0;
+            }
+        }
+    }
+
+  if(!count || !(sum>0.0))
+    {
+      return 0.0;
+    }
+
+  const double mean=sum/count;
+  return std::sqrt(std::max(0.0,sq_sum/count-mean*mean))/mean;
+}
+
+
+
+
+// Iterations until FruchtermanReingold::IsConverged() (the mean move of the vertices below
+// the tolerance), or until the iteration or time limit
+static void run_fruchterman_reingold_(const CsrGraph& aGraph,double aTheta,const Options& aOptions
+                                     ,Result& aResult,std::vector<NsPosition>& aPositions)
+{
+  nodesoup::FruchtermanReingold engine(aGraph,kEdgeLength,aTheta);
+  engine.SetThreadCount(aOptions.m_Threads);
+  engine.SetTolerance(aOptions.m_Tolerance);
+
+  std::srand(static_cast<unsigned int>(aOptions.m_Seed));
+  clock_type::time_point start=clock_type::now();
+  engine.Start(nodesoup::InitMode::kRandom);
+  engine.Iterate(0);
+  aResult.m_StartMs=elapsed_ms_(start,clock_type::now());
+
+  double iterations_ms=0.0;
+  while(!engine.IsConverged() && aResult.m_Iterations<aOptions.m_MaxIterations
+        && aResult.m_StartMs+iterations_ms<aOptions.m_TimeLimit*1000.0)
+    {
+      start=clock_type::now();
+      engine.Iterate(1);
+      iterations_ms+=elapsed_ms_(start,clock_type::now());
+      aResult.m_Iterations++;
+    }
+
+  aResult.m_Converged=engine.IsConverged();
+  engine.GetPositions(aPositions);
+  aResult.m_MsPerIteration=aResult.m_Iterations ? iterations_ms/aResult.m_Iterations : 0.0;
+  aResult.m_ConvergeMs=aResult.m_StartMs+iterations_ms;
+}
+
+
+
+
+static void run_kamada_kawai_(const CsrGraph& aGraph,const Options& aOptions,Result& aResult
+                             ,std::vector<NsPosition>& aPositions)
+{
+  nodesoup::KamadaKawai engine(aGraph,kEdgeLength);
+  aPositions.resize(aGraph.GetVertexCount());
+
+  std::srand(static_cast<unsigned int>(aOptions.m_Seed));
+  const clock_type::time_point start=clock_type::now();
+  engine.Start(nodesoup::InitMode::kRandom);
+  aResult.m_StartMs=elapsed_ms_(start,clock_type::now());
+
+  // CenterAndScale() of every StepFor() is timed too, once per budget
+  double moves_ms=0.0;
+  while(!aResult.m_Converged && aResult.m_StartMs+moves_ms<aOptions.m_TimeLimit*1000.0)
+    {
+      const nodesoup::StepProgress progress=engine.StepFor(kKamadaKawaiBudget,1000.0f,1000.0f,aPositions);
+      moves_ms+=progress.m_Elapsed.count()/1000.0;
+      aResult.m_Iterations+=progress.m_Iterations;
+      aResult.m_Converged=progress.m_Converged;
+    }
+
+  aResult.m_MsPerIteration=aResult.m_Iterations ? moves_ms/aResult.m_Iterations : 0.0;
+  aResult.m_ConvergeMs=aResult.m_StartMs+moves_ms;
+}
+
+
+
+
+static std::size_t get_max_vertices_(const std::string& aEngine,const Options& aOptions)
+{
+  if(aOptions.m_MaxVertices)
+    {
+      return aOptions.m_MaxVertices;
+    }
+  // Exact FR is O(n^2) per iteration, KK keeps O(n^2) hop distances
+  return aEngine=="fr-bh" ? static_cast<std::size_t>(-1) : 10000;
+}
+
+
+
+
+static void write_result_(std::FILE* aFile,const Options& aOptions,const Result& aResult,bool aFirst)
+{
+  if(aOptions.m_Format=="csv")
+    {
+      std::fprintf(aFile,"%s,%zu,%zu,%s,%u,%.3f,%lld,%.6f,%.3f,%d,%.1f,%.6f,%.6f\n"
+                   ,aResult.m_Generator.c_str(),aResult.m_Vertices,aResult.m_Edges,aResult.m_Engine.c_str()
+                   ,aResult.m_Threads,aResult.m_StartMs,aResult.m_Iterations,aResult.m_MsPerIteration
+                   ,aResult.m_ConvergeMs,aResult.m_Converged ? 1 : 0,aResult.m_PeakMemoryMb
+                   ,aResult.m_Stress,aResult.m_EdgeLengthCv);
+    }
+  else
+    {
+      std::fprintf(aFile,"%s\n  {\"generator\": \"%s\", \"vertices\": %zu, \"edges\": %zu, \"engine\": \"%s\", \"threads\": %u"
+                   ", \"start_ms\": %.3f, \"iterations\": %lld, \"ms_per_iteration\": %.6f, \"converge_ms\": %.3f"
+                   ", \"converged\": %s, \"peak_memory_mb\": %.1f, \"stress\": %.6f, \"edge_cv\": %.6f}"
+                   ,aFirst ? "" : ",",aResult.m_Generator.c_str(),aResult.m_Vertices,aResult.m_Edges
+                   ,aResult.m_Engine.c_str(),aResult.m_Threads,aResult.m_StartMs,aResult.m_Iterations
+                   ,aResult.m_MsPerIteration,aResult.m_ConvergeMs,aResult.m_Converged ? "true" : "false"
+                   ,aResult.m_PeakMemoryMb,aResult.m_Stress,aResult.m_EdgeLengthCv);
+    }
+  std::fflush(aFile);
+}
+
+
+
+
+int main(int aArgc,char** aArgv)
+{
+  Options options;
+  if(!parse_options_(aArgc,aArgv,options))
+    {
+      print_usage_();
+      return 2;
+    }
+
+  std::FILE* file=options.m_Output.empty() ? stdout : std::fopen(options.m_Output.c_str(),"w");
+  if(!file)
+    {
+      std::fprintf(stderr,"cannot create %s\n",options.m_Output.c_str());
+      return 1;
+    }
+
+  if(options.m_Format=="csv")
+    {
+      std::fputs("generator,vertices,edges,engine,threads,start_ms,iterations,ms_per_iteration"
+                 ",converge_ms,converged,peak_memory_mb,stress,edge_cv\n",file);
+    }
+  else
+    {
+      std::fputs("[",file);
+    }
+
+  bool first=true;
+  for(const std::string& generator:options.m_Generators)
+    {
+      for(std::size_t size:options.m_Sizes)
+        {
+          CsrGraph graph;
+          if(!generate_(generator,size,options.m_Seed,graph))
+            {
+              std::fprintf(stderr,"unknown generator %s\n",generator.c_str());
+              return 2;
+            }
+
+          for(const std::string& engine:options.m_Engines)
+            {
+              if(graph.GetVertexCount()>get_max_vertices_(engine,options))
+                {
+                  std::fprintf(stderr,"skipped %s %zu %s, see --max-vertices\n",generator.c_str(),size,engine.c_str());
+                  continue;
+                }
+
+              Result result;
+              result.m_Generator=generator;
+              result.m_Vertices=graph.GetVertexCount();
+              result.m_Edges=graph.GetArcCount()/2;
+              result.m_Engine=engine;
+              result.m_Threads=options.m_Threads ? options.m_Threads : nodesoup::DefaultThreadPool().GetThreadCount();
+
+              std::fprintf(stderr,"%s %zu %s\n",generator.c_str(),graph.GetVertexCount(),engine.c_str());
+              std::vector<NsPosition> positions;
+              reset_peak_memory_();
+              if(engine=="fr" || engine=="fr-bh")
+                {
+                  run_fruchterman_reingold_(graph,engine=="fr" ? 0.0 : kBarnesHutTheta,options,result,positions);
+                }
+              else if(engine=="kk")
+                {
+                  run_kamada_kawai_(graph,options,result,positions);
+                }
+              else
+                {
+                  std::fprintf(stderr,"unknown engine %s\n",engine.c_str());
+                  return 2;
+                }
+              result.m_PeakMemoryMb=get_peak_memory_mb_();
+
+              result.m_Stress=sampled_stress_(graph,positions,options.m_Seed);
+              result.m_EdgeLengthCv=edge_length_cv_(graph,positions);
+
+              write_result_(file,options,result,first);
+              first=false;
+            }
+        }
+    }
+
+  if(options.m_Format=="json")
+    {
+      std::fputs("\n]\n",file);
+    }
+  if(file!=stdout)
+    {
+      std::fclose(file);
+    }
+
+  return 0;
+}
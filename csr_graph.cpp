@@ -0,0 +1,528 @@
+#include "csr_graph.hpp"
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+namespace nodesoup
+{
+
+
+template<typename Index>
+BasicCsrGraph<Index>::BasicCsrGraph() noexcept
+    : m_Offsets(nullptr)
+    , m_Ends(nullptr)
+    , m_Targets(nullptr)
+    , m_VertexCount(0)
+    , m_ArcCount(0)
+    , m_FreeCount(0)
+{
+}
+
+
+
+
+template<typename Index>
+BasicCsrGraph<Index>::BasicCsrGraph(const adj_list_t& aAdjList)
+    : BasicCsrGraph()
+{
+  Assign(aAdjList);
+}
+
+
+
+
+template<typename Index>
+BasicCsrGraph<Index>::BasicCsrGraph(const Index* aOffsets,const Index* aTargets,std::size_t aVertexCount) noexcept
+    : m_Offsets(aOffsets)
+    , m_Ends(aOffsets+1)
+    , m_Targets(aTargets)
+    , m_VertexCount(aVertexCount)
+    , m_ArcCount(aVertexCount ? aOffsets[aVertexCount] : 0)
+    , m_FreeCount(0)
+{
+}
+
+
+
+
+template<typename Index>
+BasicCsrGraph<Index>::BasicCsrGraph(const BasicCsrGraph& aOther)
+    : m_OwnOffsets(aOther.m_OwnOffsets)
+    , m_OwnTargets(aOther.m_OwnTargets)
+    , m_OwnEnds(aOther.m_OwnEnds)
+    , m_OwnLimits(aOther.m_OwnLimits)
+    , m_Offsets(aOther.m_Offsets)
+    , m_Ends(aOther.m_Ends)
+    , m_Targets(aOther.m_Targets)
+    , m_VertexCount(aOther.m_VertexCount)
+    , m_ArcCount(aOther.m_ArcCount)
+    , m_FreeCount(aOther.m_FreeCount)
+{
+  if(!m_OwnOffsets.empty())
+    {
+      PointToOwnArrays();
+    }
+}
+
+
+
+
+template<typename Index>
+BasicCsrGraph<Index>::BasicCsrGraph(BasicCsrGraph&& aOther) noexcept
+    : m_OwnOffsets(std::move(aOther.m_OwnOffsets))
+    , m_OwnTargets(std::move(aOther.m_OwnTargets))
+    , m_OwnEnds(std::move(aOther.m_OwnEnds))
+    , m_OwnLimits(std::move(aOther.m_OwnLimits))
+    , m_Offsets(aOther.m_Offsets)
+    , m_Ends(aOther.m_Ends)
+    , m_Targets(aOther.m_Targets)
+    , m_VertexCount(aOther.m_VertexCount)
+    , m_ArcCount(aOther.m_ArcCount)
+    , m_FreeCount(aOther.m_FreeCount)
+{
+  // moved vector buffers keep their address, so the pointers are still right
+  aOther.m_OwnEnds.clear();
+  aOther.m_OwnLimits.clear();
+  aOther.m_Offsets=nullptr;
+  aOther.m_Ends=nullptr;
+  aOther.m_Targets=nullptr;
+  aOther.m_VertexCount=0;
+  aOther.m_ArcCount=0;
+  aOther.m_FreeCount=0;
+}
+
+
+
+
+template<typename Index>
+BasicCsrGraph<Index>& BasicCsrGraph<Index>::operator=(const BasicCsrGraph& aOther)
+{
+  if(this!=&aOther)
+    {
+      m_OwnOffsets=aOther.m_OwnOffsets;
+      m_OwnTargets=aOther.m_OwnTargets;
+      m_OwnEnds=aOther.m_OwnEnds;
+      m_OwnLimits=aOther.m_OwnLimits;
+      m_Offsets=aOther.m_Offsets;
+      m_Ends=aOther.m_Ends;
+      m_Targets=aOther.m_Targets;
+      m_VertexCount=aOther.m_VertexCount;
+      m_ArcCount=aOther.m_ArcCount;
+      m_FreeCount=aOther.m_FreeCount;
+      if(!m_OwnOffsets.empty())
+        {
+          PointToOwnArrays();
+        }
+    }
+  return *this;
+}
+
+
+
+
+template<typename Index>
+BasicCsrGraph<Index>& BasicCsrGraph<Index>::operator=(BasicCsrGraph&& aOther) noexcept
+{
+  if(this!=&aOther)
+    {
+      m_OwnOffsets=std::move(aOther.m_OwnOffsets);
+      m_OwnTargets=std::move(aOther.m_OwnTargets);
+      m_OwnEnds=std::move(aOther.m_OwnEnds);
+      m_OwnLimits=std::move(aOther.m_OwnLimits);
+      m_Offsets=aOther.m_Offsets;
+      m_Ends=aOther.m_Ends;
+      m_Targets=aOther.m_Targets;
+      m_VertexCount=aOther.m_VertexCount;
+      m_ArcCount=aOther.m_ArcCount;
+      m_FreeCount=aOther.m_FreeCount;
+
+      aOther.m_OwnEnds.clear();
+      aOther.m_OwnLimits.clear();
+      aOther.m_Offsets=nullptr;
+      aOther.m_Ends=nullptr;
+      aOther.m_Targets=nullptr;
+      aOther.m_VertexCount=0;
+      aOther.m_ArcCount=0;
+      aOther.m_FreeCount=0;
+    }
+  return *this;
+}
+
+
+
+
+template<typename Index>
+void BasicCsrGraph<Index>::Assign(const adj_list_t& aAdjList)
+{
+  assert(aAdjList.size()<std::numeric_limits<Index>::max());
+
+  std::size_t arc_count=0;
+  for(const std::vector<vertex_id_t>& adj:aAdjList)
+    {
+      arc_count+=adj.size();
+    }
+  assert(arc_count<=std::numeric_limits<Index>::max());
+
+  m_OwnOffsets.resize(aAdjList.size()+1);
+  m_OwnTargets.resize(arc_count);
+
+  Index offset=0;
+  for(vertex_id_t v_id=0; v_id<aAdjList.size(); v_id++)
+    {
+      m_OwnOffsets[v_id]=offset;
+      for(vertex_id_t adj_id:aAdjList[v_id])
+        {
+          m_OwnTargets[offset++]=static_cast<Index>(adj_id);
+        }
+    }
+  m_OwnOffsets[aAdjList.size()]=offset;
+
+  m_OwnEnds.clear();
+  m_OwnLimits.clear();
+  m_VertexCount=aAdjList.size();
+  m_ArcCount=arc_count;
+  m_FreeCount=0;
+  PointToOwnArrays();
+}
+
+
+
+
+template<typename Index>
+void BasicCsrGraph<Index>::Assign(std::vector<Index>&& aOffsets,std::vector<Index>&& aTargets)
+{
+  assert(!aOffsets.empty() && aOffsets.back()==aTargets.size());
+
+  m_OwnOffsets=std::move(aOffsets);
+  m_OwnTargets=std::move(aTargets);
+  m_OwnEnds.clear();
+  m_OwnLimits.clear();
+  m_VertexCount=m_OwnOffsets.size()-1;
+  m_ArcCount=m_OwnTargets.size();
+  m_FreeCount=0;
+  PointToOwnArrays();
+}
+
+
+
+
+// Counting sort of both directions of the edges, then sort and unique of each row
+template<typename Index>
+void BasicCsrGraph<Index>::AssignEdges(std::size_t aVertexCount,std::vector<Index>&& aSources,std::vector<Index>&& aTargets)
+{
+  assert(aSources.size()==aTargets.size());
+  const std::size_t edge_count=aSources.size();
+
+  std::vector<Index> offsets(aVertexCount+1,0);
+  for(std::size_t e=0; e<edge_count; e++)
+    {
+      offsets[aSources[e]+1]++;
+      offsets[aTargets[e]+1]++;
+    }
+  for(std::size_t v_id=0; v_id<aVertexCount; v_id++)
+    {
+      offsets[v_id+1]+=offsets[v_id];
+    }
+
+  std::vector<Index> targets(2*edge_count);
+  std::vector<Index> fill(offsets.begin(),offsets.end()-1);
+  for(std::size_t e=0; e<edge_count; e++)
+    {
+      targets[fill[aSources[e]]++]=aTargets[e];
+      targets[fill[aTargets[e]]++]=aSources[e];
+    }
+  aSources=std::vector<Index>();
+  aTargets=std::vector<Index>();
+
+  Index write=0;
+  for(std::size_t v_id=0; v_id<aVertexCount; v_id++)
+    {
+      auto row_begin=targets.begin()+offsets[v_id];
+      auto row_end=targets.begin()+offsets[v_id+1];
+      std::sort(row_begin,row_end);
+      row_end=std::unique(row_begin,row_end);
+
+      offsets[v_id]=write;
+      write=static_cast<Index>(std::copy(row_begin,row_end,targets.begin()+write)-targets.begin());
+    }
+  offsets[aVertexCount]=write;
+  targets.resize(write);
+
+  Assign(std::move(offsets),std::move(targets));
+}
+
+
+
+
+// Copies borrowed arrays, so they can be edited
+template<typename Index>
+void BasicCsrGraph<Index>::MakeOwned()
+{
+  if(!m_OwnOffsets.empty())
+    {
+      return;
+    }
+
+  if(m_VertexCount)
+    {
+      m_OwnOffsets.assign(m_Offsets,m_Offsets+m_VertexCount+1);
+      m_OwnTargets.assign(m_Targets,m_Targets+m_Offsets[m_VertexCount]);
+    }
+  else
+    {
+      m_OwnOffsets.assign(1,0);
+    }
+  PointToOwnArrays();
+}
+
+
+
+
+// Owned arrays with the row ends apart, so rows can grow and shrink without moving the others
+template<typename Index>
+void BasicCsrGraph<Index>::MakeEditable()
+{
+  MakeOwned();
+  if(m_OwnEnds.empty())
+    {
+      m_OwnEnds.assign(m_OwnOffsets.begin()+1,m_OwnOffsets.end());
+      m_OwnLimits=m_OwnEnds;
+      PointToOwnArrays();
+    }
+}
+
+
+
+
+// Rows in vertex order without room, as Assign() leaves them
+template<typename Index>
+void BasicCsrGraph<Index>::Compact()
+{
+  if(IsCompact())
+    {
+      return;
+    }
+
+  std::vector<Index> offsets(m_VertexCount+1);
+  std::vector<Index> targets;
+  targets.reserve(m_ArcCount);
+  for(std::size_t v_id=0; v_id<m_VertexCount; v_id++)
+    {
+      offsets[v_id]=static_cast<Index>(targets.size());
+      const Neighbors neighbors=GetNeighbors(v_id);
+      targets.insert(targets.end(),neighbors.begin(),neighbors.end());
+    }
+  offsets[m_VertexCount]=static_cast<Index>(targets.size());
+
+  Assign(std::move(offsets),std::move(targets));
+}
+
+
+
+
+// The new row starts empty and without room, at the end of the targets
+template<typename Index>
+Index BasicCsrGraph<Index>::AddVertex()
+{
+  MakeEditable();
+  assert(m_VertexCount+1<std::numeric_limits<Index>::max());
+
+  const Index row=static_cast<Index>(m_OwnTargets.size());
+  m_OwnOffsets.back()=row;
+  m_OwnOffsets.push_back(row);
+  m_OwnEnds.push_back(row);
+  m_OwnLimits.push_back(row);
+  PointToOwnArrays();
+  return static_cast<Index>(m_VertexCount++);
+}
+
+
+
+
+template<typename Index>
+bool BasicCsrGraph<Index>::HasEdge(Index aFrom,Index aTo) const noexcept
+{
+  const Neighbors neighbors=GetNeighbors(aFrom);
+  return std::find(neighbors.begin(),neighbors.end(),aTo)!=neighbors.end();
+}
+
+
+
+
+template<typename Index>
+bool BasicCsrGraph<Index>::AddEdge(Index aFrom,Index aTo)
+{
+  assert(aFrom<m_VertexCount && aTo<m_VertexCount);
+  if(aFrom==aTo || HasEdge(aFrom,aTo))
+    {
+      return false;
+    }
+
+  MakeEditable();
+  InsertArc(aFrom,aTo);
+  InsertArc(aTo,aFrom);
+  PointToOwnArrays();
+  return true;
+}
+
+
+
+
+template<typename Index>
+bool BasicCsrGraph<Index>::RemoveEdge(Index aFrom,Index aTo)
+{
+  assert(aFrom<m_VertexCount && aTo<m_VertexCount);
+  if(!HasEdge(aFrom,aTo))
+    {
+      return false;
+    }
+
+  MakeEditable();
+  EraseArc(aFrom,aTo);
+  EraseArc(aTo,aFrom);
+  PointToOwnArrays();
+  return true;
+}
+
+
+
+
+// Appended at the end of the row, rows are not kept sorted
+template<typename Index>
+void BasicCsrGraph<Index>::InsertArc(Index aFrom,Index aTo)
+{
+  if(m_OwnEnds[aFrom]==m_OwnLimits[aFrom])
+    {
+      GrowRow(aFrom);
+    }
+  m_OwnTargets[m_OwnEnds[aFrom]++]=aTo;
+  m_ArcCount++;
+}
+
+
+
+
+// The last arc of the row takes the place of the erased one
+template<typename Index>
+void BasicCsrGraph<Index>::EraseArc(Index aFrom,Index aTo)
+{
+  auto row_begin=m_OwnTargets.begin()+m_OwnOffsets[aFrom];
+  auto row_end=m_OwnTargets.begin()+m_OwnEnds[aFrom];
+  *std::find(row_begin,row_end,aTo)=*(row_end-1);
+  m_OwnEnds[aFrom]--;
+  m_ArcCount--;
+}
+
+
+
+
+template<typename Index>
+void BasicCsrGraph<Index>::RenameArc(Index aFrom,Index aTo,Index aNewTo) noexcept
+{
+  auto row_begin=m_OwnTargets.begin()+m_OwnOffsets[aFrom];
+  auto row_end=m_OwnTargets.begin()+m_OwnEnds[aFrom];
+  *std::find(row_begin,row_end,aTo)=aNewTo;
+}
+
+
+
+
+// A full row moves to the end of the targets with twice its size of room. Once the space
+// left behind by moved rows is half of the targets they are packed again: each compaction
+// follows as many targets moved, so both stay O(1) amortized per arc inserted.
+template<typename Index>
+void BasicCsrGraph<Index>::GrowRow(Index aVertexId)
+{
+  if(2*m_FreeCount>m_OwnTargets.size())
+    {
+      Compact();
+      MakeEditable();
+    }
+
+  const std::size_t degree=GetDegree(aVertexId);
+  const std::size_t row=m_OwnTargets.size();
+  assert(row+2*degree+kMinRowCapacity<=std::numeric_limits<Index>::max());
+  m_OwnTargets.resize(row+std::max(2*degree,kMinRowCapacity));
+  std::copy(m_OwnTargets.begin()+m_OwnOffsets[aVertexId],m_OwnTargets.begin()+m_OwnEnds[aVertexId],m_OwnTargets.begin()+row);
+
+  m_FreeCount+=m_OwnLimits[aVertexId]-m_OwnOffsets[aVertexId];
+  m_OwnOffsets[aVertexId]=static_cast<Index>(row);
+  m_OwnEnds[aVertexId]=static_cast<Index>(row+degree);
+  m_OwnLimits[aVertexId]=static_cast<Index>(m_OwnTargets.size());
+  m_OwnOffsets.back()=m_OwnLimits[aVertexId];
+}
+
+
+
+
+// The neighbours of aVertexId drop their arc to it, the row of the last vertex becomes the
+// row of aVertexId and its neighbours rename their arc to it. No other row is visited.
+template<typename Index>
+void BasicCsrGraph<Index>::RemoveVertex(Index aVertexId)
+{
+  assert(aVertexId<m_VertexCount);
+  MakeEditable();
+
+  const Index last=static_cast<Index>(m_VertexCount-1);
+  for(Index adj_id:GetNeighbors(aVertexId))
+    {
+      EraseArc(adj_id,aVertexId);
+    }
+  m_ArcCount-=GetDegree(aVertexId);
+  m_FreeCount+=m_OwnLimits[aVertexId]-m_OwnOffsets[aVertexId];
+
+  if(aVertexId!=last)
+    {
+      for(Index adj_id:GetNeighbors(last))
+        {
+          RenameArc(adj_id,last,aVertexId);
+        }
+      m_OwnOffsets[aVertexId]=m_OwnOffsets[last];
+      m_OwnEnds[aVertexId]=m_OwnEnds[last];
+      m_OwnLimits[aVertexId]=m_OwnLimits[last];
+    }
+
+  m_OwnOffsets.pop_back();
+  m_OwnOffsets.back()=static_cast<Index>(m_OwnTargets.size());
+  m_OwnEnds.pop_back();
+  m_OwnLimits.pop_back();
+  m_VertexCount--;
+  if(!m_VertexCount)
+    {
+      // Compact again, as an empty graph from Assign()
+      m_OwnOffsets.assign(1,0);
+      m_OwnTargets.clear();
+      m_FreeCount=0;
+    }
+  PointToOwnArrays();
+}
+
+
+
+
+template<typename Index>
+void BasicCsrGraph<Index>::PointToOwnArrays() noexcept
+{
+  m_Offsets=m_OwnOffsets.data();
+  m_Ends=(m_OwnEnds.empty() ? m_Offsets+1 : m_OwnEnds.data());
+  m_Targets=m_OwnTargets.data();
+}
+
+
+
+
+template<typename Index>
+std::size_t BasicCsrGraph<Index>::GetMemorySize() const noexcept
+{
+  return (m_OwnOffsets.capacity()+m_OwnTargets.capacity()+m_OwnEnds.capacity()+m_OwnLimits.capacity())*sizeof(Index);
+}
+
+
+
+
+
+template class BasicCsrGraph<std::uint32_t>;
+template class BasicCsrGraph<std::uint64_t>;
+
+
+}
@@ -0,0 +1,178 @@
+#pragma once
+#include "nodesoup.hpp"
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+namespace nodesoup
+{
+
+// 32 bits vertex ids for compact graphs, BasicCsrGraph<std::uint64_t> past 4G arcs
+using csr_id_t=std::uint32_t;
+
+
+
+
+// Compressed sparse row graph: the neighbors of vertex v are
+// m_Targets[m_Offsets[v]] .. m_Targets[m_Offsets[v+1]-1].
+// Undirected edges are stored in both directions, as in adj_list_t.
+// The arrays are either owned or borrowed from the caller without copying.
+// Once edited, rows end before the next one starts: each row keeps room to grow, and a row
+// out of room moves to the end of the targets. See IsCompact().
+// Index is the type of the ids and offsets, instantiated for std::uint32_t and std::uint64_t.
+template<typename Index>
+class BasicCsrGraph
+{
+public:
+
+  using index_t=Index;
+
+  // Range of neighbors usable in range-for
+  struct Neighbors
+  {
+    const Index* m_Begin;
+    const Index* m_End;
+
+    const Index* begin() const noexcept { return m_Begin; }
+    const Index* end() const noexcept   { return m_End; }
+    std::size_t  size() const noexcept  { return static_cast<std::size_t>(m_End-m_Begin); }
+  };
+
+  BasicCsrGraph() noexcept;
+  explicit BasicCsrGraph(const adj_list_t& aAdjList);
+
+  // Borrows the arrays, which must outlive the graph. aOffsets has aVertexCount+1 items.
+  BasicCsrGraph(const Index* aOffsets,const Index* aTargets,std::size_t aVertexCount) noexcept;
+
+  BasicCsrGraph(const BasicCsrGraph& aOther);
+  BasicCsrGraph(BasicCsrGraph&& aOther) noexcept;
+  BasicCsrGraph& operator=(const BasicCsrGraph& aOther);
+  BasicCsrGraph& operator=(BasicCsrGraph&& aOther) noexcept;
+
+  // Single pass over aAdjList, two allocations
+  void Assign(const adj_list_t& aAdjList);
+  // Takes ownership of ready made arrays, aOffsets has one item more than vertices
+  void Assign(std::vector<Index>&& aOffsets,std::vector<Index>&& aTargets);
+  // Undirected edges aSources[e]-aTargets[e], in any order. Repeated edges are merged,
+  // the lists are released.
+  void AssignEdges(std::size_t aVertexCount,std::vector<Index>&& aSources,std::vector<Index>&& aTargets);
+
+  // Edits in place, only the edited rows are touched. The first edit copies a borrowed
+  // graph and adds the row ends, O(n+m) once. Then AddVertex is O(1), AddEdge and RemoveEdge
+  // O(degree of both ends), amortized over the moves of full rows and the compactions.
+  Index AddVertex();
+  // Both return false when there is nothing to do (existing edge, missing edge or loop)
+  bool AddEdge(Index aFrom,Index aTo);
+  bool RemoveEdge(Index aFrom,Index aTo);
+  // The last vertex takes the id of the removed one, so the ids stay contiguous.
+  // O(degrees of the neighbours of both), the rows of the others are left as they are.
+  void RemoveVertex(Index aVertexId);
+
+  bool HasEdge(Index aFrom,Index aTo) const noexcept;
+
+  // Copies borrowed arrays to owned ones, after which the borrowed arrays may go away
+  void MakeOwned();
+
+  // Compact graphs are plain CSR arrays, edited ones have room in their rows until packed
+  // again by Compact(), O(n+m)
+  bool IsCompact() const noexcept;
+  void Compact();
+
+  bool        IsEmpty() const noexcept;
+  std::size_t GetVertexCount() const noexcept;
+  // Directed arcs, twice the number of undirected edges
+  std::size_t GetArcCount() const noexcept;
+
+  Neighbors   GetNeighbors(vertex_id_t aVertexId) const noexcept;
+  std::size_t GetDegree(vertex_id_t aVertexId) const noexcept;
+
+  // The CSR arrays, of compact graphs only
+  const Index* GetOffsets() const noexcept;
+  const Index* GetTargets() const noexcept;
+
+  std::size_t GetMemorySize() const noexcept;
+
+private:
+
+  // Smallest room given to a row moved to the end of the targets
+  static constexpr std::size_t kMinRowCapacity=4;
+
+  std::vector<Index> m_OwnOffsets;
+  std::vector<Index> m_OwnTargets;
+  // Once edited: row v is m_OwnTargets[m_OwnOffsets[v]..m_OwnEnds[v]-1], with room up to
+  // m_OwnLimits[v]. Empty while compact.
+  std::vector<Index> m_OwnEnds;
+  std::vector<Index> m_OwnLimits;
+
+  const Index* m_Offsets;
+  const Index* m_Ends;      // m_Offsets+1 while compact
+  const Index* m_Targets;
+  std::size_t  m_VertexCount;
+  std::size_t  m_ArcCount;
+  std::size_t  m_FreeCount; // targets in no row, left by moved and removed rows
+
+  void PointToOwnArrays() noexcept;
+  void MakeEditable();
+  void InsertArc(Index aFrom,Index aTo);
+  void EraseArc(Index aFrom,Index aTo);
+  void RenameArc(Index aFrom,Index aTo,Index aNewTo) noexcept;
+  void GrowRow(Index aVertexId);
+};
+
+using CsrGraph=BasicCsrGraph<csr_id_t>;
+
+
+
+
+template<typename Index>
+inline bool BasicCsrGraph<Index>::IsEmpty() const noexcept
+{
+  return m_VertexCount==0;
+}
+
+template<typename Index>
+inline std::size_t BasicCsrGraph<Index>::GetVertexCount() const noexcept
+{
+  return m_VertexCount;
+}
+
+template<typename Index>
+inline std::size_t BasicCsrGraph<Index>::GetArcCount() const noexcept
+{
+  return m_ArcCount;
+}
+
+template<typename Index>
+inline bool BasicCsrGraph<Index>::IsCompact() const noexcept
+{
+  return m_OwnEnds.empty();
+}
+
+template<typename Index>
+inline typename BasicCsrGraph<Index>::Neighbors BasicCsrGraph<Index>::GetNeighbors(vertex_id_t aVertexId) const noexcept
+{
+  return {m_Targets+m_Offsets[aVertexId],m_Targets+m_Ends[aVertexId]};
+}
+
+template<typename Index>
+inline std::size_t BasicCsrGraph<Index>::GetDegree(vertex_id_t aVertexId) const noexcept
+{
+  return m_Ends[aVertexId]-m_Offsets[aVertexId];
+}
+
+template<typename Index>
+inline const Index* BasicCsrGraph<Index>::GetOffsets() const noexcept
+{
+  assert(IsCompact());
+  return m_Offsets;
+}
+
+template<typename Index>
+inline const Index* BasicCsrGraph<Index>::GetTargets() const noexcept
+{
+  assert(IsCompact());
+  return m_Targets;
+}
+
+
+}
@@ -0,0 +1,652 @@
+#include "dot_parser.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+namespace nodesoup
+{
+namespace
+{
+
+
+// Open addressing hash map from names to vertex ids, the names live in the parsed data.
+// Slots keep the name pointer and size so a lookup touches the slot and the data only.
+class NameTable
+{
+public:
+
+  explicit NameTable(std::vector<std::string_view>& aNames)
+      : m_Names(aNames)
+  {
+    Rehash(1024);
+  }
+
+  csr_id_t Intern(std::string_view aName)
+  {
+    std::size_t slot=Hash(aName)&m_Mask;
+    while(m_Slots[slot].m_Id!=kEmpty)
+      {
+        const Slot& item=m_Slots[slot];
+        if(item.m_Size==aName.size() && std::memcmp(item.m_Data,aName.data(),aName.size())==0)
+          {
+            return item.m_Id;
+          }
+        slot=(slot+1)&m_Mask;
+      }
+
+    const csr_id_t id=static_cast<csr_id_t>(m_Names.size());
+    m_Names.push_back(aName);
+    m_Slots[slot]={aName.data(),static_cast<std::uint32_t>(aName.size()),id};
+
+    // Load factor kept below 1/2
+    if(2*m_Names.size()>m_Slots.size())
+      {
+        Rehash(2*m_Slots.size());
+      }
+    return id;
+  }
+
+private:
+
+  struct Slot
+  {
+    const char*   m_Data;
+    std::uint32_t m_Size;
+    csr_id_t      m_Id;
+  };
+
+  static constexpr csr_id_t kEmpty=~csr_id_t(0);
+
+  std::vector<std::string_view>& m_Names;
+  std::vector<Slot> m_Slots;
+  std::size_t m_Mask=0;
+
+  // FNV-1a
+  static std::uint32_t Hash(std::string_view aName) noexcept
+  {
+    std::uint32_t hash=2166136261u;
+    for(char c:aName)
+      {
+        hash=(hash^static_cast<unsigned char>(c))*16777619u;
+      }
+    return hash;
+  }
+
+  void Rehash(std::size_t aSlotCount)
+  {
+    m_Slots.assign(aSlotCount,Slot{nullptr,0,kEmpty});
+    m_Mask=aSlotCount-1;
+
+    for(csr_id_t id=0; id<m_Names.size(); id++)
+      {
+        const std::string_view name=m_Names[id];
+        std::size_t slot=Hash(name)&m_Mask;
+        while(m_Slots[slot].m_Id!=kEmpty)
+          {
+            slot=(slot+1)&m_Mask;
+          }
+        m_Slots[slot]={name.data(),static_cast<std::uint32_t>(name.size()),id};
+      }
+  }
+};
+
+
+
+
+enum class Token
+{
+  kEnd,
+  kId,
+  kLBrace,
+  kRBrace,
+  kLBracket,
+  kRBracket,
+  kSemicolon,
+  kComma,
+  kColon,
+  kEqual,
+  kEdgeOp,
+  kError
+};
+
+
+
+
+class DotParser
+{
+public:
+
+  DotParser(std::string_view aData,DotGraph& aGraph)
+      : m_Data(aData)
+      , m_Pos(0)
+      , m_Token(Token::kEnd)
+      , m_Graph(aGraph)
+      , m_Names(aGraph.m_Names)
+  {
+  }
+
+  bool Parse();
+  const std::string& GetError() const noexcept { return m_Error; }
+
+private:
+
+  // Endpoints of an edge: one vertex, or every vertex of a subgraph
+  struct Operand
+  {
+    csr_id_t m_Node;
+    std::vector<csr_id_t> m_Nodes;
+    bool m_IsSubgraph;
+  };
+
+  std::string_view m_Data;
+  std::size_t      m_Pos;
+  Token            m_Token;
+  std::string_view m_Text;
+  std::size_t      m_TokenPos;
+
+  DotGraph&   m_Graph;
+  NameTable   m_Names;
+  std::vector<csr_id_t> m_Sources;
+  std::vector<csr_id_t> m_Targets;
+  std::string m_Error;
+
+  void Next();
+  void SkipBlanks();
+  bool IsKeyword(std::string_view aKeyword) const noexcept;
+  bool Fail(const char* aReason);
+
+  bool ParseStatements(std::vector<csr_id_t>* aNodes);
+  bool ParseStatement(std::vector<csr_id_t>* aNodes);
+  bool ParseOperand(Operand& aOperand,std::vector<csr_id_t>* aNodes);
+  bool ParseSubgraph(std::vector<csr_id_t>& aNodes);
+  bool SkipPort();
+  bool SkipAttributes();
+  void AddEdges(const Operand& aFrom,const Operand& aTo);
+  void BuildGraph();
+};
+
+
+
+
+static bool is_id_start_(char aChar) noexcept
+{
+  return (aChar>='a' && aChar<='z') || (aChar>='A' && aChar<='Z') || aChar=='_' || static_cast<unsigned char>(aChar)>=0x80;
+}
+
+static bool is_digit_(char aChar) noexcept
+{
+  return aChar>='0' && aChar<='9';
+}
+
+
+
+
+// Whitespace, // and /* */ comments, and # lines
+void DotParser::SkipBlanks()
+{
+  const std::size_t size=m_Data.size();
+  while(m_Pos<size)
+    {
+      const char c=m_Data[m_Pos];
+      if(c==' ' || c=='\t' || c=='\n' || c=='\r')
+        {
+          m_Pos++;
+        }
+      else if(c=='/' && m_Pos+1<size && m_Data[m_Pos+1]=='/')
+        {
+          m_Pos=m_Data.find('\n',m_Pos);
+          m_Pos=(m_Pos==std::string_view::npos ? size : m_Pos);
+        }
+      else if(c=='/' && m_Pos+1<size && m_Data[m_Pos+1]=='*')
+        {
+          m_Pos=m_Data.find("*/",m_Pos+2);
+          m_Pos=(m_Pos==std::string_view::npos ? size : m_Pos+2);
+        }
+      else if(c=='#' && (m_Pos==0 || m_Data[m_Pos-1]=='\n'))
+        {
+          m_Pos=m_Data.find('\n',m_Pos);
+          m_Pos=(m_Pos==std::string_view::npos ? size : m_Pos);
+        }
+      else
+        {
+          break;
+        }
+    }
+}
+
+
+
+
+void DotParser::Next()
+{
+  SkipBlanks();
+
+  m_TokenPos=m_Pos;
+  const std::size_t size=m_Data.size();
+  if(m_Pos>=size)
+    {
+      m_Token=Token::kEnd;
+      return;
+    }
+
+  const char c=m_Data[m_Pos];
+  const std::size_t start=m_Pos;
+
+  switch(c)
+    {
+    case '{': m_Token=Token::kLBrace;    m_Pos++; return;
+    case '}': m_Token=Token::kRBrace;    m_Pos++; return;
+    case '[': m_Token=Token::kLBracket;  m_Pos++; return;
+    case ']': m_Token=Token::kRBracket;  m_Pos++; return;
+    case ';': m_Token=Token::kSemicolon; m_Pos++; return;
+    case ',': m_Token=Token::kComma;     m_Pos++; return;
+    case ':': m_Token=Token::kColon;     m_Pos++; return;
+    case '=': m_Token=Token::kEqual;     m_Pos++; return;
+    default: break;
+    }
+
+  if(c=='-' && m_Pos+1<size && (m_Data[m_Pos+1]=='-' || m_Data[m_Pos+1]=='>'))
+    {
+      m_Token=Token::kEdgeOp;
+      m_Pos+=2;
+      return;
+    }
+
+  m_Token=Token::kId;
+
+  if(is_id_start_(c))
+    {
+      while(m_Pos<size && (is_id_start_(m_Data[m_Pos]) || is_digit_(m_Data[m_Pos])))
+        {
+          m_Pos++;
+        }
+      m_Text=m_Data.substr(start,m_Pos-start);
+      return;
+    }
+
+  if(is_digit_(c) || c=='.' || c=='-')
+    {
+      m_Pos++;
+      while(m_Pos<size && (is_digit_(m_Data[m_Pos]) || m_Data[m_Pos]=='.'))
+        {
+          m_Pos++;
+        }
+      m_Text=m_Data.substr(start,m_Pos-start);
+      return;
+    }
+
+  // Quoted names are used without the quotes, escapes are left as they are
+  if(c=='"')
+    {
+      m_Pos++;
+      while(m_Pos<size && m_Data[m_Pos]!='"')
+        {
+          m_Pos+=(m_Data[m_Pos]=='\\' && m_Pos+1<size) ? 2 : 1;
+        }
+      if(m_Pos>=size)
+        {
+          m_Token=Token::kError;
+          return;
+        }
+      m_Text=m_Data.substr(start+1,m_Pos-start-1);
+      m_Pos++;
+      return;
+    }
+
+  // HTML names, <...> with nested brackets
+  if(c=='<')
+    {
+      int depth=0;
+      do
+        {
+          depth+=(m_Data[m_Pos]=='<') ? 1 : (m_Data[m_Pos]=='>') ? -1 : 0;
+          m_Pos++;
+        }
+      while(m_Pos<size && depth>0);
+
+      if(depth>0)
+        {
+          m_Token=Token::kError;
+          return;
+        }
+      m_Text=m_Data.substr(start,m_Pos-start);
+      return;
+    }
+
+  m_Token=Token::kError;
+}
+
+
+
+
+// Keywords are case insensitive
+bool DotParser::IsKeyword(std::string_view aKeyword) const noexcept
+{
+  if(m_Token!=Token::kId || m_Text.size()!=aKeyword.size() || m_Data[m_TokenPos]=='"')
+    {
+      return false;
+    }
+
+  for(std::size_t i=0; i<aKeyword.size(); i++)
+    {
+      char c=m_Text[i];
+      if((c>='A' && c<='Z' ? c-'A'+'a' : c)!=aKeyword[i])
+        {
+          return false;
+        }
+    }
+  return true;
+}
+
+
+
+
+bool DotParser::Fail(const char* aReason)
+{
+  const std::size_t line=1+std::count(m_Data.begin(),m_Data.begin()+std::min(m_TokenPos,m_Data.size()),'\n');
+  m_Error="line "+std::to_string(line)+": "+aReason;
+  return false;
+}
+
+
+
+
+bool DotParser::Parse()
+{
+  Next();
+  if(m_Token==Token::kEnd)
+    {
+      BuildGraph();
+      return true;
+    }
+
+  if(IsKeyword("strict"))
+    {
+      Next();
+    }
+
+  if(IsKeyword("digraph"))
+    {
+      m_Graph.m_Directed=true;
+    }
+  else if(!IsKeyword("graph"))
+    {
+      return Fail("expected 'graph' or 'digraph'");
+    }
+  Next();
+
+  if(m_Token==Token::kId)
+    {
+      Next();
+    }
+
+  if(m_Token!=Token::kLBrace)
+    {
+      return Fail("expected '{'");
+    }
+  Next();
+
+  if(!ParseStatements(nullptr))
+    {
+      return false;
+    }
+
+  BuildGraph();
+  return true;
+}
+
+
+
+
+// Statements until the closing '}', which is consumed.
+// aNodes (if given) collects every vertex mentioned, for subgraphs used as edge operands.
+bool DotParser::ParseStatements(std::vector<csr_id_t>* aNodes)
+{
+  while(m_Token!=Token::kRBrace)
+    {
+      if(m_Token==Token::kEnd)
+        {
+          return Fail("missing '}'");
+        }
+
+      if(m_Token==Token::kSemicolon)
+        {
+          Next();
+          continue;
+        }
+
+      if(!ParseStatement(aNodes))
+        {
+          return false;
+        }
+    }
+
+  Next();
+  return true;
+}
+
+
+
+
+bool DotParser::ParseStatement(std::vector<csr_id_t>* aNodes)
+{
+  // graph/node/edge [attributes]
+  if(IsKeyword("graph") || IsKeyword("node") || IsKeyword("edge"))
+    {
+      Next();
+      return SkipAttributes();
+    }
+
+  // ID = ID
+  if(m_Token==Token::kId && !IsKeyword("subgraph"))
+    {
+      const std::size_t pos=m_Pos;
+      const std::string_view text=m_Text;
+      const std::size_t token_pos=m_TokenPos;
+      Next();
+      if(m_Token==Token::kEqual)
+        {
+          Next();
+          if(m_Token!=Token::kId)
+            {
+              return Fail("expected a value after '='");
+            }
+          Next();
+          return true;
+        }
+
+      // Not an assignment, back to the name
+      m_Pos=pos;
+      m_Text=text;
+      m_TokenPos=token_pos;
+      m_Token=Token::kId;
+    }
+
+  Operand from;
+  if(!ParseOperand(from,aNodes))
+    {
+      return false;
+    }
+
+  Operand to;
+  while(m_Token==Token::kEdgeOp)
+    {
+      Next();
+      if(!ParseOperand(to,aNodes))
+        {
+          return false;
+        }
+
+      AddEdges(from,to);
+      std::swap(from,to);
+    }
+
+  return SkipAttributes();
+}
+
+
+
+
+bool DotParser::ParseOperand(Operand& aOperand,std::vector<csr_id_t>* aNodes)
+{
+  if(m_Token==Token::kLBrace || IsKeyword("subgraph"))
+    {
+      aOperand.m_IsSubgraph=true;
+      aOperand.m_Nodes.clear();
+      if(!ParseSubgraph(aOperand.m_Nodes))
+        {
+          return false;
+        }
+
+      if(aNodes)
+        {
+          aNodes->insert(aNodes->end(),aOperand.m_Nodes.begin(),aOperand.m_Nodes.end());
+        }
+      return true;
+    }
+
+  if(m_Token!=Token::kId)
+    {
+      return Fail("expected a vertex name");
+    }
+
+  aOperand.m_IsSubgraph=false;
+  aOperand.m_Node=m_Names.Intern(m_Text);
+  if(aNodes)
+    {
+      aNodes->push_back(aOperand.m_Node);
+    }
+  Next();
+
+  return SkipPort();
+}
+
+
+
+
+bool DotParser::ParseSubgraph(std::vector<csr_id_t>& aNodes)
+{
+  if(IsKeyword("subgraph"))
+    {
+      Next();
+      if(m_Token==Token::kId)
+        {
+          Next();
+        }
+    }
+
+  if(m_Token!=Token::kLBrace)
+    {
+      return Fail("expected '{' after subgraph");
+    }
+  Next();
+
+  return ParseStatements(&aNodes);
+}
+
+
+
+
+// :port or :port:compass_point
+bool DotParser::SkipPort()
+{
+  for(int part=0; part<2 && m_Token==Token::kColon; part++)
+    {
+      Next();
+      if(m_Token!=Token::kId)
+        {
+          return Fail("expected a port name after ':'");
+        }
+      Next();
+    }
+  return true;
+}
+
+
+
+
+// Any number of [a=b, c=d; e] lists
+bool DotParser::SkipAttributes()
+{
+  while(m_Token==Token::kLBracket)
+    {
+      Next();
+      while(m_Token!=Token::kRBracket)
+        {
+          if(m_Token==Token::kEnd || m_Token==Token::kError)
+            {
+              return Fail("unterminated attribute list");
+            }
+          Next();
+        }
+      Next();
+    }
+
+  if(m_Token==Token::kError)
+    {
+      return Fail("unexpected character");
+    }
+  return true;
+}
+
+
+
+
+void DotParser::AddEdges(const Operand& aFrom,const Operand& aTo)
+{
+  const csr_id_t* from_begin=aFrom.m_IsSubgraph ? aFrom.m_Nodes.data() : &aFrom.m_Node;
+  const csr_id_t* from_end=aFrom.m_IsSubgraph ? from_begin+aFrom.m_Nodes.size() : from_begin+1;
+  const csr_id_t* to_begin=aTo.m_IsSubgraph ? aTo.m_Nodes.data() : &aTo.m_Node;
+  const csr_id_t* to_end=aTo.m_IsSubgraph ? to_begin+aTo.m_Nodes.size() : to_begin+1;
+
+  for(const csr_id_t* from=from_begin; from!=from_end; ++from)
+    {
+      for(const csr_id_t* to=to_begin; to!=to_end; ++to)
+        {
+          if(*from!=*to)
+            {
+              m_Sources.push_back(*from);
+              m_Targets.push_back(*to);
+            }
+        }
+    }
+}
+
+
+
+
+// The edge lists are handed over to the graph, see CsrGraph::AssignEdges()
+void DotParser::BuildGraph()
+{
+  m_Graph.m_Graph.AssignEdges(m_Graph.m_Names.size(),std::move(m_Sources),std::move(m_Targets));
+}
+
+
+}
+
+
+
+
+bool ParseDot(std::string_view aData,DotGraph& aGraph,std::string* aError)
+{
+  aGraph.m_Names.clear();
+  aGraph.m_Directed=false;
+
+  DotParser parser(aData,aGraph);
+  if(!parser.Parse())
+    {
+      aGraph.m_Graph=CsrGraph();
+      aGraph.m_Names.clear();
+      if(aError)
+        {
+          *aError=parser.GetError();
+        }
+      return false;
+    }
+
+  return true;
+}
+
+
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include "nodesoup.hpp"
+#include "csr_graph.hpp"
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace nodesoup
+{
+// Single pass parser for Graphviz DOT files.
+// Supports graph and digraph, statements separated by ';' or nothing, '--' and '->' edges,
+// edge chains (a -- b -- c), subgraphs as edge operands (a -- {b c}), ports, [attr] lists,
+// attribute statements, comments and quoted or HTML names.
+// Attributes are skipped, edges are undirected for the layout, duplicated edges and self loops
+// are dropped.
+
+
+
+struct DotGraph
+{
+  CsrGraph m_Graph;
+  // Vertex names in order of first appearance, they point into the parsed data (no copies):
+  // keep the data (or the MappedFile) alive while they are used
+  std::vector<std::string_view> m_Names;
+  bool m_Directed=false;
+};
+
+
+// False on syntax errors, aError (if given) gets the line and the reason.
+// Empty data gives an empty graph.
+bool ParseDot(std::string_view aData,DotGraph& aGraph,std::string* aError=nullptr);
+
+
+}
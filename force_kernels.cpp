@@ -0,0 +1,504 @@
+#include "force_kernels.hpp"
+#include <atomic>
+#include <cmath>
+#include <type_traits>
+
+// Fused multiply-adds would round differently from the scalar code
+#if defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define NODESOUP_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+#else
+#define NODESOUP_X86 0
+#endif
+
+#if NODESOUP_X86 && (defined(__GNUC__) || defined(__clang__))
+#define NODESOUP_TARGET(x) __attribute__((target(x)))
+#else
+#define NODESOUP_TARGET(x)
+#endif
+
+
+namespace nodesoup
+{
+
+
+
+static SimdLevel detect_simd_level_() noexcept
+{
+#if NODESOUP_X86 && (defined(__GNUC__) || defined(__clang__))
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx512f"))
+    {
+      return SimdLevel::kAvx512;
+    }
+  if(__builtin_cpu_supports("avx2"))
+    {
+      return SimdLevel::kAvx2;
+    }
+  if(__builtin_cpu_supports("sse4.1"))
+    {
+      return SimdLevel::kSse41;
+    }
+  return SimdLevel::kScalar;
+#elif NODESOUP_X86 && defined(_MSC_VER)
+  int regs[4];
+  __cpuid(regs,0);
+  const int max_leaf=regs[0];
+
+  __cpuid(regs,1);
+  const bool sse41=(regs[2] & (1<<19))!=0;
+  const bool osxsave=(regs[2] & (1<<27))!=0;
+  const unsigned long long xcr0=osxsave ? _xgetbv(0) : 0;
+  const bool os_avx=(xcr0 & 0x6)==0x6;
+  const bool os_avx512=(xcr0 & 0xE6)==0xE6;
+
+  bool avx2=false;
+  bool avx512=false;
+  if(max_leaf>=7)
+    {
+      __cpuidex(regs,7,0);
+      avx2=(regs[1] & (1<<5))!=0;
+      avx512=(regs[1] & (1<<16))!=0;
+    }
+
+  if(avx512 && os_avx512)
+    {
+      return SimdLevel::kAvx512;
+    }
+  if(avx2 && os_avx)
+    {
+      return SimdLevel::kAvx2;
+    }
+  return sse41 ? SimdLevel::kSse41 : SimdLevel::kScalar;
+#else
+  return SimdLevel::kScalar;
+#endif
+}
+
+
+
+
+SimdLevel GetSupportedSimdLevel() noexcept
+{
+  static const SimdLevel supported=detect_simd_level_();
+  return supported;
+}
+
+
+
+
+static std::atomic<int> gSimdLevel{-1};
+
+SimdLevel GetSimdLevel() noexcept
+{
+  int level=gSimdLevel.load(std::memory_order_relaxed);
+  if(level<0)
+    {
+      level=static_cast<int>(GetSupportedSimdLevel());
+      gSimdLevel.store(level,std::memory_order_relaxed);
+    }
+  return static_cast<SimdLevel>(level);
+}
+
+
+
+
+void SetSimdLevel(SimdLevel aLevel) noexcept
+{
+  if(static_cast<int>(aLevel)>static_cast<int>(GetSupportedSimdLevel()))
+    {
+      aLevel=GetSupportedSimdLevel();
+    }
+  gSimdLevel.store(static_cast<int>(aLevel),std::memory_order_relaxed);
+}
+
+
+
+
+const char* GetSimdLevelName(SimdLevel aLevel) noexcept
+{
+  switch(aLevel)
+    {
+      case SimdLevel::kScalar: return "scalar";
+      case SimdLevel::kSse41:  return "SSE4.1";
+      case SimdLevel::kAvx2:   return "AVX2";
+      case SimdLevel::kAvx512: return "AVX-512";
+    }
+  return "?";
+}
+
+
+
+
+template<typename Scalar,int Dim>
+void BasicSoAVectors<Scalar,Dim>::Resize(std::size_t aCount)
+{
+  for(int axis=0; axis<Dim; axis++)
+    {
+      m_Coords[axis].resize(aCount,0);
+    }
+}
+
+
+
+
+template<typename Scalar,int Dim>
+void BasicSoAPositions<Scalar,Dim>::Resize(std::size_t aCount)
+{
+  for(int axis=0; axis<Dim; axis++)
+    {
+      m_Coords[axis].resize(aCount);
+    }
+  m_Fixed.resize(aCount);
+}
+
+
+
+
+template<typename Scalar,int Dim>
+void BasicSoAPositions<Scalar,Dim>::Load(const std::vector<NsBasicPosition<Scalar,Dim>>& aPositions)
+{
+  Resize(aPositions.size());
+  for(std::size_t k=0; k<aPositions.size(); k++)
+    {
+      Set(k,aPositions[k].m_Pos);
+      m_Fixed[k]=aPositions[k].m_Fixed;
+    }
+}
+
+
+
+
+template<typename Scalar,int Dim>
+void BasicSoAPositions<Scalar,Dim>::Store(std::vector<NsBasicPosition<Scalar,Dim>>& aPositions) const
+{
+  aPositions.resize(GetCount());
+  for(std::size_t k=0; k<aPositions.size(); k++)
+    {
+      aPositions[k].m_Pos=Get(k);
+      aPositions[k].m_Fixed=m_Fixed[k]!=0;
+    }
+}
+
+
+
+
+template<typename Scalar,int Dim>
+void BasicSoAPositions<Scalar,Dim>::PushBack(const NsVec<Scalar,Dim>& aPos,bool aFixed)
+{
+  for(int axis=0; axis<Dim; axis++)
+    {
+      m_Coords[axis].push_back(aPos[axis]);
+    }
+  m_Fixed.push_back(aFixed);
+}
+
+
+
+
+template<typename Scalar,int Dim>
+void BasicSoAPositions<Scalar,Dim>::PopBack()
+{
+  for(int axis=0; axis<Dim; axis++)
+    {
+      m_Coords[axis].pop_back();
+    }
+  m_Fixed.pop_back();
+}
+
+
+
+
+// The reference: the SIMD versions do the same operations in the same order, one vertex per lane
+static void repulsion_scalar_(const float* aX,const float* aY,std::size_t aCount,std::size_t aBegin,std::size_t aEnd
+                             ,float aKSquared,float aMaxSqDist,float* aMvmtX,float* aMvmtY) noexcept
+{
+  for(std::size_t v_id=aBegin; v_id<aEnd; v_id++)
+    {
+      const float x=aX[v_id];
+      const float y=aY[v_id];
+      float mvmt_x=0.0f;
+      float mvmt_y=0.0f;
+
+      for(std::size_t other_id=0; other_id<aCount; other_id++)
+        {
+          float dx=x-aX[other_id];
+          float dy=y-aY[other_id];
+          float sq_dist=dx*dx+dy*dy;
+
+          // delta/distance * K^2/distance
+          float factor=(sq_dist>0.0f && sq_dist<=aMaxSqDist) ? aKSquared/sq_dist : 0.0f;
+          mvmt_x+=dx*factor;
+          mvmt_y+=dy*factor;
+        }
+
+      aMvmtX[v_id]+=mvmt_x;
+      aMvmtY[v_id]+=mvmt_y;
+    }
+}
+
+
+
+
+#if NODESOUP_X86
+
+NODESOUP_TARGET("sse4.1")
+static void repulsion_sse41_(const float* aX,const float* aY,std::size_t aCount,std::size_t aBegin,std::size_t aEnd
+                            ,float aKSquared,float aMaxSqDist,float* aMvmtX,float* aMvmtY) noexcept
+{
+  const __m128 k_squared=_mm_set1_ps(aKSquared);
+  const __m128 max_sq_dist=_mm_set1_ps(aMaxSqDist);
+  const __m128 zero=_mm_setzero_ps();
+
+  std::size_t v_id=aBegin;
+  for(; v_id+4<=aEnd; v_id+=4)
+    {
+      const __m128 x=_mm_loadu_ps(aX+v_id);
+      const __m128 y=_mm_loadu_ps(aY+v_id);
+      __m128 mvmt_x=zero;
+      __m128 mvmt_y=zero;
+
+      for(std::size_t other_id=0; other_id<aCount; other_id++)
+        {
+          __m128 dx=_mm_sub_ps(x,_mm_set1_ps(aX[other_id]));
+          __m128 dy=_mm_sub_ps(y,_mm_set1_ps(aY[other_id]));
+          __m128 sq_dist=_mm_add_ps(_mm_mul_ps(dx,dx),_mm_mul_ps(dy,dy));
+
+          __m128 mask=_mm_and_ps(_mm_cmpgt_ps(sq_dist,zero),_mm_cmple_ps(sq_dist,max_sq_dist));
+          __m128 factor=_mm_and_ps(mask,_mm_div_ps(k_squared,sq_dist));
+          mvmt_x=_mm_add_ps(mvmt_x,_mm_mul_ps(dx,factor));
+          mvmt_y=_mm_add_ps(mvmt_y,_mm_mul_ps(dy,factor));
+        }
+
+      _mm_storeu_ps(aMvmtX+v_id,_mm_add_ps(_mm_loadu_ps(aMvmtX+v_id),mvmt_x));
+      _mm_storeu_ps(aMvmtY+v_id,_mm_add_ps(_mm_loadu_ps(aMvmtY+v_id),mvmt_y));
+    }
+
+  repulsion_scalar_(aX,aY,aCount,v_id,aEnd,aKSquared,aMaxSqDist,aMvmtX,aMvmtY);
+}
+
+
+
+
+NODESOUP_TARGET("avx2")
+static void repulsion_avx2_(const float* aX,const float* aY,std::size_t aCount,std::size_t aBegin,std::size_t aEnd
+                           ,float aKSquared,float aMaxSqDist,float* aMvmtX,float* aMvmtY) noexcept
+{
+  const __m256 k_squared=_mm256_set1_ps(aKSquared);
+  const __m256 max_sq_dist=_mm256_set1_ps(aMaxSqDist);
+  const __m256 zero=_mm256_setzero_ps();
+
+  std::size_t v_id=aBegin;
+  for(; v_id+8<=aEnd; v_id+=8)
+    {
+      const __m256 x=_mm256_loadu_ps(aX+v_id);
+      const __m256 y=_mm256_loadu_ps(aY+v_id);
+      __m256 mvmt_x=zero;
+      __m256 mvmt_y=zero;
+
+      for(std::size_t other_id=0; other_id<aCount; other_id++)
+        {
+          __m256 dx=_mm256_sub_ps(x,_mm256_broadcast_ss(aX+other_id));
+          __m256 dy=_mm256_sub_ps(y,_mm256_broadcast_ss(aY+other_id));
+          __m256 sq_dist=_mm256_add_ps(_mm256_mul_ps(dx,dx),_mm256_mul_ps(dy,dy));
+
+          __m256 mask=_mm256_and_ps(_mm256_cmp_ps(sq_dist,zero,_CMP_GT_OQ),_mm256_cmp_ps(sq_dist,max_sq_dist,_CMP_LE_OQ));
+          __m256 factor=_mm256_and_ps(mask,_mm256_div_ps(k_squared,sq_dist));
+          mvmt_x=_mm256_add_ps(mvmt_x,_mm256_mul_ps(dx,factor));
+          mvmt_y=_mm256_add_ps(mvmt_y,_mm256_mul_ps(dy,factor));
+        }
+
+      _mm256_storeu_ps(aMvmtX+v_id,_mm256_add_ps(_mm256_loadu_ps(aMvmtX+v_id),mvmt_x));
+      _mm256_storeu_ps(aMvmtY+v_id,_mm256_add_ps(_mm256_loadu_ps(aMvmtY+v_id),mvmt_y));
+    }
+
+  repulsion_scalar_(aX,aY,aCount,v_id,aEnd,aKSquared,aMaxSqDist,aMvmtX,aMvmtY);
+}
+
+
+
+
+NODESOUP_TARGET("avx512f")
+static void repulsion_avx512_(const float* aX,const float* aY,std::size_t aCount,std::size_t aBegin,std::size_t aEnd
+                             ,float aKSquared,float aMaxSqDist,float* aMvmtX,float* aMvmtY) noexcept
+{
+  const __m512 k_squared=_mm512_set1_ps(aKSquared);
+  const __m512 max_sq_dist=_mm512_set1_ps(aMaxSqDist);
+  const __m512 zero=_mm512_setzero_ps();
+
+  std::size_t v_id=aBegin;
+  for(; v_id+16<=aEnd; v_id+=16)
+    {
+      const __m512 x=_mm512_loadu_ps(aX+v_id);
+      const __m512 y=_mm512_loadu_ps(aY+v_id);
+      __m512 mvmt_x=zero;
+      __m512 mvmt_y=zero;
+
+      for(std::size_t other_id=0; other_id<aCount; other_id++)
+        {
+          __m512 dx=_mm512_sub_ps(x,_mm512_set1_ps(aX[other_id]));
+          __m512 dy=_mm512_sub_ps(y,_mm512_set1_ps(aY[other_id]));
+          __m512 sq_dist=_mm512_add_ps(_mm512_mul_ps(dx,dx),_mm512_mul_ps(dy,dy));
+
+          __mmask16 mask=_mm512_cmp_ps_mask(sq_dist,zero,_CMP_GT_OQ) & _mm512_cmp_ps_mask(sq_dist,max_sq_dist,_CMP_LE_OQ);
+          __m512 factor=_mm512_maskz_div_ps(mask,k_squared,sq_dist);
+          mvmt_x=_mm512_add_ps(mvmt_x,_mm512_mul_ps(dx,factor));
+          mvmt_y=_mm512_add_ps(mvmt_y,_mm512_mul_ps(dy,factor));
+        }
+
+      _mm512_storeu_ps(aMvmtX+v_id,_mm512_add_ps(_mm512_loadu_ps(aMvmtX+v_id),mvmt_x));
+      _mm512_storeu_ps(aMvmtY+v_id,_mm512_add_ps(_mm512_loadu_ps(aMvmtY+v_id),mvmt_y));
+    }
+
+  repulsion_scalar_(aX,aY,aCount,v_id,aEnd,aKSquared,aMaxSqDist,aMvmtX,aMvmtY);
+}
+
+#endif
+
+
+
+
+// Same operations as repulsion_scalar_(), for the types without SIMD kernels
+template<typename Scalar,int Dim>
+static void repulsion_generic_(const BasicSoAPositions<Scalar,Dim>& aPositions,std::size_t aBegin,std::size_t aEnd
+                              ,Scalar aKSquared,Scalar aMaxSqDist,BasicSoAVectors<Scalar,Dim>& aMvmt) noexcept
+{
+  const std::size_t count=aPositions.GetCount();
+  for(std::size_t v_id=aBegin; v_id<aEnd; v_id++)
+    {
+      const NsVec<Scalar,Dim> pos=aPositions.Get(v_id);
+      NsVec<Scalar,Dim> mvmt;
+
+      for(std::size_t other_id=0; other_id<count; other_id++)
+        {
+          NsVec<Scalar,Dim> delta;
+          Scalar sq_dist=0;
+          for(int axis=0; axis<Dim; axis++)
+            {
+              delta[axis]=pos[axis]-aPositions.m_Coords[axis][other_id];
+              sq_dist+=delta[axis]*delta[axis];
+            }
+
+          // delta/distance * K^2/distance
+          Scalar factor=(sq_dist>0 && sq_dist<=aMaxSqDist) ? aKSquared/sq_dist : 0;
+          mvmt+=delta*factor;
+        }
+
+      for(int axis=0; axis<Dim; axis++)
+        {
+          aMvmt.m_Coords[axis][v_id]+=mvmt[axis];
+        }
+    }
+}
+
+
+
+
+template<typename Scalar,int Dim>
+void AddRepulsion(const BasicSoAPositions<Scalar,Dim>& aPositions,std::size_t aBegin,std::size_t aEnd,Scalar aKSquared,Scalar aMaxDistance
+                 ,BasicSoAVectors<Scalar,Dim>& aMvmt) noexcept
+{
+  const Scalar max_sq_dist=aMaxDistance*aMaxDistance;
+  if constexpr(!std::is_same<Scalar,float>::value || Dim!=2)
+    {
+      repulsion_generic_(aPositions,aBegin,aEnd,aKSquared,max_sq_dist,aMvmt);
+    }
+  else
+    {
+      const float* x=aPositions.m_Coords[0].data();
+      const float* y=aPositions.m_Coords[1].data();
+      float* mvmt_x=aMvmt.m_Coords[0].data();
+      float* mvmt_y=aMvmt.m_Coords[1].data();
+      const std::size_t count=aPositions.GetCount();
+
+      switch(GetSimdLevel())
+        {
+#if NODESOUP_X86
+          case SimdLevel::kAvx512:
+            repulsion_avx512_(x,y,count,aBegin,aEnd,aKSquared,max_sq_dist,mvmt_x,mvmt_y);
+            return;
+          case SimdLevel::kAvx2:
+            repulsion_avx2_(x,y,count,aBegin,aEnd,aKSquared,max_sq_dist,mvmt_x,mvmt_y);
+            return;
+          case SimdLevel::kSse41:
+            repulsion_sse41_(x,y,count,aBegin,aEnd,aKSquared,max_sq_dist,mvmt_x,mvmt_y);
+            return;
+#endif
+          default:
+            repulsion_scalar_(x,y,count,aBegin,aEnd,aKSquared,max_sq_dist,mvmt_x,mvmt_y);
+            return;
+        }
+    }
+}
+
+
+
+
+// Edges are irregular gathers, and only O(m): kept scalar. Each vertex sums its own
+// edges in CSR order, so the result does not depend on how vertices are split.
+template<typename Scalar,typename Index,int Dim>
+void AddAttraction(const BasicCsrGraph<Index>& aGraph,const BasicSoAPositions<Scalar,Dim>& aPositions,std::size_t aBegin,std::size_t aEnd,Scalar aK
+                  ,BasicSoAVectors<Scalar,Dim>& aMvmt) noexcept
+{
+  for(std::size_t v_id=aBegin; v_id<aEnd; v_id++)
+    {
+      const NsVec<Scalar,Dim> pos=aPositions.Get(v_id);
+      NsVec<Scalar,Dim> mvmt;
+
+      for(Index adj_id:aGraph.GetNeighbors(v_id))
+        {
+          NsVec<Scalar,Dim> delta;
+          Scalar sq_dist=0;
+          for(int axis=0; axis<Dim; axis++)
+            {
+              delta[axis]=pos[axis]-aPositions.m_Coords[axis][adj_id];
+              sq_dist+=delta[axis]*delta[axis];
+            }
+          Scalar distance=std::sqrt(sq_dist);
+          if(distance==0)
+            {
+              continue;
+            }
+
+          // delta/distance * distance^2/K
+          Scalar factor=distance/aK;
+          mvmt-=delta*factor;
+        }
+
+      for(int axis=0; axis<Dim; axis++)
+        {
+          aMvmt.m_Coords[axis][v_id]+=mvmt[axis];
+        }
+    }
+}
+
+
+
+
+#define NODESOUP_INSTANTIATE_(aScalar,aIndex,aDim) \
+  template void AddAttraction(const BasicCsrGraph<aIndex>&,const BasicSoAPositions<aScalar,aDim>&,std::size_t,std::size_t,aScalar \
+                             ,BasicSoAVectors<aScalar,aDim>&) noexcept;
+NODESOUP_FOR_EACH_LAYOUT_TYPE(NODESOUP_INSTANTIATE_)
+#undef NODESOUP_INSTANTIATE_
+
+#define NODESOUP_INSTANTIATE_(aScalar,aDim) \
+  template struct BasicSoAVectors<aScalar,aDim>; \
+  template struct BasicSoAPositions<aScalar,aDim>; \
+  template void AddRepulsion(const BasicSoAPositions<aScalar,aDim>&,std::size_t,std::size_t,aScalar,aScalar,BasicSoAVectors<aScalar,aDim>&) noexcept;
+NODESOUP_INSTANTIATE_(float,2)
+NODESOUP_INSTANTIATE_(float,3)
+NODESOUP_INSTANTIATE_(double,2)
+NODESOUP_INSTANTIATE_(double,3)
+#undef NODESOUP_INSTANTIATE_
+
+
+}
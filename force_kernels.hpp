@@ -0,0 +1,138 @@
+#pragma once
+#include "aligned_allocator.hpp"
+#include "csr_graph.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace nodesoup
+{
+// Fruchterman-Reingold force kernels on structure-of-arrays positions.
+// The SIMD variant is picked at runtime from what the CPU supports.
+
+
+
+enum class SimdLevel
+{
+  kScalar,
+  kSse41,
+  kAvx2,
+  kAvx512
+};
+
+
+SimdLevel   GetSupportedSimdLevel() noexcept;
+SimdLevel   GetSimdLevel() noexcept;
+// Forces a lower level (for testing or benchmarking), clamped to the supported one
+void        SetSimdLevel(SimdLevel aLevel) noexcept;
+const char* GetSimdLevelName(SimdLevel aLevel) noexcept;
+
+
+
+
+template<typename Scalar>
+using scalar_array_t=std::vector<Scalar,AlignedAllocator<Scalar>>;
+using float_array_t=scalar_array_t<float>;
+
+// Vectors split in one array per axis, so the kernels load several vertices at once
+template<typename Scalar,int Dim>
+struct BasicSoAVectors
+{
+  scalar_array_t<Scalar> m_Coords[Dim];
+
+  // New items are set to zero
+  void Resize(std::size_t aCount);
+  std::size_t GetCount() const noexcept;
+  std::size_t GetMemorySize() const noexcept;
+};
+
+// Positions split the same way, with their fixed flags
+template<typename Scalar,int Dim>
+struct BasicSoAPositions
+{
+  scalar_array_t<Scalar> m_Coords[Dim];
+  std::vector<uint8_t>   m_Fixed;
+
+  void Resize(std::size_t aCount);
+  std::size_t GetCount() const noexcept;
+  std::size_t GetMemorySize() const noexcept;
+
+  void Load(const std::vector<NsBasicPosition<Scalar,Dim>>& aPositions);
+  // Copies the coordinates and fixed flags, radiuses are left alone. aPositions is resized
+  // to GetCount() first, so it follows the graph edits (new items get a zero radius).
+  void Store(std::vector<NsBasicPosition<Scalar,Dim>>& aPositions) const;
+  // Appends and removes vertices for the graph edits
+  void PushBack(const NsVec<Scalar,Dim>& aPos,bool aFixed);
+  void PopBack();
+  NsVec<Scalar,Dim> Get(std::size_t aIndex) const noexcept;
+  void              Set(std::size_t aIndex,const NsVec<Scalar,Dim>& aPos) noexcept;
+};
+
+using SoAPositions=BasicSoAPositions<float,2>;
+
+
+
+
+// Adds the K^2/d repulsion from all aCount vertices to vertices [aBegin,aEnd).
+// Pairs farther than aMaxDistance or at the same position are ignored.
+// Each vertex sums its forces in vertex order, so every SIMD level gives the same bits
+// as the scalar code. Only float 2D layouts have SIMD kernels, the others run the
+// scalar code in their own type.
+template<typename Scalar,int Dim>
+void AddRepulsion(const BasicSoAPositions<Scalar,Dim>& aPositions,std::size_t aBegin,std::size_t aEnd,Scalar aKSquared,Scalar aMaxDistance
+                 ,BasicSoAVectors<Scalar,Dim>& aMvmt) noexcept;
+
+// Adds the d^2/K attraction along the edges of vertices [aBegin,aEnd)
+template<typename Scalar,typename Index,int Dim>
+void AddAttraction(const BasicCsrGraph<Index>& aGraph,const BasicSoAPositions<Scalar,Dim>& aPositions,std::size_t aBegin,std::size_t aEnd,Scalar aK
+                  ,BasicSoAVectors<Scalar,Dim>& aMvmt) noexcept;
+
+
+
+
+template<typename Scalar,int Dim>
+inline std::size_t BasicSoAVectors<Scalar,Dim>::GetCount() const noexcept
+{
+  return m_Coords[0].size();
+}
+
+template<typename Scalar,int Dim>
+inline std::size_t BasicSoAVectors<Scalar,Dim>::GetMemorySize() const noexcept
+{
+  return Dim*m_Coords[0].capacity()*sizeof(Scalar);
+}
+
+template<typename Scalar,int Dim>
+inline std::size_t BasicSoAPositions<Scalar,Dim>::GetCount() const noexcept
+{
+  return m_Coords[0].size();
+}
+
+template<typename Scalar,int Dim>
+inline std::size_t BasicSoAPositions<Scalar,Dim>::GetMemorySize() const noexcept
+{
+  return Dim*m_Coords[0].capacity()*sizeof(Scalar)+m_Fixed.capacity();
+}
+
+template<typename Scalar,int Dim>
+inline NsVec<Scalar,Dim> BasicSoAPositions<Scalar,Dim>::Get(std::size_t aIndex) const noexcept
+{
+  NsVec<Scalar,Dim> pos;
+  for(int axis=0; axis<Dim; axis++)
+    {
+      pos[axis]=m_Coords[axis][aIndex];
+    }
+  return pos;
+}
+
+template<typename Scalar,int Dim>
+inline void BasicSoAPositions<Scalar,Dim>::Set(std::size_t aIndex,const NsVec<Scalar,Dim>& aPos) noexcept
+{
+  for(int axis=0; axis<Dim; axis++)
+    {
+      m_Coords[axis][aIndex]=aPos[axis];
+    }
+}
+
+
+}
@@ -1,133 +1,349 @@
 #include "fruchterman_reingold.hpp"
+#include "thread_pool.hpp"
 #include <algorithm>
+#include <atomic>
+#include <cassert>
 #include <cmath>
-#include <iostream>
+#include <limits>
 
 namespace nodesoup
 {
 
 
-FruchtermanReingold::FruchtermanReingold(const adj_list_t& aAdjList,double aK)
-    : m_AdjList(aAdjList)
+template<typename Scalar,typename Index,int Dim>
+BasicFruchtermanReingold<Scalar,Index,Dim>::BasicFruchtermanReingold(const adj_list_t& aAdjList,double aK,double aTheta)
+    : m_AdjList(&aAdjList)
+    , m_Graph(&m_OwnGraph)
     , m_K(aK)
     , m_KSquared(aK* aK)
+    , m_Theta(aTheta)
     , m_Temp(10 * sqrt(aAdjList.size()))
-    , m_Mvmts(m_AdjList.size())
-    , m_StartCircle(true)
+    , m_MaxTemp(m_Temp)
+    , m_Energy(0.0)
+    , m_Progress(0)
+    , m_Tolerance(kDefaultTolerance)
+    , m_Converged(false)
+    , m_TreeValid(false)
+    , m_InitMode(InitMode::kCircle)
     , m_CurrIter(0), m_MaxIter(0)
+    , m_ThreadPool(&DefaultThreadPool())
+    , m_ThreadCount(0)
+    , m_StatsMemorySize(0)
+    , m_LocalRelaxation(true)
 {
 }
 
 
 
 
-void FruchtermanReingold::Start(bool aStartCircle)
+template<typename Scalar,typename Index,int Dim>
+BasicFruchtermanReingold<Scalar,Index,Dim>::BasicFruchtermanReingold(const graph_t& aGraph,double aK,double aTheta)
+    : m_AdjList(nullptr)
+    , m_Graph(&aGraph)
+    , m_K(aK)
+    , m_KSquared(aK* aK)
+    , m_Theta(aTheta)
+    , m_Temp(10 * sqrt(aGraph.GetVertexCount()))
+    , m_MaxTemp(m_Temp)
+    , m_Energy(0.0)
+    , m_Progress(0)
+    , m_Tolerance(kDefaultTolerance)
+    , m_Converged(false)
+    , m_TreeValid(false)
+    , m_InitMode(InitMode::kCircle)
+    , m_CurrIter(0), m_MaxIter(0)
+    , m_ThreadPool(&DefaultThreadPool())
+    , m_ThreadCount(0)
+    , m_StatsMemorySize(0)
+    , m_LocalRelaxation(true)
+{
+}
+
+
+
+
+template<typename Scalar,typename Index,int Dim>
+void BasicFruchtermanReingold<Scalar,Index,Dim>::Start(bool aStartCircle)
+{
+  Start(aStartCircle ? InitMode::kCircle : InitMode::kRandom);
+}
+
+
+
+
+template<typename Scalar,typename Index,int Dim>
+void BasicFruchtermanReingold<Scalar,Index,Dim>::Start(InitMode aInitMode)
 {
-  m_Mvmts.resize(m_AdjList.size());
-  m_Positions.resize(m_AdjList.size());
+  if(m_AdjList)
+    {
+      m_OwnGraph.Assign(*m_AdjList);
+    }
+
+  m_Positions.Resize(m_Graph->GetVertexCount());
+  ResizeBuffers();
 
   m_CurrIter=0;
   m_MaxIter=0;
+  m_TreeValid=false;
 
-  m_StartCircle=aStartCircle;
+  // Hot start, the layout may come back from a previous run
+  m_Temp=m_MaxTemp;
+  ResetConvergence();
+
+  m_InitMode=aInitMode;
+  NODESOUP_STATS_ONLY(m_Stats.CountGrowth(GetMemorySize(),m_StatsMemorySize);)
 }
 
 
 
-void FruchtermanReingold::DoStep()
+
+// Warm start from known positions instead of the circle or random ones
+template<typename Scalar,typename Index,int Dim>
+void BasicFruchtermanReingold<Scalar,Index,Dim>::Start(const std::vector<position_t>& aPositions,double aTemperature)
 {
-  ImVec2 zero={0.0f,0.0f};
-  fill(m_Mvmts.begin(),m_Mvmts.end(), zero);
+  Start(true);
+
+  assert(aPositions.size()==m_Positions.GetCount());
+  m_Positions.Load(aPositions);
+  m_Temp=std::min(aTemperature,m_MaxTemp);
+
+  // past the first iteration, so Step() keeps these positions
+  m_CurrIter=1;
+}
+
 
-  // Repulsion force between vertice pairs
-  for(vertex_id_t v_id=0; v_id<m_AdjList.size(); v_id++)
+
+
+// Runs aIterations layout iterations, without the Step() schedule
+template<typename Scalar,typename Index,int Dim>
+void BasicFruchtermanReingold<Scalar,Index,Dim>::Iterate(int aIterations)
+{
+  if(!m_CurrIter)
     {
-      for(vertex_id_t other_id=v_id+1; other_id<m_AdjList.size(); other_id++)
-        {
-          if(v_id==other_id)
-            {
-              continue;
-            }
+      SetInitPositions();
+      m_CurrIter=1;
+    }
 
-          ImVec2 delta = m_Positions[v_id].m_Pos-m_Positions[other_id].m_Pos;
-          double distance = norm(delta);
-          // TODO: handle distance == 0.0
+  for(int k=0;k<aIterations && !m_Converged;++k)
+    {
+      DoStep();
+    }
+}
 
-          // > 1000.0: not worth computing
-          if(distance > 1000.0)
-            {
-              continue;
-            }
 
-          double repulsion = m_KSquared / distance;
 
-          m_Mvmts[v_id] += delta/distance * repulsion;
-          m_Mvmts[other_id] -= delta/distance * repulsion;
-        }
 
-      // Attraction force between edges
-      for(vertex_id_t adj_id:m_AdjList[v_id])
-        {
-          if(adj_id>v_id)
-            {
-              continue;
-            }
+template<typename Scalar,typename Index,int Dim>
+void BasicFruchtermanReingold<Scalar,Index,Dim>::GetPositions(std::vector<position_t>& aPositions) const
+{
+  m_Positions.Store(aPositions);
+}
+
+
+
+
+// Repulsion force between vertice pairs, O(n^2) with the SIMD kernel
+template<typename Scalar,typename Index,int Dim>
+std::uint64_t BasicFruchtermanReingold<Scalar,Index,Dim>::ComputeExactRepulsion(std::size_t aBegin,std::size_t aEnd)
+{
+  // > 1000.0: not worth computing
+  AddRepulsion(m_Positions,aBegin,aEnd,static_cast<Scalar>(m_KSquared),Scalar(1000),m_Mvmt);
+  return (aEnd-aBegin)*(m_Positions.GetCount()-1);
+}
 
-          ImVec2 delta = m_Positions[v_id].m_Pos-m_Positions[adj_id].m_Pos;
-          float distance=norm(delta);
-          if(distance==0.0f)
-            {
-              continue;
-            }
 
-          double attraction = distance*distance / m_K;
 
-          m_Mvmts[v_id] -= delta / distance * attraction;
-          m_Mvmts[adj_id] += delta / distance * attraction;
+
+// Repulsion approximated with a quadtree or octree (already built), O(n log n)
+template<typename Scalar,typename Index,int Dim>
+std::uint64_t BasicFruchtermanReingold<Scalar,Index,Dim>::ComputeBarnesHutRepulsion(std::size_t aBegin,std::size_t aEnd)
+{
+  std::uint64_t terms=0;
+  for(std::size_t v_id=aBegin; v_id<aEnd; v_id++)
+    {
+      const vec_t mvmt=m_Tree.ComputeRepulsion(static_cast<Index>(v_id),static_cast<Scalar>(m_KSquared),static_cast<Scalar>(m_Theta),terms);
+      for(int axis=0; axis<Dim; axis++)
+        {
+          m_Mvmt.m_Coords[axis][v_id]+=mvmt[axis];
         }
     }
+  return terms;
+}
+
 
-  // Max movement capped by current temperature
-  for(vertex_id_t v_id=0; v_id<m_AdjList.size(); v_id++)
+
+
+// Max movement capped by current temperature. The forces are not needed past this point:
+// the first axis of m_Mvmt gets the distance moved by each vertex and the second its squared force.
+template<typename Scalar,typename Index,int Dim>
+std::uint64_t BasicFruchtermanReingold<Scalar,Index,Dim>::CapMovements(std::size_t aBegin,std::size_t aEnd,double aTemperature)
+{
+  std::uint64_t moved=0;
+  const Scalar temperature=static_cast<Scalar>(aTemperature);
+  for(std::size_t v_id=aBegin; v_id<aEnd; v_id++)
     {
-      if(!m_Positions[v_id].m_Fixed)
+      vec_t mvmt;
+      for(int axis=0; axis<Dim; axis++)
         {
-          double mvmt_norm=norm(m_Mvmts[v_id]);
+          mvmt[axis]=m_Mvmt.m_Coords[axis][v_id];
+          m_Mvmt.m_Coords[axis][v_id]=0;
+        }
+      if(!m_Positions.m_Fixed[v_id])
+        {
+          const Scalar sq_mvmt_norm=sq_norm(mvmt);
+          m_Mvmt.m_Coords[1][v_id]=sq_mvmt_norm;
+
+          Scalar mvmt_norm=std::sqrt(sq_mvmt_norm);
           // < 1.0: not worth computing
-          if (mvmt_norm < 1.0)
+          if (mvmt_norm < 1)
             {
               continue;
             }
-          double capped_mvmt_norm=std::min(mvmt_norm, m_Temp);
-          ImVec2 capped_mvmt=m_Mvmts[v_id] / mvmt_norm * capped_mvmt_norm;
+          Scalar capped_mvmt_norm=std::min(mvmt_norm, temperature);
+          Scalar scale=capped_mvmt_norm/mvmt_norm;
 
-          m_Positions[v_id].m_Pos=m_Positions[v_id].m_Pos+capped_mvmt;
+          for(int axis=0; axis<Dim; axis++)
+            {
+              m_Positions.m_Coords[axis][v_id]+=mvmt[axis]*scale;
+            }
+          m_Mvmt.m_Coords[0][v_id]=capped_mvmt_norm;
+          NODESOUP_COUNT(moved,1);
         }
     }
+  return moved;
+}
+
+
+
+
+// Splits the vertices in ranges of aGrain for the thread pool, or runs serially
+// when there are too few vertices to pay for waking the threads
+template<typename Scalar,typename Index,int Dim>
+void BasicFruchtermanReingold<Scalar,Index,Dim>::ForEachVertexRange(std::size_t aGrain,const std::function<void(std::size_t,std::size_t)>& aFunc)
+{
+  const std::size_t vertex_count=m_Positions.GetCount();
+  if(m_ThreadCount==1 || vertex_count<kMinParallelVertices)
+    {
+      aFunc(0,vertex_count);
+      return;
+    }
+
+  m_ThreadPool->ParallelFor(vertex_count,aGrain,aFunc,m_ThreadCount);
+}
+
+
 
-  // Cool down fast until we reach 1.5, then stay at low temperature
-  if(m_Temp>0.1)
+
+template<typename Scalar,typename Index,int Dim>
+void BasicFruchtermanReingold<Scalar,Index,Dim>::DoStep()
+{
+  const bool barnes_hut=m_Theta>0.0;
+  if(barnes_hut)
     {
-      m_Temp*=0.85;
+      NODESOUP_SCOPED_TIMER(m_Stats.m_Phases[LayoutStats::kTreeBuild]);
+      m_Tree.Build(m_Positions);
     }
-  else
+  m_TreeValid=barnes_hut;
+
+  // Times and counts of the ranges, added up over the threads
+  NODESOUP_STATS_ONLY(std::atomic<std::uint64_t> repulsion_ns{0},attraction_ns{0},capping_ns{0},pairs{0},moved{0};)
+
+  // Every vertex sums the forces acting on it and nothing else, so the ranges can run on
+  // any thread in any order: the layout does not depend on the number of threads
+  ForEachVertexRange(64,[&](std::size_t aBegin,std::size_t aEnd)
+  {
+    NODESOUP_STATS_ONLY(LapTimer timer;)
+    for(int axis=0; axis<Dim; axis++)
+      {
+        std::fill(m_Mvmt.m_Coords[axis].begin()+aBegin,m_Mvmt.m_Coords[axis].begin()+aEnd,Scalar(0));
+      }
+
+    [[maybe_unused]] const std::uint64_t range_pairs=barnes_hut ? ComputeBarnesHutRepulsion(aBegin,aEnd) : ComputeExactRepulsion(aBegin,aEnd);
+    NODESOUP_STATS_ONLY(repulsion_ns+=timer.Lap();)
+
+    // Attraction force between edges
+    AddAttraction(*m_Graph,m_Positions,aBegin,aEnd,static_cast<Scalar>(m_K),m_Mvmt);
+    NODESOUP_STATS_ONLY(attraction_ns+=timer.Lap();
+                        std::uint64_t arcs=0;
+                        for(std::size_t v_id=aBegin; v_id<aEnd; v_id++) { arcs+=m_Graph->GetDegree(v_id); }
+                        pairs+=range_pairs+arcs;)
+  });
+
+  // Positions only change once every force is known
+  ForEachVertexRange(4096,[&](std::size_t aBegin,std::size_t aEnd)
+  {
+    NODESOUP_STATS_ONLY(LapTimer timer;)
+    for(int axis=0; axis<Dim; axis++)
+      {
+        std::copy(m_Mvmt.m_Coords[axis].begin()+aBegin,m_Mvmt.m_Coords[axis].begin()+aEnd,m_Residual.m_Coords[axis].begin()+aBegin);
+      }
+    [[maybe_unused]] const std::uint64_t range_moved=CapMovements(aBegin,aEnd,m_Temp);
+    NODESOUP_STATS_ONLY(capping_ns+=timer.Lap(); moved+=range_moved;)
+  });
+
+  NODESOUP_STATS_ONLY(m_Stats.m_Phases[LayoutStats::kRepulsion].Add(repulsion_ns);
+                      m_Stats.m_Phases[LayoutStats::kAttraction].Add(attraction_ns);
+                      m_Stats.m_Phases[LayoutStats::kCapping].Add(capping_ns);
+                      m_Stats.m_PairEvaluations+=pairs;
+                      m_Stats.m_VerticesMoved+=moved;
+                      m_Stats.CountGrowth(GetMemorySize(),m_StatsMemorySize);)
+
+  // Summed serially, so the schedule does not depend on the number of threads
+  double displacement=0.0;
+  double energy=0.0;
+  for(std::size_t v_id=0; v_id<m_Positions.GetCount(); v_id++)
     {
-      m_Temp=0.1;
+      displacement+=m_Mvmt.m_Coords[0][v_id];
+      energy+=m_Mvmt.m_Coords[1][v_id];
     }
+
+  UpdateTemperature(energy);
+  m_Converged=displacement<=m_Tolerance*m_K*m_Positions.GetCount();
 }
 
 
 
 
-void FruchtermanReingold::Step(int aStepSize,int aMaxStep,std::vector<NsPosition>& aPositions)
+template<typename Scalar,typename Index,int Dim>
+void BasicFruchtermanReingold<Scalar,Index,Dim>::UpdateTemperature(double aEnergy) noexcept
 {
-  if(m_CurrIter>=aMaxStep && aMaxStep>0)
+  if(aEnergy<m_Energy)
     {
-      for(int k=0;k<aPositions.size();++k)
+      if(++m_Progress>=kProgressIterations)
         {
-          aPositions[k].m_Fixed=m_Positions[k].m_Fixed;
-          aPositions[k].m_Pos=m_Positions[k].m_Pos;
+          m_Progress=0;
+          m_Temp=std::min(m_Temp/kCooling,m_MaxTemp);
         }
+    }
+  else
+    {
+      m_Progress=0;
+      m_Temp*=kCooling;
+    }
+  m_Energy=aEnergy;
+}
+
+
+
+
+// The layout moves again, from the current temperature
+template<typename Scalar,typename Index,int Dim>
+void BasicFruchtermanReingold<Scalar,Index,Dim>::ResetConvergence() noexcept
+{
+  m_Energy=std::numeric_limits<double>::max();
+  m_Progress=0;
+  m_Converged=false;
+}
+
+
+
+
+template<typename Scalar,typename Index,int Dim>
+void BasicFruchtermanReingold<Scalar,Index,Dim>::Step(int aStepSize,int aMaxStep,std::vector<position_t>& aPositions)
+{
+  if(m_CurrIter>=aMaxStep && aMaxStep>0)
+    {
+      m_Positions.Store(aPositions);
       return;
     }
 
@@ -136,7 +352,7 @@ void FruchtermanReingold::Step(int aStepSize,int aMaxStep,std::vector<NsPosition
       SetInitPositions();
     }
 
-  for(int k=0;k<aStepSize && m_CurrIter<m_MaxIter;++k)
+  for(int k=0;k<aStepSize && m_CurrIter<m_MaxIter && !m_Converged;++k)
     {
       DoStep();
       m_CurrIter++;
@@ -148,10 +364,554 @@ void FruchtermanReingold::Step(int aStepSize,int aMaxStep,std::vector<NsPosition
       m_CurrIter=1;
       m_MaxIter++;
 
-      for(int k=0;k<aPositions.size();++k)
+      m_Positions.Store(aPositions);
+    }
+  else if(m_Converged)
+    {
+      m_Positions.Store(aPositions);
+    }
+}
+
+
+
+
+template<typename Scalar,typename Index,int Dim>
+StepProgress BasicFruchtermanReingold<Scalar,Index,Dim>::StepFor(std::chrono::microseconds aBudget,std::vector<position_t>& aPositions)
+{
+  using clock=std::chrono::steady_clock;
+
+  if (!m_CurrIter)
+    {
+      SetInitPositions();
+      m_CurrIter=1;
+    }
+
+  StepProgress progress;
+  const clock::time_point start=clock::now();
+  clock::time_point now=start;
+  while(!m_Converged && (!progress.m_Iterations || now-start+m_IterationCost.Get()<=aBudget))
+    {
+      DoStep();
+      m_CurrIter++;
+      progress.m_Iterations++;
+
+      const clock::time_point iter_end=clock::now();
+      m_IterationCost.Add(iter_end-now);
+      now=iter_end;
+    }
+
+  m_Positions.Store(aPositions);
+
+  progress.m_Elapsed=std::chrono::duration_cast<std::chrono::microseconds>(now-start);
+  progress.m_Converged=m_Converged;
+  return progress;
+}
+
+
+
+
+template<typename Scalar,typename Index,int Dim>
+std::size_t BasicFruchtermanReingold<Scalar,Index,Dim>::GetMemorySize() const noexcept
+{
+  return m_Mvmt.GetMemorySize()+m_Residual.GetMemorySize()+m_Positions.GetMemorySize()
+        +m_Tree.GetMemorySize()+m_OwnGraph.GetMemorySize();
+}
+
+
+
+
+// Buffers sized from m_Positions
+template<typename Scalar,typename Index,int Dim>
+void BasicFruchtermanReingold<Scalar,Index,Dim>::ResizeBuffers()
+{
+  const std::size_t vertex_count=m_Positions.GetCount();
+  m_Mvmt.Resize(vertex_count);
+  m_Residual.Resize(vertex_count);
+  m_ActiveMark.resize(vertex_count,0);
+  m_MaxTemp=10*sqrt(vertex_count);
+}
+
+
+
+
+// The first edit copies the graph, later ones edit the copy
+template<typename Scalar,typename Index,int Dim>
+typename BasicFruchtermanReingold<Scalar,Index,Dim>::graph_t& BasicFruchtermanReingold<Scalar,Index,Dim>::EditGraph()
+{
+  assert(m_Positions.GetCount()==m_Graph->GetVertexCount());
+  if(m_Graph!=&m_OwnGraph)
+    {
+      m_OwnGraph=*m_Graph;
+      m_Graph=&m_OwnGraph;
+    }
+  m_AdjList=nullptr;
+  return m_OwnGraph;
+}
+
+
+
+
+// New vertices without neighbours start an edge away from the origin, in a direction given
+// by the id as in PlaceNear(): at the origin no force would ever move them apart
+template<typename Scalar,typename Index,int Dim>
+Index BasicFruchtermanReingold<Scalar,Index,Dim>::AddVertex()
+{
+  const bool relax=FreezeAround({});
+  const Index v_id=EditGraph().AddVertex();
+  m_Positions.PushBack(GetSpreadDirection<Scalar,Dim>(v_id)*static_cast<Scalar>(m_K),false);
+  ResizeBuffers();
+  if(m_TreeValid)
+    {
+      m_Tree.AddVertex();
+    }
+
+  if(relax)
+    {
+      m_ActiveMark[v_id]=1;
+      m_Active.push_back(v_id);
+      RelaxEdit();
+    }
+  return v_id;
+}
+
+
+
+
+template<typename Scalar,typename Index,int Dim>
+void BasicFruchtermanReingold<Scalar,Index,Dim>::AddEdge(Index aFrom,Index aTo)
+{
+  if(aFrom==aTo || m_Graph->HasEdge(aFrom,aTo))
+    {
+      return;
+    }
+
+  const bool place_from=!m_Graph->GetDegree(aFrom);
+  const bool place_to=!m_Graph->GetDegree(aTo);
+  const bool relax=FreezeAround({aFrom,aTo});
+  EditGraph().AddEdge(aFrom,aTo);
+
+  if(place_from && !place_to)
+    {
+      PlaceNear(aFrom,aTo);
+    }
+  else if(place_to && !place_from)
+    {
+      PlaceNear(aTo,aFrom);
+    }
+
+  if(relax)
+    {
+      RelaxEdit();
+    }
+}
+
+
+
+
+template<typename Scalar,typename Index,int Dim>
+void BasicFruchtermanReingold<Scalar,Index,Dim>::RemoveEdge(Index aFrom,Index aTo)
+{
+  if(!m_Graph->HasEdge(aFrom,aTo))
+    {
+      return;
+    }
+
+  const bool relax=FreezeAround({aFrom,aTo});
+  EditGraph().RemoveEdge(aFrom,aTo);
+  if(relax)
+    {
+      RelaxEdit();
+    }
+}
+
+
+
+
+template<typename Scalar,typename Index,int Dim>
+void BasicFruchtermanReingold<Scalar,Index,Dim>::RemoveVertex(Index aVertexId)
+{
+  graph_t& graph=EditGraph();
+
+  const Index last=static_cast<Index>(graph.GetVertexCount()-1);
+  const std::vector<Index> seeds(graph.GetNeighbors(aVertexId).begin(),graph.GetNeighbors(aVertexId).end());
+  const bool relax=FreezeAround(seeds);
+
+  graph.RemoveVertex(aVertexId);
+  m_Positions.Set(aVertexId,m_Positions.Get(last));
+  m_Positions.m_Fixed[aVertexId]=m_Positions.m_Fixed[last];
+  for(int axis=0; axis<Dim; axis++)
+    {
+      m_Residual.m_Coords[axis][aVertexId]=m_Residual.m_Coords[axis][last];
+    }
+  m_Positions.PopBack();
+  if(m_TreeValid)
+    {
+      m_Tree.RemoveVertex(aVertexId);
+    }
+
+  // The active vertices follow: the removed one leaves, the last one is renamed
+  std::size_t kept=0;
+  for(Index v_id:m_Active)
+    {
+      if(v_id!=aVertexId)
+        {
+          m_Active[kept++]=(v_id==last ? aVertexId : v_id);
+        }
+    }
+  m_Active.resize(kept);
+  m_ActiveMark[aVertexId]=m_ActiveMark[last];
+  m_ActiveMark[last]=0;
+  ResizeBuffers();
+
+  if(relax)
+    {
+      RelaxEdit();
+    }
+}
+
+
+
+
+// Half an edge away, in a direction given by the id so that several new vertices around
+// the same neighbour do not overlap. The vertex had no force from the edges before, its
+// residual one is dropped.
+template<typename Scalar,typename Index,int Dim>
+void BasicFruchtermanReingold<Scalar,Index,Dim>::PlaceNear(Index aVertexId,Index aNeighborId)
+{
+  if(m_Positions.m_Fixed[aVertexId])
+    {
+      return;
+    }
+
+  const Scalar offset=static_cast<Scalar>(0.5*m_K);
+  m_Positions.Set(aVertexId,m_Positions.Get(aNeighborId)+GetSpreadDirection<Scalar,Dim>(aVertexId)*offset);
+  for(int axis=0; axis<Dim; axis++)
+    {
+      m_Residual.m_Coords[axis][aVertexId]=0;
+    }
+  if(m_TreeValid)
+    {
+      m_Tree.MoveVertex(aVertexId);
+    }
+}
+
+
+
+
+// Edits and drops relax with the tree even when the iterations are exact
+template<typename Scalar,typename Index,int Dim>
+double BasicFruchtermanReingold<Scalar,Index,Dim>::GetEditTheta() const noexcept
+{
+  return m_Theta>0.0 ? m_Theta : kLocalTheta;
+}
+
+
+
+
+// Before an edit, the vertices up to kEditHops hops from aSeeds take their current forces
+// as residual ones: the relaxation after the edit moves them by what it changed only, not
+// by what is left of the cooling or by the error of the tree. The rest of the layout is
+// left as is, the global iterations resume from the current temperature and stop again at
+// once if nothing else moves. False before the first iteration, when there is nothing to relax.
+template<typename Scalar,typename Index,int Dim>
+bool BasicFruchtermanReingold<Scalar,Index,Dim>::FreezeAround(const std::vector<Index>& aSeeds)
+{
+  ResetConvergence();
+  if(!m_CurrIter)
+    {
+      return false;
+    }
+
+  const double theta=GetEditTheta();
+  CollectActive(aSeeds,kEditHops);
+  UpdateActiveTree(theta);
+  for(Index v_id:m_Active)
+    {
+      for(int axis=0; axis<Dim; axis++)
+        {
+          m_Residual.m_Coords[axis][v_id]=0;
+        }
+    }
+
+  [[maybe_unused]] const std::uint64_t pairs=ComputeActiveForces(0,m_Active.size(),theta);
+  NODESOUP_COUNT(m_Stats.m_PairEvaluations,pairs);
+  for(Index v_id:m_Active)
+    {
+      for(int axis=0; axis<Dim; axis++)
+        {
+          m_Residual.m_Coords[axis][v_id]=m_Mvmt.m_Coords[axis][v_id];
+        }
+    }
+  return true;
+}
+
+
+
+
+template<typename Scalar,typename Index,int Dim>
+void BasicFruchtermanReingold<Scalar,Index,Dim>::RelaxEdit()
+{
+  RelaxActive(m_K,0.0,GetEditTheta());
+  ClearActive();
+  NODESOUP_STATS_ONLY(m_Stats.CountGrowth(GetMemorySize(),m_StatsMemorySize);)
+}
+
+
+
+
+// The layout only changes around the dropped vertex, the rest is not even visited but by
+// the repulsion: vertices next to the relaxed ones join them when they are pushed too hard
+template<typename Scalar,typename Index,int Dim>
+void BasicFruchtermanReingold<Scalar,Index,Dim>::RelaxDropped(Index aVertexId)
+{
+  CollectActive({aVertexId},kDragHops);
+  CollectWithin(aVertexId,kDragRadius*m_K);
+  const double theta=GetEditTheta();
+  UpdateActiveTree(theta);
+  RelaxActive(m_K,kFrozenForce*m_K,theta);
+  ClearActive();
+  NODESOUP_STATS_ONLY(m_Stats.CountGrowth(GetMemorySize(),m_StatsMemorySize);)
+}
+
+
+
+
+// Breadth first up to aHops hops from aSeeds, or kMaxActiveVertices vertices
+template<typename Scalar,typename Index,int Dim>
+void BasicFruchtermanReingold<Scalar,Index,Dim>::CollectActive(const std::vector<Index>& aSeeds,int aHops)
+{
+  m_Active.clear();
+  for(Index v_id:aSeeds)
+    {
+      if(!m_ActiveMark[v_id])
+        {
+          m_ActiveMark[v_id]=1;
+          m_Active.push_back(v_id);
+        }
+    }
+
+  std::size_t hop_begin=0;
+  for(int hop=0; hop<aHops && m_Active.size()<kMaxActiveVertices; hop++)
+    {
+      const std::size_t hop_end=m_Active.size();
+      for(std::size_t k=hop_begin; k<hop_end && m_Active.size()<kMaxActiveVertices; k++)
+        {
+          for(Index adj_id:m_Graph->GetNeighbors(m_Active[k]))
+            {
+              if(!m_ActiveMark[adj_id])
+                {
+                  m_ActiveMark[adj_id]=1;
+                  m_Active.push_back(adj_id);
+                }
+            }
+        }
+      hop_begin=hop_end;
+    }
+}
+
+
+
+
+// Adds the vertices closer than aRadius, a plain scan: O(n) but far below one iteration
+template<typename Scalar,typename Index,int Dim>
+void BasicFruchtermanReingold<Scalar,Index,Dim>::CollectWithin(Index aVertexId,double aRadius)
+{
+  const vec_t pos=m_Positions.Get(aVertexId);
+  const Scalar sq_radius=static_cast<Scalar>(aRadius*aRadius);
+  for(std::size_t v_id=0; v_id<m_Positions.GetCount() && m_Active.size()<kMaxActiveVertices; v_id++)
+    {
+      if(sq_norm(m_Positions.Get(v_id)-pos)<=sq_radius && !m_ActiveMark[v_id])
+        {
+          m_ActiveMark[v_id]=1;
+          m_Active.push_back(static_cast<Index>(v_id));
+        }
+    }
+}
+
+
+
+
+// Adds the free neighbours of the active vertices whose force changed by more than aForce,
+// the others stay frozen
+template<typename Scalar,typename Index,int Dim>
+void BasicFruchtermanReingold<Scalar,Index,Dim>::GrowActive(double aForce,double aTheta)
+{
+  const std::size_t active_count=m_Active.size();
+  for(std::size_t k=0; k<active_count; k++)
+    {
+      for(Index adj_id:m_Graph->GetNeighbors(m_Active[k]))
+        {
+          if(!m_ActiveMark[adj_id] && !m_Positions.m_Fixed[adj_id])
+            {
+              m_ActiveMark[adj_id]=1;
+              m_Active.push_back(adj_id);
+            }
+        }
+    }
+
+  [[maybe_unused]] const std::uint64_t pairs=ComputeActiveForces(active_count,m_Active.size(),aTheta);
+  NODESOUP_COUNT(m_Stats.m_PairEvaluations,pairs);
+
+  const Scalar sq_force=static_cast<Scalar>(aForce*aForce);
+  std::size_t kept=active_count;
+  for(std::size_t k=active_count; k<m_Active.size(); k++)
+    {
+      const Index v_id=m_Active[k];
+      Scalar sq_mvmt=0;
+      for(int axis=0; axis<Dim; axis++)
+        {
+          sq_mvmt+=m_Mvmt.m_Coords[axis][v_id]*m_Mvmt.m_Coords[axis][v_id];
+        }
+      if(sq_mvmt>sq_force && kept<kMaxActiveVertices)
+        {
+          m_Active[kept++]=v_id;
+        }
+      else
+        {
+          m_ActiveMark[v_id]=0;
+        }
+    }
+  m_Active.resize(kept);
+}
+
+
+
+
+template<typename Scalar,typename Index,int Dim>
+void BasicFruchtermanReingold<Scalar,Index,Dim>::ClearActive() noexcept
+{
+  for(Index v_id:m_Active)
+    {
+      m_ActiveMark[v_id]=0;
+    }
+  m_Active.clear();
+}
+
+
+
+
+// The tree of the last iteration is kept, the active vertices move to their current
+// positions in it, O(active*log n). The others moved at most one iteration since: their
+// cells are as good a far field as when it was built. There is only a full build, O(n log n),
+// when there is no tree yet.
+template<typename Scalar,typename Index,int Dim>
+void BasicFruchtermanReingold<Scalar,Index,Dim>::UpdateActiveTree(double aTheta)
+{
+  if(aTheta<=0.0)
+    {
+      return;
+    }
+
+  NODESOUP_SCOPED_TIMER(m_Stats.m_Phases[LayoutStats::kTreeBuild]);
+  if(!m_TreeValid || m_Tree.GetVertexCount()!=m_Positions.GetCount())
+    {
+      m_Tree.Build(m_Positions);
+      m_TreeValid=true;
+      return;
+    }
+
+  for(Index v_id:m_Active)
+    {
+      m_Tree.MoveVertex(v_id);
+    }
+}
+
+
+
+
+// Forces on m_Active[aBegin..aEnd-1] into m_Mvmt, less the residual forces the layout froze
+// with. Returns the pairs evaluated.
+template<typename Scalar,typename Index,int Dim>
+std::uint64_t BasicFruchtermanReingold<Scalar,Index,Dim>::ComputeActiveForces(std::size_t aBegin,std::size_t aEnd,double aTheta)
+{
+  const bool barnes_hut=aTheta>0.0;
+  [[maybe_unused]] const std::size_t vertex_count=m_Positions.GetCount();
+  std::uint64_t pairs=0;
+  for(std::size_t k=aBegin; k<aEnd; k++)
+    {
+      const Index v_id=m_Active[k];
+      for(int axis=0; axis<Dim; axis++)
+        {
+          m_Mvmt.m_Coords[axis][v_id]=-m_Residual.m_Coords[axis][v_id];
+        }
+      if(barnes_hut)
+        {
+          const vec_t mvmt=m_Tree.ComputeRepulsion(v_id,static_cast<Scalar>(m_KSquared),static_cast<Scalar>(aTheta),pairs);
+          for(int axis=0; axis<Dim; axis++)
+            {
+              m_Mvmt.m_Coords[axis][v_id]+=mvmt[axis];
+            }
+        }
+      else
+        {
+          AddRepulsion(m_Positions,v_id,v_id+1,static_cast<Scalar>(m_KSquared),Scalar(1000),m_Mvmt);
+          NODESOUP_COUNT(pairs,vertex_count-1);
+        }
+      AddAttraction(*m_Graph,m_Positions,v_id,v_id+1,static_cast<Scalar>(m_K),m_Mvmt);
+      NODESOUP_COUNT(pairs,m_Graph->GetDegree(v_id));
+    }
+  return pairs;
+}
+
+
+
+
+// Iterations moving only the active vertices, the others only push and pull them. Each one
+// costs O(active*log n) with aTheta>0.0, the moved vertices follow in the tree (see
+// UpdateActiveTree()), O(active*n) with the exact repulsion. With aGrowForce>0.0 the active
+// set grows every kGrowInterval iterations, see GrowActive(). The temperature follows the
+// schedule of the global iterations.
+template<typename Scalar,typename Index,int Dim>
+void BasicFruchtermanReingold<Scalar,Index,Dim>::RelaxActive(double aTemperature,double aGrowForce,double aTheta)
+{
+  NODESOUP_SCOPED_TIMER(m_Stats.m_Phases[LayoutStats::kLocalRelaxation]);
+
+  int progress=0;
+  double energy=std::numeric_limits<double>::max();
+  for(int iter=0; iter<kMaxLocalIterations; iter++)
+    {
+      // Every vertex moves as soon as its force is known: the next ones see it moved, which
+      // settles a small set in far fewer iterations than moving them all at once
+      std::uint64_t pairs=0;
+      double displacement=0.0;
+      double active_energy=0.0;
+      for(std::size_t k=0; k<m_Active.size(); k++)
+        {
+          const Index v_id=m_Active[k];
+          pairs+=ComputeActiveForces(k,k+1,aTheta);
+          [[maybe_unused]] const std::uint64_t moved=CapMovements(v_id,v_id+1,aTemperature);
+          if(m_TreeValid)
+            {
+              m_Tree.MoveVertex(v_id);
+            }
+          NODESOUP_COUNT(m_Stats.m_VerticesMoved,moved);
+          displacement+=m_Mvmt.m_Coords[0][v_id];
+          active_energy+=m_Mvmt.m_Coords[1][v_id];
+        }
+      NODESOUP_COUNT(m_Stats.m_PairEvaluations,pairs);
+
+      // Same schedule as UpdateTemperature()
+      if(active_energy<energy)
+        {
+          if(++progress>=kProgressIterations)
+            {
+              progress=0;
+              aTemperature=std::min(aTemperature/kCooling,m_MaxTemp);
+            }
+        }
+      else
+        {
+          progress=0;
+          aTemperature*=kCooling;
+        }
+      energy=active_energy;
+      if(displacement<=m_Tolerance*m_K*m_Active.size())
         {
-          aPositions[k].m_Fixed=m_Positions[k].m_Fixed;
-          aPositions[k].m_Pos=m_Positions[k].m_Pos;
+          break;
+        }
+      if(aGrowForce>0.0 && (iter+1)%kGrowInterval==0)
+        {
+          GrowActive(aGrowForce,aTheta);
         }
     }
 }
@@ -159,15 +919,19 @@ void FruchtermanReingold::Step(int aStepSize,int aMaxStep,std::vector<NsPosition
 
 
 
-void FruchtermanReingold::SetInitPositions()
+template<typename Scalar,typename Index,int Dim>
+void BasicFruchtermanReingold<Scalar,Index,Dim>::SetInitPositions()
 {
-  nodesoup::SetInitPositions(m_StartCircle,m_Positions);
+  std::vector<position_t> positions(m_Positions.GetCount());
+  nodesoup::SetInitPositions(m_InitMode,*m_Graph,positions);
+  m_Positions.Load(positions);
 }
 
 
 
 
-void FruchtermanReingold::SetK(double aK) noexcept
+template<typename Scalar,typename Index,int Dim>
+void BasicFruchtermanReingold<Scalar,Index,Dim>::SetK(double aK) noexcept
 {
   m_K=aK;
   m_KSquared=aK*aK;
@@ -176,27 +940,56 @@ void FruchtermanReingold::SetK(double aK) noexcept
 
 
 
-void FruchtermanReingold::MovePos(vertex_id_t aVertexId,const ImVec2& aDisp,bool aRecalculate)
+template<typename Scalar,typename Index,int Dim>
+void BasicFruchtermanReingold<Scalar,Index,Dim>::MovePos(Index aVertexId,const vec_t& aDisp,bool aRecalculate)
 {
   // TODO: assert aVertexId en rango
   if(aRecalculate)
     {
       if(aDisp.x==kInvalidPos && aDisp.y==kInvalidPos)
         {
-          m_Positions[aVertexId].m_Fixed=!m_Positions[aVertexId].m_Fixed;
+          m_Positions.m_Fixed[aVertexId]=!m_Positions.m_Fixed[aVertexId];
+        }
+
+      // Before the first iteration the whole layout is still to be done
+      if(m_LocalRelaxation && m_CurrIter)
+        {
+          if(m_Converged)
+            {
+              RelaxDropped(aVertexId);
+            }
+          return;
         }
 
+      ResetConvergence();
+      // Warm enough for the neighbours to follow the moved vertex
+      m_Temp=std::min(std::max(m_Temp,m_K),m_MaxTemp);
       m_CurrIter=1;
       m_MaxIter=0;
       return;
     }
 
-  m_Positions[aVertexId].m_Pos+=aDisp;
-  if(sq_norm(aDisp)>0.0f)
+  if(!m_LocalRelaxation)
+    {
+      ResetConvergence();
+    }
+  m_Positions.Set(aVertexId,m_Positions.Get(aVertexId)+aDisp);
+  if(m_TreeValid)
     {
-      m_Positions[aVertexId].m_Fixed=true;
+      m_Tree.MoveVertex(aVertexId);
+    }
+  if(sq_norm(aDisp)>0)
+    {
+      m_Positions.m_Fixed[aVertexId]=true;
     }
 }
 
 
+
+
+#define NODESOUP_INSTANTIATE_(aScalar,aIndex,aDim) template class BasicFruchtermanReingold<aScalar,aIndex,aDim>;
+NODESOUP_FOR_EACH_LAYOUT_TYPE(NODESOUP_INSTANTIATE_)
+#undef NODESOUP_INSTANTIATE_
+
+
 }
@@ -1,18 +1,50 @@
 #pragma once
 #include "nodesoup.hpp"
+#include "barnes_hut.hpp"
+#include "csr_graph.hpp"
+#include "force_kernels.hpp"
+#include "layout_stats.hpp"
+#include "step_budget.hpp"
+#include <chrono>
+#include <functional>
 #include <vector>
 
 namespace nodesoup
 {
 
+class ThreadPool;
 
-class FruchtermanReingold
+// Scalar is the type of the positions and forces (float or double), Index the type of the
+// vertex ids (std::uint32_t or std::uint64_t, as in BasicCsrGraph) and Dim 2 or 3. They are
+// instantiated in fruchterman_reingold.cpp for every combination, FruchtermanReingold below
+// is the float, 32 bits, 2D one: the fastest for large graphs, and what the demo uses.
+template<typename Scalar,typename Index,int Dim>
+class BasicFruchtermanReingold
 {
 public:
-  FruchtermanReingold(const adj_list_t& aAdjList,double aK=15.0);
+
+  using vec_t=NsVec<Scalar,Dim>;
+  using position_t=NsBasicPosition<Scalar,Dim>;
+  using graph_t=BasicCsrGraph<Index>;
+
+  // aTheta==0.0 computes the exact O(n^2) repulsion, aTheta>0.0 uses the Barnes-Hut approximation.
+  // With the SIMD kernel the exact repulsion is faster up to about 10k vertices (3-4 times at 1k),
+  // Barnes-Hut at 0.8 wins past it, 2-3 times at 30k, see bench/nodesoup_bench.cpp.
+  BasicFruchtermanReingold(const adj_list_t& aAdjList,double aK=15.0,double aTheta=0.0);
+  BasicFruchtermanReingold(const graph_t& aGraph,double aK=15.0,double aTheta=0.0);
 
   void Start(bool aStartCircle=true);
-  void Step(int aStepSize,int aMaxStep,std::vector<NsPosition>& aPositions);
+  void Start(InitMode aInitMode);
+  void Start(const std::vector<position_t>& aPositions,double aTemperature);
+  void Step(int aStepSize,int aMaxStep,std::vector<position_t>& aPositions);
+  // Runs as many iterations as fit in aBudget (at least one unless converged), from the
+  // measured cost of the previous ones. Unlike Step() there is no schedule, every call
+  // continues the layout.
+  StepProgress StepFor(std::chrono::microseconds aBudget,std::vector<position_t>& aPositions);
+
+  // Up to aIterations, stops once converged
+  void Iterate(int aIterations);
+  void GetPositions(std::vector<position_t>& aPositions) const;
 
   int GetCurrIter() const noexcept;
   int GetMaxIters() const noexcept;
@@ -20,50 +52,263 @@ public:
   double GetK() const noexcept;
   void   SetK(double aK) noexcept;
 
+  double GetTheta() const noexcept;
+  void   SetTheta(double aTheta) noexcept;
+
+  // Sum of the squared forces on the free vertices at the last iteration
   double GetEnergy() const noexcept;
+  // Longest move of an iteration, what Start() warm starts from
+  double GetTemperature() const noexcept;
+
+  // Converged once the vertices move less than aTolerance*K on average in an iteration.
+  // Steps do nothing until MovePos() or Start() is called.
+  bool   IsConverged() const noexcept;
+  double GetTolerance() const noexcept;
+  void   SetTolerance(double aTolerance) noexcept;
+
+  static constexpr double kDefaultTolerance=0.01;
+
+  // Phase times and counters, see layout_stats.hpp
+  const LayoutStats& GetStats() const noexcept;
+  void               ResetStats() noexcept;
+  // Bytes of the engine buffers, the graph included when owned
+  std::size_t        GetMemorySize() const noexcept;
+
+  void   MovePos(Index aVertexId,const vec_t& aDisp,bool aRecalculate);
 
-  void   MovePos(vertex_id_t aVertexId,const ImVec2& aDisp,bool aRecalculate);
+  // With local relaxation (the default) dragging a vertex leaves the rest of the layout as
+  // is. Dropping it in a converged layout relaxes the vertices up to kDragHops hops or
+  // kDragRadius*K away, and the vertices next to them whose force changes by more than
+  // kFrozenForce*K join them; the rest stays frozen and the layout stays converged. Dropping
+  // it while the layout runs lets the iterations go on. Without local relaxation every drop
+  // restarts the global iterations. Drops relax against the Barnes-Hut tree as the graph
+  // edits below do, at kLocalTheta when the iterations are exact.
+  // Cooling freezes a layout with forces left on the vertices: local relaxations only move
+  // the vertices by the change of their force, since the last iteration for drops and since
+  // just before the edit for graph edits.
+  bool GetLocalRelaxation() const noexcept;
+  void SetLocalRelaxation(bool aLocal) noexcept;
+
+  // Graph edits after Start(), keeping the layout. A vertex without neighbours moves next to
+  // its first one, then the vertices up to kEditHops hops from the edit are relaxed on their
+  // own before the global iterations resume. From the first edit the engine works on its own
+  // copy of the graph, see GetGraph(). Step() and StepFor() resize their positions to it.
+  // The relaxation is pushed by the Barnes-Hut tree of the last iteration, where only the
+  // relaxed vertices move: an edit costs O(active*log n) per local iteration plus the
+  // CsrGraph edit. Exact iterations (theta 0) have no tree, the first edit after them
+  // builds one at kLocalTheta, O(n log n).
+  Index AddVertex();
+  void  AddEdge(Index aFrom,Index aTo);
+  void  RemoveEdge(Index aFrom,Index aTo);
+  // The last vertex takes the id of the removed one, as in CsrGraph::RemoveVertex()
+  void  RemoveVertex(Index aVertexId);
+
+  const graph_t& GetGraph() const noexcept;
+
+  // Threads used by each step, 0: every thread of the pool, 1: serial.
+  // Graphs below kMinParallelVertices always run serially.
+  unsigned int GetThreadCount() const noexcept;
+  void         SetThreadCount(unsigned int aThreadCount) noexcept;
+  void         SetThreadPool(ThreadPool& aThreadPool) noexcept;
+
+  static constexpr std::size_t kMinParallelVertices=1024;
+
+  static constexpr double kCooling=0.9;
+  static constexpr int    kProgressIterations=5;
+
+  static constexpr int         kEditHops=2;
+  static constexpr std::size_t kMaxActiveVertices=4096;
+  static constexpr int         kMaxLocalIterations=50;
+  static constexpr double      kLocalTheta=0.5;
+
+  static constexpr int    kDragHops=3;
+  static constexpr double kDragRadius=3.0;
+  static constexpr double kFrozenForce=0.5;
+  static constexpr int    kGrowInterval=10;
 
 private:
 
-  const adj_list_t& m_AdjList;
+  // Graphs are read on Start(), an adjacency list is converted to m_OwnGraph
+  const adj_list_t* m_AdjList;
+  const graph_t*    m_Graph;
+  graph_t           m_OwnGraph;
   double m_K;
   double m_KSquared;
+  double m_Theta;
+
+  // Adaptive cooling (Hu, "Efficient and high quality force-directed graph drawing"):
+  // the temperature cools down when the energy goes up, and warms up again after
+  // kProgressIterations iterations in a row lowering it
   double m_Temp;
-  std::vector<ImVec2> m_Mvmts;
+  double m_MaxTemp;
+  double m_Energy;
+  int    m_Progress;
+  double m_Tolerance;
+  bool   m_Converged;
+  BasicSoAVectors<Scalar,Dim> m_Mvmt;
+  // Forces of the last iteration, see SetLocalRelaxation()
+  BasicSoAVectors<Scalar,Dim> m_Residual;
+  BarnesHutTree<Scalar,Index,Dim> m_Tree;
+  // The tree holds every vertex, near their current positions: built by the last Barnes-Hut
+  // iteration or edit, then kept up to date by the local relaxations and drags
+  bool m_TreeValid;
 
-  bool m_StartCircle;
+  InitMode m_InitMode;
   int m_CurrIter,m_MaxIter;
 
-  std::vector<NsPosition> m_Positions;
+  BasicSoAPositions<Scalar,Dim> m_Positions;
+
+  ThreadPool*  m_ThreadPool;
+  unsigned int m_ThreadCount;
+
+  IterationCost m_IterationCost;
+
+  LayoutStats m_Stats;
+  std::size_t m_StatsMemorySize;
+
+  // Vertices moved by a local relaxation, m_ActiveMark is all zeros in between
+  std::vector<Index>   m_Active;
+  std::vector<uint8_t> m_ActiveMark;
+  bool                 m_LocalRelaxation;
 
   void DoStep();
+  void UpdateTemperature(double aEnergy) noexcept;
+  void ResetConvergence() noexcept;
+  // Return the number of pairs (or Barnes-Hut terms) evaluated, and of vertices moved
+  std::uint64_t ComputeExactRepulsion(std::size_t aBegin,std::size_t aEnd);
+  std::uint64_t ComputeBarnesHutRepulsion(std::size_t aBegin,std::size_t aEnd);
+  std::uint64_t CapMovements(std::size_t aBegin,std::size_t aEnd,double aTemperature);
+  graph_t& EditGraph();
+  void ResizeBuffers();
+  void PlaceNear(Index aVertexId,Index aNeighborId);
+  double GetEditTheta() const noexcept;
+  bool FreezeAround(const std::vector<Index>& aSeeds);
+  void RelaxEdit();
+  void RelaxDropped(Index aVertexId);
+  void CollectActive(const std::vector<Index>& aSeeds,int aHops);
+  void CollectWithin(Index aVertexId,double aRadius);
+  void GrowActive(double aForce,double aTheta);
+  void ClearActive() noexcept;
+  void UpdateActiveTree(double aTheta);
+  std::uint64_t ComputeActiveForces(std::size_t aBegin,std::size_t aEnd,double aTheta);
+  void RelaxActive(double aTemperature,double aGrowForce,double aTheta);
+  void ForEachVertexRange(std::size_t aGrain,const std::function<void(std::size_t,std::size_t)>& aFunc);
   void SetInitPositions();
 };
 
+using FruchtermanReingold=BasicFruchtermanReingold<float,csr_id_t,2>;
 
 
 
-inline int FruchtermanReingold::GetCurrIter() const noexcept
+
+template<typename Scalar,typename Index,int Dim>
+inline int BasicFruchtermanReingold<Scalar,Index,Dim>::GetCurrIter() const noexcept
 {
   return m_CurrIter;
 }
 
-inline int FruchtermanReingold::GetMaxIters() const noexcept
+template<typename Scalar,typename Index,int Dim>
+inline int BasicFruchtermanReingold<Scalar,Index,Dim>::GetMaxIters() const noexcept
 {
   return m_MaxIter;
 }
 
-inline double FruchtermanReingold::GetK() const noexcept
+template<typename Scalar,typename Index,int Dim>
+inline double BasicFruchtermanReingold<Scalar,Index,Dim>::GetK() const noexcept
 {
   return m_K;
 }
 
-inline double FruchtermanReingold::GetEnergy() const noexcept
+template<typename Scalar,typename Index,int Dim>
+inline double BasicFruchtermanReingold<Scalar,Index,Dim>::GetTheta() const noexcept
+{
+  return m_Theta;
+}
+
+template<typename Scalar,typename Index,int Dim>
+inline void BasicFruchtermanReingold<Scalar,Index,Dim>::SetTheta(double aTheta) noexcept
+{
+  m_Theta=aTheta;
+}
+
+template<typename Scalar,typename Index,int Dim>
+inline unsigned int BasicFruchtermanReingold<Scalar,Index,Dim>::GetThreadCount() const noexcept
+{
+  return m_ThreadCount;
+}
+
+template<typename Scalar,typename Index,int Dim>
+inline void BasicFruchtermanReingold<Scalar,Index,Dim>::SetThreadCount(unsigned int aThreadCount) noexcept
+{
+  m_ThreadCount=aThreadCount;
+}
+
+template<typename Scalar,typename Index,int Dim>
+inline void BasicFruchtermanReingold<Scalar,Index,Dim>::SetThreadPool(ThreadPool& aThreadPool) noexcept
+{
+  m_ThreadPool=&aThreadPool;
+}
+
+template<typename Scalar,typename Index,int Dim>
+inline double BasicFruchtermanReingold<Scalar,Index,Dim>::GetEnergy() const noexcept
+{
+  return m_Energy;
+}
+
+template<typename Scalar,typename Index,int Dim>
+inline double BasicFruchtermanReingold<Scalar,Index,Dim>::GetTemperature() const noexcept
 {
   return m_Temp;
 }
 
+template<typename Scalar,typename Index,int Dim>
+inline bool BasicFruchtermanReingold<Scalar,Index,Dim>::IsConverged() const noexcept
+{
+  return m_Converged;
+}
+
+template<typename Scalar,typename Index,int Dim>
+inline double BasicFruchtermanReingold<Scalar,Index,Dim>::GetTolerance() const noexcept
+{
+  return m_Tolerance;
+}
+
+template<typename Scalar,typename Index,int Dim>
+inline void BasicFruchtermanReingold<Scalar,Index,Dim>::SetTolerance(double aTolerance) noexcept
+{
+  m_Tolerance=aTolerance;
+}
+
+template<typename Scalar,typename Index,int Dim>
+inline bool BasicFruchtermanReingold<Scalar,Index,Dim>::GetLocalRelaxation() const noexcept
+{
+  return m_LocalRelaxation;
+}
+
+template<typename Scalar,typename Index,int Dim>
+inline void BasicFruchtermanReingold<Scalar,Index,Dim>::SetLocalRelaxation(bool aLocal) noexcept
+{
+  m_LocalRelaxation=aLocal;
+}
+
+template<typename Scalar,typename Index,int Dim>
+inline const typename BasicFruchtermanReingold<Scalar,Index,Dim>::graph_t& BasicFruchtermanReingold<Scalar,Index,Dim>::GetGraph() const noexcept
+{
+  return *m_Graph;
+}
+
+template<typename Scalar,typename Index,int Dim>
+inline const LayoutStats& BasicFruchtermanReingold<Scalar,Index,Dim>::GetStats() const noexcept
+{
+  return m_Stats;
+}
+
+template<typename Scalar,typename Index,int Dim>
+inline void BasicFruchtermanReingold<Scalar,Index,Dim>::ResetStats() noexcept
+{
+  m_Stats=LayoutStats();
+}
+
 
 
 
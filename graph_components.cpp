@@ -0,0 +1,188 @@
+#include "graph_components.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+namespace nodesoup
+{
+
+
+static constexpr csr_id_t kNoComponent=std::numeric_limits<csr_id_t>::max();
+
+
+
+
+// Breadth first from every vertex not reached yet, aLabels[v] gets the component in order
+// of discovery. Returns the size of each component.
+static std::vector<std::size_t> label_components_(const CsrGraph& aGraph,std::vector<csr_id_t>& aLabels)
+{
+  const std::size_t vertex_count=aGraph.GetVertexCount();
+  aLabels.assign(vertex_count,kNoComponent);
+
+  std::vector<std::size_t> sizes;
+  std::vector<csr_id_t> queue;
+  queue.reserve(vertex_count);
+  for(std::size_t root=0; root<vertex_count; root++)
+    {
+      if(aLabels[root]!=kNoComponent)
+        {
+          continue;
+        }
+
+      const csr_id_t label=static_cast<csr_id_t>(sizes.size());
+      queue.clear();
+      queue.push_back(static_cast<csr_id_t>(root));
+      aLabels[root]=label;
+      for(std::size_t head=0; head<queue.size(); head++)
+        {
+          for(csr_id_t adj_id:aGraph.GetNeighbors(queue[head]))
+            {
+              if(aLabels[adj_id]==kNoComponent)
+                {
+                  aLabels[adj_id]=label;
+                  queue.push_back(adj_id);
+                }
+            }
+        }
+      sizes.push_back(queue.size());
+    }
+
+  return sizes;
+}
+
+
+
+
+void SplitComponents(const CsrGraph& aGraph,GraphComponents& aComponents)
+{
+  const std::size_t vertex_count=aGraph.GetVertexCount();
+
+  std::vector<csr_id_t> labels;
+  const std::vector<std::size_t> sizes=label_components_(aGraph,labels);
+
+  // Biggest first, so the longest layouts start first
+  std::vector<csr_id_t> order(sizes.size());
+  std::iota(order.begin(),order.end(),csr_id_t(0));
+  std::stable_sort(order.begin(),order.end(),[&sizes](csr_id_t aLhs,csr_id_t aRhs)
+  {
+    return sizes[aLhs]>sizes[aRhs];
+  });
+  std::vector<csr_id_t> ranks(sizes.size());
+  for(std::size_t c=0; c<order.size(); c++)
+    {
+      ranks[order[c]]=static_cast<csr_id_t>(c);
+    }
+
+  // Local ids keep the order of the vertices in the graph
+  aComponents.m_ComponentIds.resize(vertex_count);
+  aComponents.m_LocalIds.resize(vertex_count);
+  aComponents.m_Vertices.assign(sizes.size(),std::vector<csr_id_t>());
+  for(std::size_t c=0; c<order.size(); c++)
+    {
+      aComponents.m_Vertices[c].reserve(sizes[order[c]]);
+    }
+  for(std::size_t v_id=0; v_id<vertex_count; v_id++)
+    {
+      const csr_id_t component_id=ranks[labels[v_id]];
+      std::vector<csr_id_t>& vertices=aComponents.m_Vertices[component_id];
+      aComponents.m_ComponentIds[v_id]=component_id;
+      aComponents.m_LocalIds[v_id]=static_cast<csr_id_t>(vertices.size());
+      vertices.push_back(static_cast<csr_id_t>(v_id));
+    }
+
+  aComponents.m_Graphs.resize(sizes.size());
+  for(std::size_t c=0; c<sizes.size(); c++)
+    {
+      const std::vector<csr_id_t>& vertices=aComponents.m_Vertices[c];
+      std::vector<csr_id_t> offsets;
+      std::vector<csr_id_t> targets;
+      offsets.reserve(vertices.size()+1);
+      for(csr_id_t v_id:vertices)
+        {
+          offsets.push_back(static_cast<csr_id_t>(targets.size()));
+          for(csr_id_t adj_id:aGraph.GetNeighbors(v_id))
+            {
+              targets.push_back(aComponents.m_LocalIds[adj_id]);
+            }
+        }
+      offsets.push_back(static_cast<csr_id_t>(targets.size()));
+      aComponents.m_Graphs[c].Assign(std::move(offsets),std::move(targets));
+    }
+}
+
+
+
+
+void PackLayouts(const std::vector<std::vector<NsPosition>>& aLayouts,float aMargin,std::vector<NsVec2>& aOffsets)
+{
+  const std::size_t layout_count=aLayouts.size();
+  aOffsets.assign(layout_count,NsVec2());
+  if(!layout_count)
+    {
+      return;
+    }
+
+  // Bounding boxes grown by the margin
+  std::vector<NsVec2> mins(layout_count);
+  std::vector<NsVec2> sizes(layout_count);
+  double area=0.0;
+  float widest=0.0f;
+  for(std::size_t l=0; l<layout_count; l++)
+    {
+      NsVec2 min;
+      NsVec2 max;
+      if(!aLayouts[l].empty())
+        {
+          min=max=aLayouts[l][0].m_Pos;
+        }
+      for(const NsPosition& pos:aLayouts[l])
+        {
+          min.x=std::min(min.x,pos.m_Pos.x);
+          min.y=std::min(min.y,pos.m_Pos.y);
+          max.x=std::max(max.x,pos.m_Pos.x);
+          max.y=std::max(max.y,pos.m_Pos.y);
+        }
+      mins[l]=min;
+      sizes[l]=max-min+NsVec2(aMargin,aMargin);
+      area+=static_cast<double>(sizes[l].x)*sizes[l].y;
+      widest=std::max(widest,sizes[l].x);
+    }
+
+  // Highest first, next fit: a row is closed by the first box not fitting in it
+  std::vector<std::size_t> order(layout_count);
+  std::iota(order.begin(),order.end(),0);
+  std::stable_sort(order.begin(),order.end(),[&sizes](std::size_t aLhs,std::size_t aRhs)
+  {
+    return sizes[aLhs].y>sizes[aRhs].y;
+  });
+
+  const float row_length=std::max(widest,static_cast<float>(std::sqrt(area)));
+  NsVec2 cursor;
+  float row_height=0.0f;
+  float packing_width=0.0f;
+  for(std::size_t l:order)
+    {
+      if(cursor.x>0.0f && cursor.x+sizes[l].x>row_length)
+        {
+          cursor.x=0.0f;
+          cursor.y+=row_height;
+          row_height=0.0f;
+        }
+
+      aOffsets[l]=cursor-mins[l];
+      cursor.x+=sizes[l].x;
+      row_height=std::max(row_height,sizes[l].y);
+      packing_width=std::max(packing_width,cursor.x);
+    }
+
+  // Centered on the origin, as the layouts of the engines
+  const NsVec2 center=NsVec2(packing_width-aMargin,cursor.y+row_height-aMargin)/2.0f;
+  for(NsVec2& offset:aOffsets)
+    {
+      offset-=center;
+    }
+}
+
+
+}
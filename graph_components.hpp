@@ -0,0 +1,33 @@
+#pragma once
+#include "nodesoup.hpp"
+#include "csr_graph.hpp"
+#include <vector>
+
+namespace nodesoup
+{
+// Connected components: splitting a graph so each part is laid out on its own, and packing
+// the layouts of the parts back side by side.
+
+
+
+// Every connected component of a graph as a graph of its own. Vertex v of the graph is
+// vertex m_LocalIds[v] of m_Graphs[m_ComponentIds[v]], and m_Vertices[c] lists the vertices
+// of component c by local id.
+struct GraphComponents
+{
+  std::vector<CsrGraph>              m_Graphs;
+  std::vector<csr_id_t>              m_ComponentIds;
+  std::vector<csr_id_t>              m_LocalIds;
+  std::vector<std::vector<csr_id_t>> m_Vertices;
+};
+
+
+// Components biggest first (ties in order of their lowest vertex id), O(n+m)
+void SplitComponents(const CsrGraph& aGraph,GraphComponents& aComponents);
+
+// Offsets moving each layout to its place in a row by row (shelf) packing of their bounding
+// boxes, aMargin apart, in rows about as long as the packing is high. O(c log c) for c layouts.
+void PackLayouts(const std::vector<std::vector<NsPosition>>& aLayouts,float aMargin,std::vector<NsVec2>& aOffsets);
+
+
+}
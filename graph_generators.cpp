@@ -0,0 +1,286 @@
+#include "graph_generators.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace nodesoup
+{
+
+
+// The standard distributions differ between libraries, these do not.
+// The modulo bias is below n/2^64.
+static std::size_t random_index_(std::mt19937_64& aRandom,std::size_t aCount) noexcept
+{
+  return static_cast<std::size_t>(aRandom()%aCount);
+}
+
+static double random_unit_(std::mt19937_64& aRandom) noexcept
+{
+  return static_cast<double>(aRandom()>>11)*(1.0/9007199254740992.0);
+}
+
+
+
+
+static void add_edge_(std::vector<csr_id_t>& aSources,std::vector<csr_id_t>& aTargets,std::size_t aSource,std::size_t aTarget)
+{
+  aSources.push_back(static_cast<csr_id_t>(aSource));
+  aTargets.push_back(static_cast<csr_id_t>(aTarget));
+}
+
+
+
+
+// Tree edges of vertices aFirst..aFirst+aVertexCount-1
+static void add_tree_edges_(std::vector<csr_id_t>& aSources,std::vector<csr_id_t>& aTargets
+                           ,std::size_t aFirst,std::size_t aVertexCount,std::size_t aBranching)
+{
+  for(std::size_t v=1; v<aVertexCount; v++)
+    {
+      add_edge_(aSources,aTargets,aFirst+(v-1)/aBranching,aFirst+v);
+    }
+}
+
+
+
+
+CsrGraph MakeGridGraph(std::size_t aRows,std::size_t aColumns)
+{
+  std::vector<csr_id_t> sources;
+  std::vector<csr_id_t> targets;
+  sources.reserve(2*aRows*aColumns);
+  targets.reserve(2*aRows*aColumns);
+
+  for(std::size_t row=0; row<aRows; row++)
+    {
+      for(std::size_t column=0; column<aColumns; column++)
+        {
+          const std::size_t v_id=row*aColumns+column;
+          if(column+1<aColumns)
+            {
+              add_edge_(sources,targets,v_id,v_id+1);
+            }
+          if(row+1<aRows)
+            {
+              add_edge_(sources,targets,v_id,v_id+aColumns);
+            }
+        }
+    }
+
+  CsrGraph graph;
+  graph.AssignEdges(aRows*aColumns,std::move(sources),std::move(targets));
+  return graph;
+}
+
+
+
+
+CsrGraph MakeRandomGeometricGraph(std::size_t aVertexCount,double aMeanDegree,std::uint64_t aSeed)
+{
+  std::mt19937_64 random(aSeed);
+  std::vector<double> x(aVertexCount);
+  std::vector<double> y(aVertexCount);
+  for(std::size_t v_id=0; v_id<aVertexCount; v_id++)
+    {
+      x[v_id]=random_unit_(random);
+      y[v_id]=random_unit_(random);
+    }
+
+  // n*pi*r^2 neighbors on average, ignoring the border
+  const double radius=std::sqrt(aMeanDegree/(3.14159265358979323846*std::max<std::size_t>(aVertexCount,1)));
+  const std::size_t side=std::max<std::size_t>(1,std::min<std::size_t>(static_cast<std::size_t>(1.0/radius),4096));
+  auto cell_of=[side](double aCoord)
+  {
+    return std::min(static_cast<std::size_t>(aCoord*side),side-1);
+  };
+
+  // Counting sort of the vertices by cell, cells are no smaller than the radius
+  std::vector<std::size_t> cell_start(side*side+1,0);
+  std::vector<std::size_t> cells(aVertexCount);
+  for(std::size_t v_id=0; v_id<aVertexCount; v_id++)
+    {
+      cells[v_id]=cell_of(y[v_id])*side+cell_of(x[v_id]);
+      cell_start[cells[v_id]+1]++;
+    }
+  for(std::size_t cell=0; cell<side*side; cell++)
+    {
+      cell_start[cell+1]+=cell_start[cell];
+    }
+  std::vector<csr_id_t> cell_vertices(aVertexCount);
+  std::vector<std::size_t> fill(cell_start.begin(),cell_start.end()-1);
+  for(std::size_t v_id=0; v_id<aVertexCount; v_id++)
+    {
+      cell_vertices[fill[cells[v_id]]++]=static_cast<csr_id_t>(v_id);
+    }
+
+  std::vector<csr_id_t> sources;
+  std::vector<csr_id_t> targets;
+  const double sq_radius=radius*radius;
+
+  // Each pair once: within the cell, then with the right cell and the three cells below
+  constexpr int kNeighborCells[4][2]={{1,0},{-1,1},{0,1},{1,1}};
+  for(std::size_t row=0; row<side; row++)
+    {
+      for(std::size_t column=0; column<side; column++)
+        {
+          const std::size_t cell=row*side+column;
+          for(std::size_t i=cell_start[cell]; i<cell_start[cell+1]; i++)
+            {
+              const csr_id_t v_id=cell_vertices[i];
+              auto link_range=[&](std::size_t aBegin,std::size_t aEnd)
+              {
+                for(std::size_t j=aBegin; j<aEnd; j++)
+                  {
+                    const csr_id_t other_id=cell_vertices[j];
+                    const double dx=x[v_id]-x[other_id];
+                    const double dy=y[v_id]-y[other_id];
+                    if(dx*dx+dy*dy<sq_radius)
+                      {
+                        add_edge_(sources,targets,v_id,other_id);
+                      }
+                  }
+              };
+
+              link_range(i+1,cell_start[cell+1]);
+              for(const auto& offset:kNeighborCells)
+                {
+                  const std::size_t other_column=column+offset[0];
+                  const std::size_t other_row=row+offset[1];
+                  if(other_column<side && other_row<side)
+                    {
+                      const std::size_t other_cell=other_row*side+other_column;
+                      link_range(cell_start[other_cell],cell_start[other_cell+1]);
+                    }
+                }
+            }
+        }
+    }
+
+  CsrGraph graph;
+  graph.AssignEdges(aVertexCount,std::move(sources),std::move(targets));
+  return graph;
+}
+
+
+
+
+CsrGraph MakeErdosRenyiGraph(std::size_t aVertexCount,double aMeanDegree,std::uint64_t aSeed)
+{
+  std::vector<csr_id_t> sources;
+  std::vector<csr_id_t> targets;
+
+  if(aVertexCount>1)
+    {
+      std::mt19937_64 random(aSeed);
+      const std::size_t max_edges=aVertexCount*(aVertexCount-1)/2;
+      const std::size_t edge_count=std::min(static_cast<std::size_t>(aVertexCount*aMeanDegree/2.0),max_edges);
+      sources.reserve(edge_count);
+      targets.reserve(edge_count);
+      while(sources.size()<edge_count)
+        {
+          const std::size_t v_id=random_index_(random,aVertexCount);
+          const std::size_t other_id=random_index_(random,aVertexCount);
+          if(v_id!=other_id)
+            {
+              add_edge_(sources,targets,v_id,other_id);
+            }
+        }
+    }
+
+  CsrGraph graph;
+  graph.AssignEdges(aVertexCount,std::move(sources),std::move(targets));
+  return graph;
+}
+
+
+
+
+CsrGraph MakeBarabasiAlbertGraph(std::size_t aVertexCount,std::size_t aEdgesPerVertex,std::uint64_t aSeed)
+{
+  assert(aEdgesPerVertex>0);
+
+  std::vector<csr_id_t> sources;
+  std::vector<csr_id_t> targets;
+
+  // Starts from a clique of aEdgesPerVertex+1 vertices
+  const std::size_t seed_count=std::min(aVertexCount,aEdgesPerVertex+1);
+  for(std::size_t v_id=0; v_id<seed_count; v_id++)
+    {
+      for(std::size_t other_id=0; other_id<v_id; other_id++)
+        {
+          add_edge_(sources,targets,other_id,v_id);
+        }
+    }
+
+  // Every edge end so far: picking one uniformly picks a vertex with probability
+  // proportional to its degree
+  std::vector<csr_id_t> ends;
+  ends.reserve(2*aVertexCount*aEdgesPerVertex);
+  ends.insert(ends.end(),sources.begin(),sources.end());
+  ends.insert(ends.end(),targets.begin(),targets.end());
+
+  std::mt19937_64 random(aSeed);
+  std::vector<csr_id_t> picked;
+  for(std::size_t v_id=seed_count; v_id<aVertexCount; v_id++)
+    {
+      picked.clear();
+      while(picked.size()<aEdgesPerVertex)
+        {
+          const csr_id_t other_id=ends[random_index_(random,ends.size())];
+          if(std::find(picked.begin(),picked.end(),other_id)==picked.end())
+            {
+              picked.push_back(other_id);
+            }
+        }
+
+      for(csr_id_t other_id:picked)
+        {
+          add_edge_(sources,targets,other_id,v_id);
+          ends.push_back(other_id);
+          ends.push_back(static_cast<csr_id_t>(v_id));
+        }
+    }
+
+  CsrGraph graph;
+  graph.AssignEdges(aVertexCount,std::move(sources),std::move(targets));
+  return graph;
+}
+
+
+
+
+CsrGraph MakeTreeGraph(std::size_t aVertexCount,std::size_t aBranching)
+{
+  return MakeForestGraph(aVertexCount,1,aBranching);
+}
+
+
+
+
+CsrGraph MakeForestGraph(std::size_t aVertexCount,std::size_t aTreeCount,std::size_t aBranching)
+{
+  assert(aBranching>0);
+
+  std::vector<csr_id_t> sources;
+  std::vector<csr_id_t> targets;
+  sources.reserve(aVertexCount);
+  targets.reserve(aVertexCount);
+
+  const std::size_t tree_count=std::max<std::size_t>(1,std::min(aTreeCount,aVertexCount));
+  std::size_t first=0;
+  for(std::size_t tree=0; tree<tree_count; tree++)
+    {
+      const std::size_t last=(tree+1)*aVertexCount/tree_count;
+      add_tree_edges_(sources,targets,first,last-first,aBranching);
+      first=last;
+    }
+
+  CsrGraph graph;
+  graph.AssignEdges(aVertexCount,std::move(sources),std::move(targets));
+  return graph;
+}
+
+
+}
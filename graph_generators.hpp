@@ -0,0 +1,34 @@
+#pragma once
+#include "nodesoup.hpp"
+#include "csr_graph.hpp"
+#include <cstdint>
+
+namespace nodesoup
+{
+// Synthetic graphs for benchmarks and tests. The random ones are reproducible: same
+// arguments and seed, same graph on every platform.
+
+
+
+// aRows x aColumns lattice, each vertex linked to its 4 neighbors
+CsrGraph MakeGridGraph(std::size_t aRows,std::size_t aColumns);
+
+// Random geometric graph: vertices uniform in the unit square, linked when closer than
+// the radius giving about aMeanDegree neighbors per vertex. O(n) with a cell grid.
+CsrGraph MakeRandomGeometricGraph(std::size_t aVertexCount,double aMeanDegree,std::uint64_t aSeed);
+
+// Erdos-Renyi G(n,m) with m=n*aMeanDegree/2 uniform pairs, repeated pairs merged
+CsrGraph MakeErdosRenyiGraph(std::size_t aVertexCount,double aMeanDegree,std::uint64_t aSeed);
+
+// Barabasi-Albert preferential attachment: every new vertex links to aEdgesPerVertex
+// distinct vertices picked with probability proportional to their degree
+CsrGraph MakeBarabasiAlbertGraph(std::size_t aVertexCount,std::size_t aEdgesPerVertex,std::uint64_t aSeed);
+
+// Complete aBranching-ary tree, vertex v>0 hangs from (v-1)/aBranching
+CsrGraph MakeTreeGraph(std::size_t aVertexCount,std::size_t aBranching);
+
+// aTreeCount disjoint trees of the same size (to one vertex), aVertexCount vertices in total
+CsrGraph MakeForestGraph(std::size_t aVertexCount,std::size_t aTreeCount,std::size_t aBranching);
+
+
+}
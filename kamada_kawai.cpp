@@ -5,121 +5,237 @@
 
 
 #include "kamada_kawai.hpp"
+#include "shortest_paths.hpp"
+#include "thread_pool.hpp"
 
 namespace nodesoup
 {
 
 
+// Positions are Scalar, the spring terms are computed in double
+template<typename Scalar,int Dim>
+static NsVec<double,Dim> to_double_(const NsVec<Scalar,Dim>& aVec) noexcept
+{
+  NsVec<double,Dim> res;
+  for(int axis=0; axis<Dim; axis++)
+    {
+      res[axis]=aVec[axis];
+    }
+  return res;
+}
+
+
+
+template<typename Scalar,typename Index,int Dim>
+BasicKamadaKawai<Scalar,Index,Dim>::BasicKamadaKawai(const adj_list_t& aAdjList,double aK,double aEnergyThreshold)
+    : m_AdjList(&aAdjList)
+    , m_Graph(&m_OwnGraph)
+    , m_ThreadPool(&DefaultThreadPool())
+    , m_EnergyThreshold(aEnergyThreshold)
+    , m_K(aK)
+    , m_SteadyEnergyCount(0)
+    , m_MaxVertexEnergy(0.0)
+    , m_VertexId(0)
+    , m_SpringLength(0.0)
+    , m_UpdatesSinceSync(0)
+    , m_StatsMemorySize(0)
+    , m_Scale(1.0)
+{
+
+}
+
+
+template<typename Scalar,typename Index,int Dim>
+BasicKamadaKawai<Scalar,Index,Dim>::BasicKamadaKawai(const graph_t& aGraph,double aK,double aEnergyThreshold)
+    : m_AdjList(nullptr)
+    , m_Graph(&aGraph)
+    , m_ThreadPool(&DefaultThreadPool())
+    , m_EnergyThreshold(aEnergyThreshold)
+    , m_K(aK)
+    , m_SteadyEnergyCount(0)
+    , m_MaxVertexEnergy(0.0)
+    , m_VertexId(0)
+    , m_SpringLength(0.0)
+    , m_UpdatesSinceSync(0)
+    , m_StatsMemorySize(0)
+    , m_Scale(1.0)
+{
+
+}
 
-static std::vector<std::vector<vertex_id_t>> floyd_warshall_(const adj_list_t& aAdjList)
+
+template<typename Scalar,typename Index,int Dim>
+void BasicKamadaKawai<Scalar,Index,Dim>::Start(bool aStartCircle)
 {
-  // build adjacency matrix (infinity = no edge, 1 = edge)
-  constexpr unsigned int infinity = std::numeric_limits<unsigned int>::max() / 2;
-  std::vector<std::vector<vertex_id_t>> distances(aAdjList.size(), std::vector<vertex_id_t>(aAdjList.size(), infinity));
+  Start(aStartCircle ? InitMode::kCircle : InitMode::kRandom);
+}
+
 
-  for(vertex_id_t v_id=0; v_id<aAdjList.size(); v_id++)
+template<typename Scalar,typename Index,int Dim>
+void BasicKamadaKawai<Scalar,Index,Dim>::Start(InitMode aInitMode)
+{
+  if(m_AdjList)
     {
-      distances[v_id][v_id]=0;
-      for(vertex_id_t adj_id : aAdjList[v_id])
-        {
-          if(adj_id>v_id)
-            {
-              distances[v_id][adj_id]=1;
-              distances[adj_id][v_id]=1;
-            }
-        }
+      m_OwnGraph.Assign(*m_AdjList);
     }
 
-  // floyd warshall itself, find length of shortest path for each pair of vertices
-  for(vertex_id_t k=0; k<aAdjList.size(); k++)
+  SetInitPositions(aInitMode);
+
+  ComputeDistances();
+  InitSprings();
+  InitEnergies();
+  NODESOUP_STATS_ONLY(m_Stats.CountGrowth(GetMemorySize(),m_StatsMemorySize);)
+}
+
+
+
+
+// Warm start from a layout given in any scale (a previous CenterAndScale() output):
+// it is scaled to fit the springs best
+template<typename Scalar,typename Index,int Dim>
+void BasicKamadaKawai<Scalar,Index,Dim>::Start(const std::vector<position_t>& aPositions)
+{
+  if(m_AdjList)
     {
-      for(vertex_id_t i=0; i<aAdjList.size(); i++)
-        {
-          for(vertex_id_t j=0; j<aAdjList.size(); j++)
-            {
-              distances[i][j]=std::min(distances[i][j],distances[i][k]+distances[k][j]);
-            }
-        }
+      m_OwnGraph.Assign(*m_AdjList);
     }
 
-  return distances;
+  assert(aPositions.size()==m_Graph->GetVertexCount());
+  m_Positions=aPositions;
+
+  ComputeDistances();
+  InitSprings();
+  FitToSprings();
+  InitEnergies();
+  NODESOUP_STATS_ONLY(m_Stats.CountGrowth(GetMemorySize(),m_StatsMemorySize);)
 }
 
 
 
 
+template<typename Scalar,typename Index,int Dim>
+void BasicKamadaKawai<Scalar,Index,Dim>::ComputeDistances()
+{
+  NODESOUP_SCOPED_TIMER(m_Stats.m_Phases[LayoutStats::kDistances]);
+  m_Distances=AllPairsHopDistances(*m_Graph,*m_ThreadPool);
+}
 
 
 
-KamadaKawai::KamadaKawai(const adj_list_t& aAdjList,double aK,double aEnergyThreshold)
-    : m_AdjList(aAdjList)
-    , m_EnergyThreshold(aEnergyThreshold)
-    , m_K(aK)
-    , m_SteadyEnergyCount(0)
-    , m_MaxVertexEnergy(0.0)
-    , m_VertexId(0)
-    , m_Scale(1.0)
+
+template<typename Scalar,typename Index,int Dim>
+std::size_t BasicKamadaKawai<Scalar,Index,Dim>::GetMemorySize() const noexcept
 {
+  return m_Positions.capacity()*sizeof(position_t)+m_Gradients.capacity()*sizeof(gradient_t)
+        +m_SpringTable.capacity()*sizeof(Spring)+m_Distances.GetMemorySize()
+        +m_Energies.GetMemorySize()+m_OwnGraph.GetMemorySize();
+}
+
 
+
+
+template<typename Scalar,typename Index,int Dim>
+void BasicKamadaKawai<Scalar,Index,Dim>::InitEnergies()
+{
+  ComputeGradients();
+  RestartMoves();
 }
 
 
-void KamadaKawai::Start(bool aStartCircle)
+
+
+// Moves go on from the vertex with most energy after a change not made by a move
+template<typename Scalar,typename Index,int Dim>
+void BasicKamadaKawai<Scalar,Index,Dim>::RestartMoves()
 {
-  SetInitPositions(aStartCircle);
+  m_SteadyEnergyCount = 0;
+  auto res = FindMaxVertexEnergy();
+  m_MaxVertexEnergy=std::get<double>(res);
+  m_VertexId=std::get<Index>(res);
+}
+
 
-  std::vector<std::vector<vertex_id_t>> distances=floyd_warshall_(m_AdjList);
 
-  // find biggest distance
-  size_t biggest_distance = 0;
-  for(vertex_id_t v_id=0; v_id<m_AdjList.size(); v_id++)
+
+// Scale s minimizing the energy of s*positions: sum(k*l*|d|)/sum(k*|d|^2) over all springs
+template<typename Scalar,typename Index,int Dim>
+void BasicKamadaKawai<Scalar,Index,Dim>::FitToSprings()
+{
+  double length_sum=0.0;
+  double distance_sum=0.0;
+  for(Index v_id=0; v_id<m_Positions.size(); v_id++)
     {
-      for(vertex_id_t other_id=0; other_id<m_AdjList.size(); other_id++)
-        {
-          if(distances[v_id][other_id] > biggest_distance)
-            {
-              biggest_distance = distances[v_id][other_id];
-            }
-        }
+      const vec_t pos=m_Positions[v_id].m_Pos;
+      ForEachSpring(v_id,[&](Index aOtherId,const Spring& aSpring)
+      {
+        const double distance=norm(pos-m_Positions[aOtherId].m_Pos);
+        length_sum+=aSpring.m_Strength*aSpring.m_Length*distance;
+        distance_sum+=aSpring.m_Strength*distance*distance;
+      });
+    }
+
+  if(distance_sum<=0.0)
+    {
+      return;
     }
 
+  const Scalar scale=static_cast<Scalar>(length_sum/distance_sum);
+  for(position_t& pos:m_Positions)
+    {
+      pos.m_Pos*=scale;
+    }
+}
+
+
+
+
+
+
+template<typename Scalar,typename Index,int Dim>
+void BasicKamadaKawai<Scalar,Index,Dim>::InitSprings()
+{
+  // biggest finite distance: with kUnreachable the edges of a forest would be 1/65535 long
+  // and every energy trivially below the threshold, so nothing would move
+  std::size_t biggest_distance=std::max<std::size_t>(m_Distances.GetMaxDistance(),1);
+
   // Ideal length for all edges. we don't really care, the layout is going to be scaled.
   // Let's chose 1.0 as the initial positions will be on a 1.0 radius circle, so we're
   // on the same order of magnitude
   double length=1.0/biggest_distance;
+  m_SpringLength=length;
 
-  // init springs lengths and strengths matrices
-  m_Springs.clear();
-  m_Springs.reserve(m_AdjList.size());
-  for(vertex_id_t v_id=0; v_id<m_AdjList.size(); v_id++)
-    {
-      std::vector<Spring> v_springs;
-      v_springs.reserve(m_AdjList.size());
+  m_SpringTable.clear();
+  ExtendSprings(m_Distances.GetMaxDistance());
 
-      for(vertex_id_t other_id=0; other_id<m_AdjList.size(); other_id++)
-        {
-          Spring spring;
-          if(v_id == other_id)
-            {
-              spring.m_Length = 0.0;
-              spring.m_Strength = 0.0;
-            }
-          else
-            {
-              size_t distance=distances[v_id][other_id];
-              spring.m_Length=distance*length;
-              spring.m_Strength=m_K/(distance*distance);
-            }
+  // Components are held one hop further apart than the longest path, as in Pivot MDS.
+  // Edits keep this spring even when paths get longer.
+  const double unreachable_distance=biggest_distance+1.0;
+  m_UnreachableSpring.m_Length=unreachable_distance*length;
+  m_UnreachableSpring.m_Strength=m_K/(unreachable_distance*unreachable_distance);
+}
 
-          v_springs.push_back(spring);
-        }
-      m_Springs.push_back(v_springs);
+
+
+
+// Springs up to aHops hops. Edits keep the length of one hop: longer paths get new springs,
+// the others are left as they are.
+template<typename Scalar,typename Index,int Dim>
+void BasicKamadaKawai<Scalar,Index,Dim>::ExtendSprings(hop_t aHops)
+{
+  std::size_t distance=m_SpringTable.size();
+  m_SpringTable.resize(std::max<std::size_t>(distance,aHops+1));
+  if(!distance)
+    {
+      m_SpringTable[0].m_Length=0.0;
+      m_SpringTable[0].m_Strength=0.0;
+      distance=1;
     }
 
-  m_SteadyEnergyCount = 0;
-  auto res = FindMaxVertexEnergy();
-  m_MaxVertexEnergy=std::get<double>(res);
-  m_VertexId=std::get<vertex_id_t>(res);
+  for(; distance<m_SpringTable.size(); distance++)
+    {
+      m_SpringTable[distance].m_Length=distance*m_SpringLength;
+      m_SpringTable[distance].m_Strength=m_K/(distance*distance);
+    }
 }
 
 
@@ -133,67 +249,137 @@ void KamadaKawai::Start(bool aStartCircle)
 
 // Reduce the energy of the next vertex with most energy until all the vertices have
 // a energy below energy_threshold
-void KamadaKawai::Step(float aWidth,float aHeight,std::vector<NsPosition>& aPositions)
+template<typename Scalar,typename Index,int Dim>
+void BasicKamadaKawai<Scalar,Index,Dim>::Step(Scalar aWidth,Scalar aHeight,std::vector<position_t>& aPositions)
 {
-  if(m_MaxVertexEnergy>m_EnergyThreshold  && m_SteadyEnergyCount<MAX_STEADY_ENERGY_ITERS_COUNT)
+  if(!IsConverged())
     {
-      // move vertex step by step until its energy goes below threshold
-      // (apparently this is equivalent to the newton raphson method)
-      unsigned int vertex_count = 0;
-      do
-        {
-          m_Positions[m_VertexId].m_Pos=ComputeNextVertexPosition(m_VertexId);
-          vertex_count++;
-        }
-      while (ComputeVertexEnergy(m_VertexId)>m_EnergyThreshold  &&  vertex_count<MAX_VERTEX_ITERS_COUNT);
+      MoveMaxEnergyVertex();
+    }
 
-      double max_vertex_energy_prev=m_MaxVertexEnergy;
-      auto res = FindMaxVertexEnergy();
-      m_MaxVertexEnergy=std::get<double>(res);
-      m_VertexId=std::get<vertex_id_t>(res);
+  CenterAndScale(aWidth,aHeight,aPositions);
+}
 
-      if(std::abs(m_MaxVertexEnergy-max_vertex_energy_prev) < 1e-20)
-        {
-          m_SteadyEnergyCount++;
-        }
-      else
-        {
-          m_SteadyEnergyCount=0;
-        }
+
+
+
+template<typename Scalar,typename Index,int Dim>
+StepProgress BasicKamadaKawai<Scalar,Index,Dim>::StepFor(std::chrono::microseconds aBudget,Scalar aWidth,Scalar aHeight,std::vector<position_t>& aPositions)
+{
+  using clock=std::chrono::steady_clock;
+
+  StepProgress progress;
+  const clock::time_point start=clock::now();
+  clock::time_point now=start;
+  while(!IsConverged() && (!progress.m_Iterations || now-start+m_MoveCost.Get()<=aBudget))
+    {
+      MoveMaxEnergyVertex();
+      progress.m_Iterations++;
+
+      const clock::time_point move_end=clock::now();
+      m_MoveCost.Add(move_end-now);
+      now=move_end;
     }
 
   CenterAndScale(aWidth,aHeight,aPositions);
+
+  progress.m_Elapsed=std::chrono::duration_cast<std::chrono::microseconds>(now-start);
+  progress.m_Converged=IsConverged();
+  return progress;
 }
 
 
 
 
+template<typename Scalar,typename Index,int Dim>
+void BasicKamadaKawai<Scalar,Index,Dim>::Iterate(int aMoves)
+{
+  for(int k=0; k<aMoves && !IsConverged(); k++)
+    {
+      MoveMaxEnergyVertex();
+    }
+}
 
-// Find @p max_energy_v_id with the most potential energy and @return its energy
-// https://gist.github.com/terakun/b7eff90c889c1485898ec9256ca9f91d
-std::tuple<double,vertex_id_t> KamadaKawai::FindMaxVertexEnergy() const noexcept
+
+
+
+template<typename Scalar,typename Index,int Dim>
+void BasicKamadaKawai<Scalar,Index,Dim>::GetPositions(std::vector<position_t>& aPositions) const
 {
-  double max_energy=-1.0;
-  vertex_id_t max_energy_v_id=0;
+  aPositions=m_Positions;
+}
+
 
-  for(vertex_id_t v_id=0; v_id<m_AdjList.size(); v_id++)
+
+
+template<typename Scalar,typename Index,int Dim>
+bool BasicKamadaKawai<Scalar,Index,Dim>::IsConverged() const noexcept
+{
+  return !(m_MaxVertexEnergy>m_EnergyThreshold && m_SteadyEnergyCount<MAX_STEADY_ENERGY_ITERS_COUNT);
+}
+
+
+
+
+template<typename Scalar,typename Index,int Dim>
+void BasicKamadaKawai<Scalar,Index,Dim>::MoveMaxEnergyVertex()
+{
+  {
+    NODESOUP_SCOPED_TIMER(m_Stats.m_Phases[LayoutStats::kMoves]);
+
+    // move vertex step by step until its energy goes below threshold
+    // (apparently this is equivalent to the newton raphson method)
+    const vec_t prev_pos=m_Positions[m_VertexId].m_Pos;
+    unsigned int vertex_count = 0;
+    do
+      {
+        m_Positions[m_VertexId].m_Pos=ComputeNextVertexPosition(m_VertexId);
+        vertex_count++;
+      }
+    while (ComputeVertexEnergy(m_VertexId)>m_EnergyThreshold  &&  vertex_count<MAX_VERTEX_ITERS_COUNT);
+
+    // Each Newton step and energy check visits every other vertex
+    NODESOUP_COUNT(m_Stats.m_PairEvaluations,2*vertex_count*(m_Positions.size()-1));
+    NODESOUP_COUNT(m_Stats.m_VerticesMoved,1);
+
+    UpdateGradients(m_VertexId,prev_pos);
+  }
+
+  double max_vertex_energy_prev=m_MaxVertexEnergy;
+  NODESOUP_STATS_ONLY(LapTimer find_timer;)
+  auto res = FindMaxVertexEnergy();
+  NODESOUP_STATS_ONLY(m_Stats.m_Phases[LayoutStats::kFindMaxEnergy].Add(find_timer.Lap());)
+  m_MaxVertexEnergy=std::get<double>(res);
+  m_VertexId=std::get<Index>(res);
+
+  if(std::abs(m_MaxVertexEnergy-max_vertex_energy_prev) < 1e-20)
     {
-      double energy=ComputeVertexEnergy(v_id);
-      if(energy>max_energy)
-        {
-          max_energy_v_id=v_id;
-          max_energy=energy;
-        }
+      m_SteadyEnergyCount++;
+    }
+  else
+    {
+      m_SteadyEnergyCount=0;
     }
+}
+
+
+
 
-  return {max_energy,max_energy_v_id};
+
+// Find @p max_energy_v_id with the most potential energy and @return its energy
+// https://gist.github.com/terakun/b7eff90c889c1485898ec9256ca9f91d
+template<typename Scalar,typename Index,int Dim>
+std::tuple<double,Index> BasicKamadaKawai<Scalar,Index,Dim>::FindMaxVertexEnergy() const noexcept
+{
+  return {m_Energies.GetMax(),static_cast<Index>(m_Energies.GetMaxIndex())};
 }
 
 
 
 
 // @return the potential energies of springs between @p v_id and all other vertices
-double KamadaKawai::ComputeVertexEnergy(vertex_id_t aVertexId) const noexcept
+template<typename Scalar,typename Index,int Dim>
+double BasicKamadaKawai<Scalar,Index,Dim>::ComputeVertexEnergy(Index aVertexId) const noexcept
 {
   assert(aVertexId<m_Positions.size());
 
@@ -202,37 +388,132 @@ double KamadaKawai::ComputeVertexEnergy(vertex_id_t aVertexId) const noexcept
       return 0.0f;
     }
 
-  double x_energy=0.0;
-  double y_energy=0.0;
+  return norm(ComputeVertexGradient(aVertexId));
+}
+
+
+
 
-  for(vertex_id_t other_id=0; other_id<m_AdjList.size(); other_id++)
+template<typename Scalar,typename Index,int Dim>
+typename BasicKamadaKawai<Scalar,Index,Dim>::gradient_t BasicKamadaKawai<Scalar,Index,Dim>::ComputeVertexGradient(Index aVertexId) const noexcept
+{
+  gradient_t gradient;
+
+  const vec_t pos=m_Positions[aVertexId].m_Pos;
+  ForEachSpring(aVertexId,[this,&pos,&gradient](Index aOtherId,const Spring& aSpring)
+  {
+    const gradient_t delta=to_double_(pos-m_Positions[aOtherId].m_Pos);
+    double distance=norm(delta);
+
+    // delta * k * (1 - l / distance)
+    const double factor=aSpring.m_Strength*(1.0-aSpring.m_Length/distance);
+    for(int axis=0; axis<Dim; axis++)
+      {
+        gradient[axis]+=delta[axis]*factor;
+      }
+  });
+
+  return gradient;
+}
+
+
+
+
+// Energy from the stored gradient
+template<typename Scalar,typename Index,int Dim>
+double BasicKamadaKawai<Scalar,Index,Dim>::GetVertexEnergy(Index aVertexId) const noexcept
+{
+  if(m_Positions[aVertexId].m_Fixed)
     {
-      if(aVertexId==other_id)
-        {
-          continue;
-        }
+      return 0.0;
+    }
 
-      ImVec2 delta=m_Positions[aVertexId].m_Pos-m_Positions[other_id].m_Pos;
-      double distance=norm(delta);
+  return norm(m_Gradients[aVertexId]);
+}
+
+
+
+
+// Computes every gradient from scratch, O(n^2)
+template<typename Scalar,typename Index,int Dim>
+void BasicKamadaKawai<Scalar,Index,Dim>::ComputeGradients()
+{
+  m_Gradients.resize(m_Positions.size());
+  m_Energies.Resize(m_Positions.size());
 
-      // delta * k * (1 - l / distance)
-      Spring spring=m_Springs[aVertexId][other_id];
-      x_energy += delta.x*spring.m_Strength * (1.0-spring.m_Length/distance);
-      y_energy += delta.y*spring.m_Strength * (1.0-spring.m_Length/distance);
+  for(Index v_id=0; v_id<m_Positions.size(); v_id++)
+    {
+      m_Gradients[v_id]=ComputeVertexGradient(v_id);
+      m_Energies.Set(v_id,GetVertexEnergy(v_id));
     }
+  m_Energies.Rebuild();
+  NODESOUP_COUNT(m_Stats.m_PairEvaluations,m_Positions.size()*m_Positions.size());
 
-  return sqrt(x_energy*x_energy+y_energy*y_energy);
+  m_UpdatesSinceSync=0;
 }
 
 
 
 
+// Only the terms involving @p aMovedId change when it moves: O(n) instead of O(n^2)
+template<typename Scalar,typename Index,int Dim>
+void BasicKamadaKawai<Scalar,Index,Dim>::UpdateGradients(Index aMovedId,const vec_t& aPrevPos)
+{
+  // Incremental updates accumulate rounding errors, resync from time to time
+  if(++m_UpdatesSinceSync>=m_Positions.size())
+    {
+      ComputeGradients();
+      return;
+    }
+
+  const vec_t new_pos=m_Positions[aMovedId].m_Pos;
+  bool moved=false;
+  for(int axis=0; axis<Dim; axis++)
+    {
+      moved=moved || new_pos[axis]!=aPrevPos[axis];
+    }
+
+  if(moved)
+    {
+      ForEachSpring(aMovedId,[this,&aPrevPos,&new_pos](Index aOtherId,const Spring& aSpring)
+      {
+        const vec_t pos=m_Positions[aOtherId].m_Pos;
+        gradient_t& gradient=m_Gradients[aOtherId];
+
+        const gradient_t prev_delta=to_double_(pos-aPrevPos);
+        double prev_distance=norm(prev_delta);
+        const double prev_factor=aSpring.m_Strength*(1.0-aSpring.m_Length/prev_distance);
+
+        const gradient_t delta=to_double_(pos-new_pos);
+        double distance=norm(delta);
+        const double factor=aSpring.m_Strength*(1.0-aSpring.m_Length/distance);
+
+        for(int axis=0; axis<Dim; axis++)
+          {
+            gradient[axis]-=prev_delta[axis]*prev_factor;
+            gradient[axis]+=delta[axis]*factor;
+          }
+
+        m_Energies.Set(aOtherId,GetVertexEnergy(aOtherId));
+      });
+
+      m_Gradients[aMovedId]=ComputeVertexGradient(aMovedId);
+      NODESOUP_COUNT(m_Stats.m_PairEvaluations,2*(m_Positions.size()-1));
+    }
+
+  m_Energies.Set(aMovedId,GetVertexEnergy(aMovedId));
+  m_Energies.Rebuild();
+}
+
+
+
 
 // @returns next position for @param v_id reducing its potential energy, ie the energy in the whole graph
 // caused by its position.
 // The position's delta depends on K (TODO bigger K = faster?).
 // This is the complicated part of the algorithm.
-ImVec2 KamadaKawai::ComputeNextVertexPosition(vertex_id_t aVertexId) const noexcept
+template<typename Scalar,typename Index,int Dim>
+typename BasicKamadaKawai<Scalar,Index,Dim>::vec_t BasicKamadaKawai<Scalar,Index,Dim>::ComputeNextVertexPosition(Index aVertexId) const noexcept
 {
   assert(aVertexId<m_Positions.size());
 
@@ -241,34 +522,102 @@ ImVec2 KamadaKawai::ComputeNextVertexPosition(vertex_id_t aVertexId) const noexc
       return m_Positions[aVertexId].m_Pos;
     }
 
-  double xx_energy=0.0, xy_energy=0.0, yx_energy=0.0, yy_energy=0.0;
-  double x_energy=0.0, y_energy=0.0;
-
-  for(vertex_id_t other_id = 0; other_id < m_AdjList.size(); other_id++)
+  // Gradient g and Hessian h of the vertex energy:
+  // h_aa = k * (1 - l * sum(d_b^2, b!=a) / |d|^3), h_ab = k * l * d_a * d_b / |d|^3
+  gradient_t gradient;
+  double hessian[Dim][Dim]={};
+
+  const vec_t pos=m_Positions[aVertexId].m_Pos;
+  ForEachSpring(aVertexId,[&](Index aOtherId,const Spring& aSpring)
+  {
+    const gradient_t delta=to_double_(pos-m_Positions[aOtherId].m_Pos);
+    double sq_distance=sq_norm(delta);
+    double distance=std::sqrt(sq_distance);
+    double cubed_distance=sq_distance*distance;
+
+    const double factor=aSpring.m_Strength*(1.0-aSpring.m_Length/distance);
+    const double curvature=aSpring.m_Strength*aSpring.m_Length/cubed_distance;
+    for(int a=0; a<Dim; a++)
+      {
+        gradient[a]+=delta[a]*factor;
+        double other_sq_distance=0.0;
+        for(int b=0; b<Dim; b++)
+          {
+            other_sq_distance+=(b!=a ? delta[b]*delta[b] : 0);
+          }
+        hessian[a][a]+=aSpring.m_Strength-curvature*other_sq_distance;
+        for(int b=a+1; b<Dim; b++)
+          {
+            hessian[a][b]+=curvature*delta[a]*delta[b];
+          }
+      }
+  });
+
+  // Away from a minimum (a folded subtree, springs to other components) h is not positive
+  // definite and the step goes to a saddle, then back and forth around it. Shifting the
+  // diagonal past the Gershgorin bound makes it a descent step again.
+  double minor=1.0;
+  bool positive_definite=true;
+  for(int a=0; a<Dim && positive_definite; a++)
     {
-      if(aVertexId==other_id)
+      for(int b=0; b<a; b++)
         {
-          continue;
+          hessian[a][b]=hessian[b][a];
+        }
+      if constexpr(Dim==2)
+        {
+          minor=(a==0 ? hessian[0][0] : hessian[0][0]*hessian[1][1]-hessian[0][1]*hessian[0][1]);
+        }
+      else
+        {
+          minor=(a==0 ? hessian[0][0] : (a==1 ? hessian[0][0]*hessian[1][1]-hessian[0][1]*hessian[0][1]
+                                              : hessian[0][0]*(hessian[1][1]*hessian[2][2]-hessian[1][2]*hessian[1][2])
+                                               -hessian[0][1]*(hessian[0][1]*hessian[2][2]-hessian[1][2]*hessian[0][2])
+                                               +hessian[0][2]*(hessian[0][1]*hessian[1][2]-hessian[1][1]*hessian[0][2])));
+        }
+      positive_definite=minor>0.0;
+    }
+  if(!positive_definite)
+    {
+      double shift=0.0;
+      double scale=0.0;
+      for(int a=0; a<Dim; a++)
+        {
+          double off_diagonal=0.0;
+          for(int b=0; b<Dim; b++)
+            {
+              off_diagonal+=(b!=a ? std::abs(hessian[a][b]) : 0.0);
+            }
+          shift=std::max(shift,off_diagonal-hessian[a][a]);
+          scale+=std::abs(hessian[a][a]);
+        }
+      for(int a=0; a<Dim; a++)
+        {
+          hessian[a][a]+=shift+1e-3*scale+std::numeric_limits<double>::min();
         }
-
-      ImVec2 delta=m_Positions[aVertexId].m_Pos-m_Positions[other_id].m_Pos;
-      double distance=norm(delta);
-      double cubed_distance=distance * distance * distance;
-
-      Spring spring=m_Springs[aVertexId][other_id];
-
-      x_energy += delta.x * spring.m_Strength * (1.0 - spring.m_Length / distance);
-      y_energy += delta.y * spring.m_Strength * (1.0 - spring.m_Length / distance);
-      xy_energy += spring.m_Strength * spring.m_Length * delta.x * delta.y / cubed_distance;
-      xx_energy += spring.m_Strength * (1.0 - spring.m_Length * delta.y * delta.y / cubed_distance);
-      yy_energy += spring.m_Strength * (1.0 - spring.m_Length * delta.x * delta.x / cubed_distance);
     }
-  yx_energy = xy_energy;
 
-  ImVec2 position = m_Positions[aVertexId].m_Pos;
-  double denom = xx_energy * yy_energy - xy_energy * yx_energy;
-  position.x += static_cast<float>((xy_energy * y_energy - yy_energy * x_energy) / denom);
-  position.y += static_cast<float>((xy_energy * x_energy - xx_energy * y_energy) / denom);
+  // Newton step: solve h * step = -g, Cramer's rule
+  vec_t position=m_Positions[aVertexId].m_Pos;
+  if constexpr(Dim==2)
+    {
+      const double xx=hessian[0][0], xy=hessian[0][1], yy=hessian[1][1];
+      const double denom=xx*yy-xy*xy;
+      position.x+=static_cast<Scalar>((xy*gradient.y-yy*gradient.x)/denom);
+      position.y+=static_cast<Scalar>((xy*gradient.x-xx*gradient.y)/denom);
+    }
+  else
+    {
+      const double xx=hessian[0][0], xy=hessian[0][1], xz=hessian[0][2];
+      const double yy=hessian[1][1], yz=hessian[1][2], zz=hessian[2][2];
+      // cofactors of the symmetric matrix
+      const double c_xx=yy*zz-yz*yz, c_xy=xz*yz-xy*zz, c_xz=xy*yz-xz*yy;
+      const double c_yy=xx*zz-xz*xz, c_yz=xy*xz-xx*yz, c_zz=xx*yy-xy*xy;
+      const double denom=xx*c_xx+xy*c_xy+xz*c_xz;
+      position.x-=static_cast<Scalar>((c_xx*gradient.x+c_xy*gradient.y+c_xz*gradient.z)/denom);
+      position.y-=static_cast<Scalar>((c_xy*gradient.x+c_yy*gradient.y+c_yz*gradient.z)/denom);
+      position.z-=static_cast<Scalar>((c_xz*gradient.x+c_yz*gradient.y+c_zz*gradient.z)/denom);
+    }
 
   return position;
 }
@@ -276,60 +625,61 @@ ImVec2 KamadaKawai::ComputeNextVertexPosition(vertex_id_t aVertexId) const noexc
 
 
 
-void KamadaKawai::CenterAndScale(float aWidth, float aHeight,std::vector<NsPosition>& aPositions) const noexcept
+template<typename Scalar,typename Index,int Dim>
+void BasicKamadaKawai<Scalar,Index,Dim>::CenterAndScale(Scalar aWidth, Scalar aHeight,std::vector<position_t>& aPositions) const
 {
-  assert(m_Positions.size()==aPositions.size());
+  // The graph edits change the vertex count under the caller
+  aPositions.resize(m_Positions.size());
+  NODESOUP_SCOPED_TIMER(m_Stats.m_Phases[LayoutStats::kCenterAndScale]);
 
   // find current dimensions
-  float x_min = std::numeric_limits<float>::max();
-  float x_max = std::numeric_limits<float>::lowest();
-  float y_min = std::numeric_limits<float>::max();
-  float y_max = std::numeric_limits<float>::lowest();
+  vec_t min;
+  vec_t max;
+  for(int axis=0; axis<Dim; axis++)
+    {
+      min[axis]=std::numeric_limits<Scalar>::max();
+      max[axis]=std::numeric_limits<Scalar>::lowest();
+    }
 
   for(vertex_id_t v_id=0; v_id<m_Positions.size(); v_id++)
     {
-      if(m_Positions[v_id].m_Pos.x<x_min)
-        {
-          x_min=m_Positions[v_id].m_Pos.x;
-        }
-      if(m_Positions[v_id].m_Pos.x>x_max)
-        {
-          x_max=m_Positions[v_id].m_Pos.x;
-        }
-
-      if(m_Positions[v_id].m_Pos.y<y_min)
+      for(int axis=0; axis<Dim; axis++)
         {
-          y_min=m_Positions[v_id].m_Pos.y;
-        }
-      if(m_Positions[v_id].m_Pos.y>y_max)
-        {
-          y_max=m_Positions[v_id].m_Pos.y;
+          if(m_Positions[v_id].m_Pos[axis]<min[axis])
+            {
+              min[axis]=m_Positions[v_id].m_Pos[axis];
+            }
+          if(m_Positions[v_id].m_Pos[axis]>max[axis])
+            {
+              max[axis]=m_Positions[v_id].m_Pos[axis];
+            }
         }
     }
 
-  float cur_width =x_max-x_min;
-  float cur_height=y_max-y_min;
+  Scalar cur_width =max.x-min.x;
+  Scalar cur_height=max.y-min.y;
 
   // compute scale factor (0.9: keep some margin)
-  float x_scale = aWidth/cur_width;
-  float y_scale = aHeight/cur_height;
-  m_Scale = 0.9f * (x_scale<y_scale ? x_scale : y_scale);
+  Scalar x_scale = aWidth/cur_width;
+  Scalar y_scale = aHeight/cur_height;
+  m_Scale = Scalar(0.9) * (x_scale<y_scale ? x_scale : y_scale);
 
   // compute offset and apply it to every position
-  ImVec2 center = { x_max+x_min, y_max+y_min };
-  m_Offset = center/2.0 * m_Scale;
+  vec_t center = max+min;
+  m_Offset = center/Scalar(2) * m_Scale;
   for(vertex_id_t v_id=0; v_id<m_Positions.size(); v_id++)
     {
-      ImVec2 pos_scaled{ m_Scale*m_Positions[v_id].m_Pos.x ,m_Scale*m_Positions[v_id].m_Pos.y };
+      vec_t pos_scaled=m_Positions[v_id].m_Pos*m_Scale;
       aPositions[v_id].m_Pos=pos_scaled-m_Offset;
-      aPositions[v_id].m_Fixed=m_Scale*m_Positions[v_id].m_Fixed;
+      aPositions[v_id].m_Fixed=m_Positions[v_id].m_Fixed;
     }
 }
 
 
 
 
-void KamadaKawai::MovePos(vertex_id_t aVertexId,const ImVec2& aDisp,bool aRecalculate)
+template<typename Scalar,typename Index,int Dim>
+void BasicKamadaKawai<Scalar,Index,Dim>::MovePos(Index aVertexId,const vec_t& aDisp,bool aRecalculate)
 {
   assert(aVertexId<m_Positions.size());
 
@@ -340,72 +690,266 @@ void KamadaKawai::MovePos(vertex_id_t aVertexId,const ImVec2& aDisp,bool aRecalc
           m_Positions[aVertexId].m_Fixed=!m_Positions[aVertexId].m_Fixed;
         }
 
-      double energy=ComputeVertexEnergy(aVertexId);
-      m_MaxVertexEnergy=std::max(energy, m_MaxVertexEnergy);
-      RecalculateSprings(aVertexId);
+      m_Energies.Update(aVertexId,GetVertexEnergy(aVertexId));
+      RestartMoves();
       return;
     }
 
-  if(!aDisp.x && !aDisp.y)
+  if(sq_norm(aDisp)==0)
     {
       return;
     }
 
-  ImVec2 disp=aDisp/m_Scale;
+  vec_t disp=aDisp/m_Scale;
+  vec_t prev_pos=m_Positions[aVertexId].m_Pos;
   m_Positions[aVertexId].m_Pos+=disp;
-  if(sq_norm(aDisp)>0.0f)
+  if(sq_norm(aDisp)>0)
     {
       m_Positions[aVertexId].m_Fixed=true;
     }
+  UpdateGradients(aVertexId,prev_pos);
 }
 
 
 
 
-void KamadaKawai::RecalculateSprings(vertex_id_t aVertexId)
+// The first edit copies the graph, later ones edit the copy
+template<typename Scalar,typename Index,int Dim>
+typename BasicKamadaKawai<Scalar,Index,Dim>::graph_t& BasicKamadaKawai<Scalar,Index,Dim>::EditGraph()
 {
-  std::vector<std::vector<vertex_id_t>> distances=floyd_warshall_(m_AdjList);
+  assert(m_Distances.GetVertexCount()==m_Graph->GetVertexCount());
+  if(m_Graph!=&m_OwnGraph)
+    {
+      m_OwnGraph=*m_Graph;
+      m_Graph=&m_OwnGraph;
+    }
+  m_AdjList=nullptr;
+  return m_OwnGraph;
+}
+
 
-  // find biggest distance
-  size_t biggest_distance = 0;
-  for(vertex_id_t v_id=0; v_id<m_AdjList.size(); v_id++)
+
+
+// The gradients of both vertices lose the term of the old spring and get the new one
+template<typename Scalar,typename Index,int Dim>
+void BasicKamadaKawai<Scalar,Index,Dim>::ChangeSpring(Index aVertexId,Index aOtherId,hop_t aOldHops,hop_t aNewHops)
+{
+  if(aNewHops!=kUnreachable && aNewHops>=m_SpringTable.size())
     {
-      for(vertex_id_t other_id=0; other_id<m_AdjList.size(); other_id++)
-        {
-          if(distances[v_id][other_id] > biggest_distance)
-            {
-              biggest_distance = distances[v_id][other_id];
-            }
-        }
+      ExtendSprings(aNewHops);
     }
 
-  double length=1.0/biggest_distance;
-  for(vertex_id_t other_id=0; other_id<m_AdjList.size(); other_id++)
+  const Spring& old_spring=GetSpring(aOldHops);
+  const Spring& new_spring=GetSpring(aNewHops);
+  const vec_t delta=m_Positions[aVertexId].m_Pos-m_Positions[aOtherId].m_Pos;
+  const double distance=norm(delta);
+
+  // delta * k * (1 - l / distance), the other vertex sees -delta
+  const double factor=new_spring.m_Strength*(1.0-new_spring.m_Length/distance)
+                     -old_spring.m_Strength*(1.0-old_spring.m_Length/distance);
+  for(int axis=0; axis<Dim; axis++)
     {
-      if(aVertexId==other_id)
+      m_Gradients[aVertexId][axis]+=delta[axis]*factor;
+      m_Gradients[aOtherId][axis]-=delta[axis]*factor;
+    }
+
+  m_Energies.Set(aVertexId,GetVertexEnergy(aVertexId));
+  m_Energies.Set(aOtherId,GetVertexEnergy(aOtherId));
+  NODESOUP_COUNT(m_Stats.m_PairEvaluations,1);
+}
+
+
+
+
+// Adds (aSign 1) or removes (aSign -1) the springs of an isolated vertex to the gradients of
+// the other vertices, O(n)
+template<typename Scalar,typename Index,int Dim>
+void BasicKamadaKawai<Scalar,Index,Dim>::AddUnreachableSprings(Index aVertexId,double aSign)
+{
+  const vec_t pos=m_Positions[aVertexId].m_Pos;
+  for(vertex_id_t v_id=0; v_id<m_Positions.size(); v_id++)
+    {
+      if(v_id==aVertexId)
         {
-          m_Springs[aVertexId][other_id].m_Length = 0.0;
-          m_Springs[aVertexId][other_id].m_Strength = 0.0;
+          continue;
         }
-      else
+
+      vec_t delta=m_Positions[v_id].m_Pos-pos;
+      double distance=norm(delta);
+      double factor=aSign*m_UnreachableSpring.m_Strength*(1.0-m_UnreachableSpring.m_Length/distance);
+      for(int axis=0; axis<Dim; axis++)
         {
-          size_t distance=distances[aVertexId][other_id];
-          m_Springs[aVertexId][other_id].m_Length=distance*length;
-          m_Springs[aVertexId][other_id].m_Strength=m_K/(distance*distance);
+          m_Gradients[v_id][axis]+=delta[axis]*factor;
         }
     }
+  NODESOUP_COUNT(m_Stats.m_PairEvaluations,m_Positions.size()-1);
+}
 
 
-  m_SteadyEnergyCount=0;
-  auto res=FindMaxVertexEnergy();
-  m_MaxVertexEnergy=std::get<double>(res);
-  m_VertexId=std::get<vertex_id_t>(res);
+
+
+// After a change of the vertex count, O(n)
+template<typename Scalar,typename Index,int Dim>
+void BasicKamadaKawai<Scalar,Index,Dim>::SyncEnergies()
+{
+  m_Energies.Resize(m_Positions.size());
+  for(vertex_id_t v_id=0; v_id<m_Positions.size(); v_id++)
+    {
+      m_Energies.Set(v_id,GetVertexEnergy(v_id));
+    }
+  m_Energies.Rebuild();
+}
+
+
+
+
+// New vertices without neighbours are spread on the unit circle (sphere) of the initial layouts
+template<typename Scalar,typename Index,int Dim>
+Index BasicKamadaKawai<Scalar,Index,Dim>::AddVertex()
+{
+  const Index v_id=EditGraph().AddVertex();
+  {
+    NODESOUP_SCOPED_TIMER(m_Stats.m_Phases[LayoutStats::kDistances]);
+    m_Distances.AddVertex();
+  }
+
+  position_t pos{};
+  pos.m_Pos=GetSpreadDirection<Scalar,Dim>(v_id);
+  m_Positions.push_back(pos);
+
+  AddUnreachableSprings(v_id,1.0);
+  m_Gradients.push_back(ComputeVertexGradient(v_id));
+  SyncEnergies();
+
+  RestartMoves();
+  NODESOUP_STATS_ONLY(m_Stats.CountGrowth(GetMemorySize(),m_StatsMemorySize);)
+  return v_id;
+}
+
+
+
+
+template<typename Scalar,typename Index,int Dim>
+void BasicKamadaKawai<Scalar,Index,Dim>::AddEdge(Index aFrom,Index aTo)
+{
+  const bool place_from=!m_Graph->GetDegree(aFrom);
+  const bool place_to=!m_Graph->GetDegree(aTo);
+  if(!EditGraph().AddEdge(aFrom,aTo))
+    {
+      return;
+    }
+
+  if(place_from && !place_to)
+    {
+      PlaceNear(aFrom,aTo);
+    }
+  else if(place_to && !place_from)
+    {
+      PlaceNear(aTo,aFrom);
+    }
+
+  {
+    NODESOUP_SCOPED_TIMER(m_Stats.m_Phases[LayoutStats::kDistances]);
+    m_Distances.InsertEdge(*m_Graph,aFrom,aTo,[this](vertex_id_t aVertexId,vertex_id_t aOtherId,hop_t aOldHops,hop_t aNewHops)
+    {
+      ChangeSpring(static_cast<Index>(aVertexId),static_cast<Index>(aOtherId),aOldHops,aNewHops);
+    });
+  }
+  m_Energies.Rebuild();
+
+  RestartMoves();
+  NODESOUP_STATS_ONLY(m_Stats.CountGrowth(GetMemorySize(),m_StatsMemorySize);)
 }
 
 
 
 
-double KamadaKawai::GetEnergy() const noexcept
+template<typename Scalar,typename Index,int Dim>
+void BasicKamadaKawai<Scalar,Index,Dim>::RemoveEdge(Index aFrom,Index aTo)
+{
+  EraseEdge(aFrom,aTo);
+  m_Energies.Rebuild();
+
+  RestartMoves();
+  NODESOUP_STATS_ONLY(m_Stats.CountGrowth(GetMemorySize(),m_StatsMemorySize);)
+}
+
+
+
+
+// Without fixing m_Energies
+template<typename Scalar,typename Index,int Dim>
+void BasicKamadaKawai<Scalar,Index,Dim>::EraseEdge(Index aFrom,Index aTo)
+{
+  if(!EditGraph().RemoveEdge(aFrom,aTo))
+    {
+      return;
+    }
+
+  NODESOUP_SCOPED_TIMER(m_Stats.m_Phases[LayoutStats::kDistances]);
+  m_Distances.RemoveEdge(*m_Graph,aFrom,aTo,[this](vertex_id_t aVertexId,vertex_id_t aOtherId,hop_t aOldHops,hop_t aNewHops)
+  {
+    ChangeSpring(static_cast<Index>(aVertexId),static_cast<Index>(aOtherId),aOldHops,aNewHops);
+  });
+}
+
+
+
+
+// The vertex loses its edges first, then the last vertex takes its id
+template<typename Scalar,typename Index,int Dim>
+void BasicKamadaKawai<Scalar,Index,Dim>::RemoveVertex(Index aVertexId)
+{
+  graph_t& graph=EditGraph();
+  const typename graph_t::Neighbors neighbors=graph.GetNeighbors(aVertexId);
+  const std::vector<Index> adj_ids(neighbors.begin(),neighbors.end());
+  for(Index adj_id:adj_ids)
+    {
+      EraseEdge(aVertexId,adj_id);
+    }
+  AddUnreachableSprings(aVertexId,-1.0);
+
+  const Index last=static_cast<Index>(graph.GetVertexCount()-1);
+  graph.RemoveVertex(aVertexId);
+  {
+    NODESOUP_SCOPED_TIMER(m_Stats.m_Phases[LayoutStats::kDistances]);
+    m_Distances.RemoveVertex(aVertexId);
+  }
+
+  m_Positions[aVertexId]=m_Positions[last];
+  m_Positions.pop_back();
+  m_Gradients[aVertexId]=m_Gradients[last];
+  m_Gradients.pop_back();
+  SyncEnergies();
+
+  RestartMoves();
+  NODESOUP_STATS_ONLY(m_Stats.CountGrowth(GetMemorySize(),m_StatsMemorySize);)
+}
+
+
+
+
+// Half a hop away, in a direction given by the id so that several new vertices around
+// the same neighbour do not overlap
+template<typename Scalar,typename Index,int Dim>
+void BasicKamadaKawai<Scalar,Index,Dim>::PlaceNear(Index aVertexId,Index aNeighborId)
+{
+  if(m_Positions[aVertexId].m_Fixed)
+    {
+      return;
+    }
+
+  const vec_t prev_pos=m_Positions[aVertexId].m_Pos;
+  const Scalar offset=static_cast<Scalar>(0.5*m_SpringLength);
+  m_Positions[aVertexId].m_Pos=m_Positions[aNeighborId].m_Pos+GetSpreadDirection<Scalar,Dim>(aVertexId)*offset;
+  UpdateGradients(aVertexId,prev_pos);
+}
+
+
+
+
+template<typename Scalar,typename Index,int Dim>
+double BasicKamadaKawai<Scalar,Index,Dim>::GetEnergy() const noexcept
 {
   return m_MaxVertexEnergy;
 }
@@ -413,13 +957,19 @@ double KamadaKawai::GetEnergy() const noexcept
 
 
 
-void KamadaKawai::SetInitPositions(bool aStartCircle)
+template<typename Scalar,typename Index,int Dim>
+void BasicKamadaKawai<Scalar,Index,Dim>::SetInitPositions(InitMode aInitMode)
 {
-  m_Positions.resize(m_AdjList.size());
-  nodesoup::SetInitPositions(aStartCircle,m_Positions);
+  m_Positions.resize(m_Graph->GetVertexCount());
+  nodesoup::SetInitPositions(aInitMode,*m_Graph,m_Positions);
 }
 
 
 
 
+#define NODESOUP_INSTANTIATE_(aScalar,aIndex,aDim) template class BasicKamadaKawai<aScalar,aIndex,aDim>;
+NODESOUP_FOR_EACH_LAYOUT_TYPE(NODESOUP_INSTANTIATE_)
+#undef NODESOUP_INSTANTIATE_
+
+
 }
@@ -1,28 +1,82 @@
 #pragma once
 #include "nodesoup.hpp"
+#include "csr_graph.hpp"
+#include "layout_stats.hpp"
+#include "shortest_paths.hpp"
+#include "step_budget.hpp"
+#include "tournament_tree.hpp"
+#include <chrono>
 #include <vector>
 #include <tuple>
 
 namespace nodesoup
 {
+
+class ThreadPool;
 // https://gist.github.com/terakun/b7eff90c889c1485898ec9256ca9f91d
 // https://graphsharp.codeplex.com/SourceControl/latest#Source/Graph#/Algorithms/Layout/Simple/FDP/KKLayoutAlgorithm.cs
 
 
 
-class KamadaKawai
+// Templated on the same Scalar, Index and Dim as BasicFruchtermanReingold, KamadaKawai below
+// is the float, 32 bits, 2D one. Whatever Scalar is, the springs, gradients and Newton steps
+// are computed in double: the energy of a vertex is a difference of large terms.
+template<typename Scalar,typename Index,int Dim>
+class BasicKamadaKawai
 {
 public:
 
-  KamadaKawai(const adj_list_t& aAdjList,double aK=300.0,double aEnergyThreshold=1e-2);
+  using vec_t=NsVec<Scalar,Dim>;
+  using position_t=NsBasicPosition<Scalar,Dim>;
+  using graph_t=BasicCsrGraph<Index>;
+
+  BasicKamadaKawai(const adj_list_t& aAdjList,double aK=300.0,double aEnergyThreshold=1e-2);
+  BasicKamadaKawai(const graph_t& aGraph,double aK=300.0,double aEnergyThreshold=1e-2);
 
   void Start(bool aStartCircle=true);
-  void Step(float aWidth,float aHeight,std::vector<NsPosition>& aPositions);
+  void Start(InitMode aInitMode);
+  // Warm start from positions of any scale (a saved layout)
+  void Start(const std::vector<position_t>& aPositions);
+  // In 3D the width and height fit x and y, z is only centered
+  void Step(Scalar aWidth,Scalar aHeight,std::vector<position_t>& aPositions);
+  // Moves as many vertices as fit in aBudget (at least one), from the measured cost of the
+  // previous moves
+  StepProgress StepFor(std::chrono::microseconds aBudget,Scalar aWidth,Scalar aHeight,std::vector<position_t>& aPositions);
+
+  // Headless use: up to aMoves vertex moves, and the positions as laid out (the longest
+  // shortest path about 1.0 long) instead of the window fit of Step()
+  void Iterate(int aMoves);
+  void GetPositions(std::vector<position_t>& aPositions) const;
+  bool IsConverged() const noexcept;
+
+  // Dropping a vertex only refreshes its energy: the hop distances do not depend on positions
+  void MovePos(Index aVertexId,const vec_t& aDisp,bool aRecalculate);
+
+  // Graph edits after Start(), keeping the layout. The hop distances are repaired in place
+  // (see HopMatrix) and only the pairs whose distance changed update their springs, then the
+  // moves resume from the vertex with most energy. From the first edit the engine works on
+  // its own copy of the graph, see GetGraph(). Step() and StepFor() resize their positions
+  // to it.
+  Index AddVertex();
+  void  AddEdge(Index aFrom,Index aTo);
+  void  RemoveEdge(Index aFrom,Index aTo);
+  // The last vertex takes the id of the removed one, as in CsrGraph::RemoveVertex()
+  void  RemoveVertex(Index aVertexId);
+
+  const graph_t& GetGraph() const noexcept;
 
-  void MovePos(vertex_id_t aVertexId,const ImVec2& aDisp,bool aRecalculate);
+  double GetEnergy() const noexcept;
 
+  // Phase times and counters, see layout_stats.hpp
+  const LayoutStats& GetStats() const noexcept;
+  void               ResetStats() noexcept;
+  // Bytes of the engine buffers, the graph included when owned
+  std::size_t        GetMemorySize() const noexcept;
 
-  double GetEnergy() const noexcept;
+  // Hop distances computed on Start(), can be shared with StressMajorization::Start()
+  const HopMatrix& GetDistances() const noexcept;
+  // Pool spreading the hop distances of Start(), DefaultThreadPool() unless set
+  void SetThreadPool(ThreadPool& aThreadPool) noexcept;
 
 private:
 
@@ -32,31 +86,133 @@ private:
     double m_Strength;
   };
 
+  // dE/dx, dE/dy (dE/dz) of a vertex; its norm is the vertex energy
+  using gradient_t=NsVec<double,Dim>;
+
 
-  const adj_list_t& m_AdjList;
+  // Graphs are read on Start(), an adjacency list is converted to m_OwnGraph
+  const adj_list_t* m_AdjList;
+  const graph_t*    m_Graph;
+  graph_t           m_OwnGraph;
+  ThreadPool*       m_ThreadPool;
   const double m_EnergyThreshold;
   double m_K;
   unsigned int m_SteadyEnergyCount;
   double m_MaxVertexEnergy;
-  vertex_id_t m_VertexId;
+  Index m_VertexId;
+
+  // Springs are derived from the hop distance between both vertices,
+  // m_SpringTable[hops] holds the spring for each finite distance.
+  // The distances are computed on Start() and kept up to date by the graph edits.
+  HopMatrix m_Distances;
+  std::vector<Spring> m_SpringTable;
+  Spring m_UnreachableSpring;
+  double m_SpringLength;   // Ideal length of one hop
+  mutable std::vector<position_t> m_Positions;
 
-  std::vector<std::vector<Spring>> m_Springs;
-  mutable std::vector<NsPosition> m_Positions;
+  // Gradients are kept up to date as vertices move, m_Energies gives the vertex with most energy
+  std::vector<gradient_t> m_Gradients;
+  TournamentTree m_Energies;
+  std::size_t m_UpdatesSinceSync;
+
+  IterationCost m_MoveCost;
+
+  // CenterAndScale() is const and timed too
+  mutable LayoutStats m_Stats;
+  std::size_t m_StatsMemorySize;
+
+  void MoveMaxEnergyVertex();
+  void ComputeDistances();
 
   // p m
-  std::tuple<double,vertex_id_t> FindMaxVertexEnergy() const noexcept;
+  std::tuple<double,Index> FindMaxVertexEnergy() const noexcept;
   // delta m
-  double ComputeVertexEnergy(vertex_id_t aVertexId) const noexcept;
-  ImVec2 ComputeNextVertexPosition(vertex_id_t aVertexId) const noexcept;
+  double ComputeVertexEnergy(Index aVertexId) const noexcept;
+  gradient_t ComputeVertexGradient(Index aVertexId) const noexcept;
+  double GetVertexEnergy(Index aVertexId) const noexcept;
+
+  void ComputeGradients();
+  void UpdateGradients(Index aMovedId,const vec_t& aPrevPos);
+  vec_t ComputeNextVertexPosition(Index aVertexId) const noexcept;
+
+  void InitSprings();
+  void FitToSprings();
+  void InitEnergies();
+  void RestartMoves();
 
-  void RecalculateSprings(vertex_id_t aVertexId);
+  void ExtendSprings(hop_t aHops);
+  void ChangeSpring(Index aVertexId,Index aOtherId,hop_t aOldHops,hop_t aNewHops);
+  void AddUnreachableSprings(Index aVertexId,double aSign);
+  void SyncEnergies();
 
-  void SetInitPositions(bool aStartCircle);
+  graph_t& EditGraph();
+  void     PlaceNear(Index aVertexId,Index aNeighborId);
+  void     EraseEdge(Index aFrom,Index aTo);
 
-  void CenterAndScale(float aWidth,float aHeight,std::vector<NsPosition>& aPositions) const noexcept;
-  mutable float m_Scale;
-  mutable ImVec2 m_Offset;
+  const Spring& GetSpring(hop_t aHops) const noexcept;
+  template<typename Func> void ForEachSpring(Index aVertexId,Func aFunc) const;
+
+  void SetInitPositions(InitMode aInitMode);
+
+  void CenterAndScale(Scalar aWidth,Scalar aHeight,std::vector<position_t>& aPositions) const;
+  mutable Scalar m_Scale;
+  mutable vec_t  m_Offset;
 };
 
+using KamadaKawai=BasicKamadaKawai<float,csr_id_t,2>;
+
+
+
+
+template<typename Scalar,typename Index,int Dim>
+inline const HopMatrix& BasicKamadaKawai<Scalar,Index,Dim>::GetDistances() const noexcept
+{
+  return m_Distances;
+}
+
+template<typename Scalar,typename Index,int Dim>
+inline void BasicKamadaKawai<Scalar,Index,Dim>::SetThreadPool(ThreadPool& aThreadPool) noexcept
+{
+  m_ThreadPool=&aThreadPool;
+}
+
+template<typename Scalar,typename Index,int Dim>
+inline const typename BasicKamadaKawai<Scalar,Index,Dim>::graph_t& BasicKamadaKawai<Scalar,Index,Dim>::GetGraph() const noexcept
+{
+  return *m_Graph;
+}
+
+template<typename Scalar,typename Index,int Dim>
+inline const LayoutStats& BasicKamadaKawai<Scalar,Index,Dim>::GetStats() const noexcept
+{
+  return m_Stats;
+}
+
+template<typename Scalar,typename Index,int Dim>
+inline void BasicKamadaKawai<Scalar,Index,Dim>::ResetStats() noexcept
+{
+  m_Stats=LayoutStats();
+}
+
+template<typename Scalar,typename Index,int Dim>
+inline const typename BasicKamadaKawai<Scalar,Index,Dim>::Spring& BasicKamadaKawai<Scalar,Index,Dim>::GetSpring(hop_t aHops) const noexcept
+{
+  return aHops<m_SpringTable.size() ? m_SpringTable[aHops] : m_UnreachableSpring;
+}
+
+
+
+
+// Calls aFunc(other_id,spring) for every other vertex, in order
+template<typename Scalar,typename Index,int Dim>
+template<typename Func>
+void BasicKamadaKawai<Scalar,Index,Dim>::ForEachSpring(Index aVertexId,Func aFunc) const
+{
+  m_Distances.ForEachDistance(aVertexId,[this,&aFunc](vertex_id_t aOtherId,hop_t aHops)
+  {
+    aFunc(static_cast<Index>(aOtherId),GetSpring(aHops));
+  });
+}
+
 
 }
@@ -0,0 +1,334 @@
+#include "layout_snapshot.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+
+#ifdef _WIN32
+  #define WIN32_LEAN_AND_MEAN
+  #include <windows.h>
+#endif
+
+namespace nodesoup
+{
+
+
+constexpr char kSnapshotMagic[8]={'N','S','O','U','P','L','A','Y'};
+constexpr std::uint32_t kByteOrderMark=0x01020304u;
+
+
+
+
+static std::uint64_t align_up_(std::uint64_t aOffset) noexcept
+{
+  return (aOffset+kSnapshotAlignment-1)/kSnapshotAlignment*kSnapshotAlignment;
+}
+
+
+
+
+// std::rename() does not replace an existing file on Windows
+static bool replace_file_(const char* aFrom,const char* aTo)
+{
+#ifdef _WIN32
+  return MoveFileExA(aFrom,aTo,MOVEFILE_REPLACE_EXISTING)!=0;
+#else
+  return std::rename(aFrom,aTo)==0;
+#endif
+}
+
+
+
+
+// Writes aSize bytes then zeroes up to the next aligned offset
+static bool write_aligned_(std::FILE* aFile,const void* aData,std::size_t aSize,std::uint64_t& aOffset)
+{
+  static const char kZeros[kSnapshotAlignment]={};
+
+  if(aSize && std::fwrite(aData,1,aSize,aFile)!=aSize)
+    {
+      return false;
+    }
+
+  aOffset+=aSize;
+  const std::size_t padding=static_cast<std::size_t>(align_up_(aOffset)-aOffset);
+  if(padding && std::fwrite(kZeros,1,padding,aFile)!=padding)
+    {
+      return false;
+    }
+
+  aOffset+=padding;
+  return true;
+}
+
+
+
+
+// One float (or flag) per vertex taken from aPositions, written through a small buffer
+template<typename T,typename Func>
+static bool write_field_(std::FILE* aFile,const std::vector<NsPosition>& aPositions,Func aField,std::uint64_t& aOffset)
+{
+  constexpr std::size_t kChunk=4096;
+  T buffer[kChunk];
+
+  for(std::size_t begin=0; begin<aPositions.size(); begin+=kChunk)
+    {
+      const std::size_t count=std::min(kChunk,aPositions.size()-begin);
+      for(std::size_t i=0; i<count; i++)
+        {
+          buffer[i]=aField(aPositions[begin+i]);
+        }
+      if(std::fwrite(buffer,sizeof(T),count,aFile)!=count)
+        {
+          return false;
+        }
+    }
+
+  aOffset+=aPositions.size()*sizeof(T);
+  return write_aligned_(aFile,nullptr,0,aOffset);
+}
+
+
+
+
+bool SaveLayoutSnapshot(const char* aPath,const CsrGraph& aGraph,const std::vector<NsPosition>& aPositions
+                        ,const LayoutState& aState,std::string* aError)
+{
+  const std::size_t vertex_count=aGraph.GetVertexCount();
+  if(aPositions.size()!=vertex_count)
+    {
+      if(aError)
+        {
+          *aError="positions do not match the graph";
+        }
+      return false;
+    }
+
+  // Edited graphs have room in their rows, the file has the plain CSR arrays
+  if(!aGraph.IsCompact())
+    {
+      CsrGraph compact(aGraph);
+      compact.Compact();
+      return SaveLayoutSnapshot(aPath,compact,aPositions,aState,aError);
+    }
+
+  SnapshotHeader header;
+  std::memset(&header,0,sizeof(header));
+  std::memcpy(header.m_Magic,kSnapshotMagic,sizeof(header.m_Magic));
+  header.m_ByteOrderMark=kByteOrderMark;
+  header.m_Version=kSnapshotVersion;
+  header.m_VertexCount=vertex_count;
+  header.m_ArcCount=aGraph.GetArcCount();
+  header.m_Temperature=aState.m_Temperature;
+  header.m_K=aState.m_K;
+  header.m_Iteration=aState.m_Iteration;
+
+  // Empty graphs have no offsets array, a single 0 is written instead
+  const csr_id_t no_offsets=0;
+  const csr_id_t* offsets=vertex_count ? aGraph.GetOffsets() : &no_offsets;
+
+  header.m_OffsetsOffset=align_up_(sizeof(SnapshotHeader));
+  header.m_TargetsOffset=align_up_(header.m_OffsetsOffset+(vertex_count+1)*sizeof(csr_id_t));
+  header.m_XOffset=align_up_(header.m_TargetsOffset+header.m_ArcCount*sizeof(csr_id_t));
+  header.m_YOffset=align_up_(header.m_XOffset+vertex_count*sizeof(float));
+  header.m_RadiusOffset=align_up_(header.m_YOffset+vertex_count*sizeof(float));
+  header.m_FixedOffset=align_up_(header.m_RadiusOffset+vertex_count*sizeof(float));
+  header.m_FileSize=align_up_(header.m_FixedOffset+vertex_count*sizeof(std::uint8_t));
+
+  // Truncating aPath in place would pull the pages from under its mappings (SIGBUS)
+  const std::string temp_path=std::string(aPath)+".tmp";
+  std::FILE* file=std::fopen(temp_path.c_str(),"wb");
+  if(!file)
+    {
+      if(aError)
+        {
+          *aError="cannot create "+temp_path;
+        }
+      return false;
+    }
+
+  std::uint64_t offset=0;
+  bool ok=write_aligned_(file,&header,sizeof(header),offset)
+       && write_aligned_(file,offsets,(vertex_count+1)*sizeof(csr_id_t),offset)
+       && write_aligned_(file,aGraph.GetTargets(),header.m_ArcCount*sizeof(csr_id_t),offset)
+       && write_field_<float>(file,aPositions,[](const NsPosition& aPos){ return aPos.m_Pos.x; },offset)
+       && write_field_<float>(file,aPositions,[](const NsPosition& aPos){ return aPos.m_Pos.y; },offset)
+       && write_field_<float>(file,aPositions,[](const NsPosition& aPos){ return aPos.m_Radius; },offset)
+       && write_field_<std::uint8_t>(file,aPositions,[](const NsPosition& aPos){ return static_cast<std::uint8_t>(aPos.m_Fixed); },offset);
+
+  ok=(std::fclose(file)==0) && ok;
+  if(!ok)
+    {
+      std::remove(temp_path.c_str());
+      if(aError)
+        {
+          *aError="cannot write "+temp_path;
+        }
+      return false;
+    }
+
+  if(!replace_file_(temp_path.c_str(),aPath))
+    {
+      std::remove(temp_path.c_str());
+      if(aError)
+        {
+          *aError=std::string("cannot replace ")+aPath;
+        }
+      return false;
+    }
+
+  return true;
+}
+
+
+
+
+LayoutSnapshot::LayoutSnapshot() noexcept
+    : m_X(nullptr)
+    , m_Y(nullptr)
+    , m_Radiuses(nullptr)
+    , m_Fixed(nullptr)
+{
+}
+
+
+
+
+bool LayoutSnapshot::Fail(const char* aReason,std::string* aError)
+{
+  Close();
+  if(aError)
+    {
+      *aError=aReason;
+    }
+  return false;
+}
+
+
+
+
+bool LayoutSnapshot::Open(const char* aPath,std::string* aError)
+{
+  Close();
+
+  if(!m_File.Open(aPath))
+    {
+      return Fail("cannot map the file",aError);
+    }
+
+  const std::uint64_t size=m_File.GetSize();
+  if(size<sizeof(SnapshotHeader))
+    {
+      return Fail("truncated header",aError);
+    }
+
+  SnapshotHeader header;
+  std::memcpy(&header,m_File.GetData(),sizeof(header));
+  if(std::memcmp(header.m_Magic,kSnapshotMagic,sizeof(header.m_Magic))!=0)
+    {
+      return Fail("not a layout snapshot",aError);
+    }
+  if(header.m_ByteOrderMark!=kByteOrderMark)
+    {
+      return Fail("written with another byte order",aError);
+    }
+  if(header.m_Version!=kSnapshotVersion)
+    {
+      return Fail("unsupported version",aError);
+    }
+  if(header.m_FileSize!=size)
+    {
+      return Fail("truncated file",aError);
+    }
+
+  // Counts bounded by the file size first, so the section ends below cannot overflow
+  const std::uint64_t vertex_count=header.m_VertexCount;
+  const std::uint64_t arc_count=header.m_ArcCount;
+  if(vertex_count>=std::numeric_limits<csr_id_t>::max() || vertex_count>size || arc_count>size)
+    {
+      return Fail("bad vertex or arc count",aError);
+    }
+
+  auto section_ok=[size](std::uint64_t aOffset,std::uint64_t aBytes)
+  {
+    return aOffset%kSnapshotAlignment==0 && aOffset>=sizeof(SnapshotHeader) && aOffset<=size && aBytes<=size-aOffset;
+  };
+  if(!section_ok(header.m_OffsetsOffset,(vertex_count+1)*sizeof(csr_id_t))
+     || !section_ok(header.m_TargetsOffset,arc_count*sizeof(csr_id_t))
+     || !section_ok(header.m_XOffset,vertex_count*sizeof(float))
+     || !section_ok(header.m_YOffset,vertex_count*sizeof(float))
+     || !section_ok(header.m_RadiusOffset,vertex_count*sizeof(float))
+     || !section_ok(header.m_FixedOffset,vertex_count*sizeof(std::uint8_t)))
+    {
+      return Fail("section out of the file",aError);
+    }
+
+  const char* data=m_File.GetData();
+  const csr_id_t* offsets=reinterpret_cast<const csr_id_t*>(data+header.m_OffsetsOffset);
+  const csr_id_t* targets=reinterpret_cast<const csr_id_t*>(data+header.m_TargetsOffset);
+
+  // The engines index with these arrays unchecked
+  if(offsets[0]!=0 || offsets[vertex_count]!=arc_count)
+    {
+      return Fail("bad CSR offsets",aError);
+    }
+  for(std::uint64_t v_id=0; v_id<vertex_count; v_id++)
+    {
+      if(offsets[v_id]>offsets[v_id+1])
+        {
+          return Fail("bad CSR offsets",aError);
+        }
+    }
+  for(std::uint64_t arc=0; arc<arc_count; arc++)
+    {
+      if(targets[arc]>=vertex_count)
+        {
+          return Fail("bad CSR target",aError);
+        }
+    }
+
+  m_Graph=vertex_count ? CsrGraph(offsets,targets,vertex_count) : CsrGraph();
+  m_X=reinterpret_cast<const float*>(data+header.m_XOffset);
+  m_Y=reinterpret_cast<const float*>(data+header.m_YOffset);
+  m_Radiuses=reinterpret_cast<const float*>(data+header.m_RadiusOffset);
+  m_Fixed=reinterpret_cast<const std::uint8_t*>(data+header.m_FixedOffset);
+
+  m_State.m_Temperature=header.m_Temperature;
+  m_State.m_K=header.m_K;
+  m_State.m_Iteration=static_cast<int>(header.m_Iteration);
+
+  return true;
+}
+
+
+
+
+void LayoutSnapshot::Close() noexcept
+{
+  m_Graph=CsrGraph();
+  m_State=LayoutState();
+  m_X=nullptr;
+  m_Y=nullptr;
+  m_Radiuses=nullptr;
+  m_Fixed=nullptr;
+
+  m_File.Close();
+}
+
+
+
+
+void LayoutSnapshot::GetPositions(std::vector<NsPosition>& aPositions) const
+{
+  const std::size_t vertex_count=m_Graph.GetVertexCount();
+  aPositions.resize(vertex_count);
+  for(vertex_id_t v_id=0; v_id<vertex_count; v_id++)
+    {
+      aPositions[v_id].m_Pos={m_X[v_id],m_Y[v_id]};
+      aPositions[v_id].m_Radius=m_Radiuses[v_id];
+      aPositions[v_id].m_Fixed=m_Fixed[v_id]!=0;
+    }
+}
+
+
+}
@@ -0,0 +1,152 @@
+#pragma once
+#include "nodesoup.hpp"
+#include "csr_graph.hpp"
+#include "mapped_file.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace nodesoup
+{
+// Binary snapshot of a graph and its layout, loaded with a memory mapping and used in place:
+// the graph of a LayoutSnapshot borrows the mapped CSR arrays, nothing is parsed or copied.
+//
+// File layout (native byte order, checked on load through kByteOrderMark):
+//   SnapshotHeader
+//   offsets  csr_id_t[vertex_count+1]
+//   targets  csr_id_t[arc_count]
+//   x, y     float[vertex_count] each
+//   radiuses float[vertex_count]
+//   fixed    uint8_t[vertex_count]
+// Every array starts on a kSnapshotAlignment boundary, its byte offset is in the header.
+
+
+
+// Engine state saved with the positions, to continue the layout where it stopped
+struct LayoutState
+{
+  double m_Temperature=0.0;   // FruchtermanReingold::GetTemperature(), 0 for engines without one
+  double m_K=0.0;             // edge length the layout was computed with
+  int    m_Iteration=0;
+};
+
+
+constexpr std::uint32_t kSnapshotVersion=1;
+constexpr std::size_t   kSnapshotAlignment=64;
+
+
+struct SnapshotHeader
+{
+  char          m_Magic[8];        // "NSOUPLAY"
+  std::uint32_t m_ByteOrderMark;
+  std::uint32_t m_Version;
+  std::uint64_t m_FileSize;
+  std::uint64_t m_VertexCount;
+  std::uint64_t m_ArcCount;
+
+  std::uint64_t m_OffsetsOffset;
+  std::uint64_t m_TargetsOffset;
+  std::uint64_t m_XOffset;
+  std::uint64_t m_YOffset;
+  std::uint64_t m_RadiusOffset;
+  std::uint64_t m_FixedOffset;
+
+  double        m_Temperature;
+  double        m_K;
+  std::int64_t  m_Iteration;
+};
+
+
+
+
+// Writes aGraph, aPositions (one per vertex) and aState to aPath, replacing the file.
+// The file is written next to aPath and renamed over it: a LayoutSnapshot still mapping
+// the old file (aGraph may borrow from it) keeps reading it, and a failed write leaves
+// the old file as it was. False on I/O errors, aError (if given) gets the reason.
+bool SaveLayoutSnapshot(const char* aPath,const CsrGraph& aGraph,const std::vector<NsPosition>& aPositions
+                        ,const LayoutState& aState,std::string* aError=nullptr);
+
+
+
+
+class LayoutSnapshot
+{
+public:
+
+  LayoutSnapshot() noexcept;
+
+  LayoutSnapshot(const LayoutSnapshot&)=delete;
+  LayoutSnapshot& operator=(const LayoutSnapshot&)=delete;
+
+  // Maps aPath and checks the header and the CSR arrays (bounds only, O(V+E) without copies).
+  // False if the file cannot be mapped, is truncated, corrupted or of another version.
+  bool Open(const char* aPath,std::string* aError=nullptr);
+  // Invalidates GetGraph() and the arrays
+  void Close() noexcept;
+  bool IsOpen() const noexcept;
+
+  // Views on the mapped file, valid until Close() or destruction
+  const CsrGraph&      GetGraph() const noexcept;
+  const float*         GetX() const noexcept;
+  const float*         GetY() const noexcept;
+  const float*         GetRadiuses() const noexcept;
+  const std::uint8_t*  GetFixed() const noexcept;
+  const LayoutState&   GetState() const noexcept;
+
+  // Positions in the form taken by the warm starts of the engines
+  void GetPositions(std::vector<NsPosition>& aPositions) const;
+
+private:
+
+  MappedFile  m_File;
+  CsrGraph    m_Graph;
+  LayoutState m_State;
+
+  const float*        m_X;
+  const float*        m_Y;
+  const float*        m_Radiuses;
+  const std::uint8_t* m_Fixed;
+
+  bool Fail(const char* aReason,std::string* aError);
+};
+
+
+
+
+inline bool LayoutSnapshot::IsOpen() const noexcept
+{
+  return m_File.IsOpen();
+}
+
+inline const CsrGraph& LayoutSnapshot::GetGraph() const noexcept
+{
+  return m_Graph;
+}
+
+inline const float* LayoutSnapshot::GetX() const noexcept
+{
+  return m_X;
+}
+
+inline const float* LayoutSnapshot::GetY() const noexcept
+{
+  return m_Y;
+}
+
+inline const float* LayoutSnapshot::GetRadiuses() const noexcept
+{
+  return m_Radiuses;
+}
+
+inline const std::uint8_t* LayoutSnapshot::GetFixed() const noexcept
+{
+  return m_Fixed;
+}
+
+inline const LayoutState& LayoutSnapshot::GetState() const noexcept
+{
+  return m_State;
+}
+
+
+}
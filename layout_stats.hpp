@@ -0,0 +1,184 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// Phase timers and counters of the engines. Define NODESOUP_STATS=0 to compile them out:
+// the stats then stay at zero and the hot paths carry no clock reads nor counters.
+#ifndef NODESOUP_STATS
+  #define NODESOUP_STATS 1
+#endif
+
+#if NODESOUP_STATS
+  #define NODESOUP_STATS_ONLY(...) __VA_ARGS__
+#else
+  #define NODESOUP_STATS_ONLY(...)
+#endif
+
+#define NODESOUP_CONCAT2_(aA,aB) aA##aB
+#define NODESOUP_CONCAT_(aA,aB)  NODESOUP_CONCAT2_(aA,aB)
+
+// Times the rest of the enclosing scope into a PhaseTimer
+#define NODESOUP_SCOPED_TIMER(aTimer) NODESOUP_STATS_ONLY(nodesoup::ScopedTimer NODESOUP_CONCAT_(scoped_timer_,__LINE__)(aTimer))
+// Adds aValue to a counter
+#define NODESOUP_COUNT(aCounter,aValue) NODESOUP_STATS_ONLY((aCounter)+=(aValue))
+
+namespace nodesoup
+{
+
+
+constexpr bool kStatsEnabled=NODESOUP_STATS!=0;
+
+
+// Total time and number of runs of a phase
+struct PhaseTimer
+{
+  std::uint64_t m_Nanoseconds=0;
+  std::uint64_t m_Calls=0;
+
+  void Add(std::uint64_t aNanoseconds) noexcept;
+  double GetMilliseconds() const noexcept;
+};
+
+
+
+
+// Cumulative since the engine was constructed or ResetStats(). Phases an engine does not
+// have stay at zero. Phases run on the thread pool add the time of every thread.
+struct LayoutStats
+{
+  enum Phase
+  {
+    kRepulsion,        // FR
+    kAttraction,       // FR
+    kCapping,          // FR
+    kTreeBuild,        // FR Barnes-Hut quadtree
+    kLocalRelaxation,  // FR iterations on the vertices around an edit
+    kDistances,        // KK and stress all pairs hop distances
+    kMoves,            // KK vertex moves
+    kFindMaxEnergy,    // KK
+    kCenterAndScale,   // KK window fit
+    kSolver,           // stress majorization conjugate gradient
+    kPhaseCount
+  };
+
+  PhaseTimer    m_Phases[kPhaseCount];
+  std::uint64_t m_PairEvaluations=0;   // vertex pair (or Barnes-Hut cell) force or energy terms
+  std::uint64_t m_VerticesMoved=0;
+  std::uint64_t m_BytesAllocated=0;    // growth of the engine buffers
+
+  LayoutStats& operator+=(const LayoutStats& aOther) noexcept;
+
+  // Engine buffers only grow: their growth from aLastSize to aMemorySize is what was
+  // allocated, aLastSize then takes aMemorySize
+  void CountGrowth(std::size_t aMemorySize,std::size_t& aLastSize) noexcept;
+
+  static const char* GetPhaseName(Phase aPhase) noexcept;
+};
+
+
+
+
+// Stopwatch for phases timed by hand, Lap() returns the nanoseconds since the previous lap
+class LapTimer
+{
+public:
+
+  LapTimer() noexcept;
+  std::uint64_t Lap() noexcept;
+
+private:
+
+  std::chrono::steady_clock::time_point m_Last;
+};
+
+
+
+
+class ScopedTimer
+{
+public:
+
+  explicit ScopedTimer(PhaseTimer& aTimer) noexcept;
+  ~ScopedTimer();
+
+  ScopedTimer(const ScopedTimer&)=delete;
+  ScopedTimer& operator=(const ScopedTimer&)=delete;
+
+private:
+
+  PhaseTimer& m_Timer;
+  std::chrono::steady_clock::time_point m_Start;
+};
+
+
+
+
+inline void PhaseTimer::Add(std::uint64_t aNanoseconds) noexcept
+{
+  m_Nanoseconds+=aNanoseconds;
+  m_Calls++;
+}
+
+inline double PhaseTimer::GetMilliseconds() const noexcept
+{
+  return static_cast<double>(m_Nanoseconds)/1e6;
+}
+
+inline LapTimer::LapTimer() noexcept
+    : m_Last(std::chrono::steady_clock::now())
+{
+}
+
+inline std::uint64_t LapTimer::Lap() noexcept
+{
+  const std::chrono::steady_clock::time_point now=std::chrono::steady_clock::now();
+  const std::uint64_t nanoseconds=static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now-m_Last).count());
+  m_Last=now;
+  return nanoseconds;
+}
+
+inline ScopedTimer::ScopedTimer(PhaseTimer& aTimer) noexcept
+    : m_Timer(aTimer)
+    , m_Start(std::chrono::steady_clock::now())
+{
+}
+
+inline ScopedTimer::~ScopedTimer()
+{
+  m_Timer.Add(static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now()-m_Start).count()));
+}
+
+inline LayoutStats& LayoutStats::operator+=(const LayoutStats& aOther) noexcept
+{
+  for(int phase=0; phase<kPhaseCount; phase++)
+    {
+      m_Phases[phase].m_Nanoseconds+=aOther.m_Phases[phase].m_Nanoseconds;
+      m_Phases[phase].m_Calls+=aOther.m_Phases[phase].m_Calls;
+    }
+  m_PairEvaluations+=aOther.m_PairEvaluations;
+  m_VerticesMoved+=aOther.m_VerticesMoved;
+  m_BytesAllocated+=aOther.m_BytesAllocated;
+  return *this;
+}
+
+inline void LayoutStats::CountGrowth(std::size_t aMemorySize,std::size_t& aLastSize) noexcept
+{
+  if(aMemorySize>aLastSize)
+    {
+      m_BytesAllocated+=aMemorySize-aLastSize;
+    }
+  aLastSize=aMemorySize;
+}
+
+inline const char* LayoutStats::GetPhaseName(Phase aPhase) noexcept
+{
+  static const char* const kNames[kPhaseCount]=
+  {
+    "Repulsion","Attraction","Capping","Tree build","Local relaxation","Distances","Moves","Find max energy","Center and scale","Solver"
+  };
+  return aPhase<kPhaseCount ? kNames[aPhase] : "";
+}
+
+
+}
@@ -0,0 +1,176 @@
+#include "layout_worker.hpp"
+
+namespace nodesoup
+{
+
+
+LayoutWorker::LayoutWorker(std::chrono::microseconds aStepInterval)
+    : m_StepInterval(aStepInterval)
+    , m_Stop(false)
+    , m_Back(0)
+    , m_Front(1)
+    , m_Middle(2)
+    , m_Energy(0.0)
+    , m_StepCount(0)
+    , m_IsIdle(false)
+{
+}
+
+
+
+
+LayoutWorker::~LayoutWorker()
+{
+  Stop();
+}
+
+
+
+
+void LayoutWorker::Start(const std::vector<NsPosition>& aPositions,init_func_t aInit,step_func_t aStep,move_func_t aMove
+                         ,idle_func_t aIdle)
+{
+  Stop();
+
+  m_Init=std::move(aInit);
+  m_Step=std::move(aStep);
+  m_Move=std::move(aMove);
+  m_Idle=std::move(aIdle);
+
+  for(std::vector<NsPosition>& buffer:m_Buffers)
+    {
+      buffer=aPositions;
+    }
+  m_WorkPositions=aPositions;
+  m_Back=0;
+  m_Front=1;
+  m_Middle.store(2,std::memory_order_relaxed);
+
+  m_Energy.store(0.0,std::memory_order_relaxed);
+  m_StepCount.store(0,std::memory_order_relaxed);
+  m_IsIdle.store(false,std::memory_order_relaxed);
+  m_Stop.store(false,std::memory_order_relaxed);
+
+  m_Thread=std::thread(&LayoutWorker::Run,this);
+}
+
+
+
+
+void LayoutWorker::Stop()
+{
+  if(!m_Thread.joinable())
+    {
+      return;
+    }
+
+  m_Stop.store(true,std::memory_order_release);
+  m_Thread.join();
+
+  m_Commands.Clear();
+  m_Pending.clear();
+  for(std::vector<NsPosition>& buffer:m_Buffers)
+    {
+      buffer.clear();
+    }
+}
+
+
+
+
+const std::vector<NsPosition>& LayoutWorker::GetPositions()
+{
+  FlushPending();
+
+  if(m_Middle.load(std::memory_order_relaxed)&kDirty)
+    {
+      m_Front=m_Middle.exchange(m_Front,std::memory_order_acq_rel)&~kDirty;
+    }
+
+  return m_Buffers[m_Front];
+}
+
+
+
+
+void LayoutWorker::MovePos(vertex_id_t aVertexId,const NsVec2& aDisp,bool aRecalculate)
+{
+  if(!IsRunning())
+    {
+      return;
+    }
+
+  FlushPending();
+
+  // Commands keep their order: once one waits, the following ones wait too
+  const Command command{aVertexId,aDisp,aRecalculate};
+  if(!m_Pending.empty() || !m_Commands.Push(command))
+    {
+      m_Pending.push_back(command);
+    }
+}
+
+
+
+
+void LayoutWorker::FlushPending()
+{
+  std::size_t pushed=0;
+  while(pushed<m_Pending.size() && m_Commands.Push(m_Pending[pushed]))
+    {
+      pushed++;
+    }
+  m_Pending.erase(m_Pending.begin(),m_Pending.begin()+pushed);
+}
+
+
+
+
+void LayoutWorker::Run()
+{
+  if(m_Init)
+    {
+      m_Init();
+    }
+
+  auto next_step=std::chrono::steady_clock::now();
+  while(!m_Stop.load(std::memory_order_acquire))
+    {
+      Command command;
+      bool moved=false;
+      while(m_Commands.Pop(command))
+        {
+          m_Move(command.m_VertexId,command.m_Disp,command.m_Recalculate);
+          moved=true;
+        }
+
+      // Idle engines only wake up for the commands, checked every interval. A command
+      // always gets its frame, even when the engine stays converged.
+      const bool idle=!moved && m_Idle && m_Idle();
+      m_IsIdle.store(idle,std::memory_order_relaxed);
+      if(!idle)
+        {
+          m_Energy.store(m_Step(m_WorkPositions),std::memory_order_relaxed);
+
+          // Publish: the back buffer becomes the middle one, the previous middle one is reused.
+          // Assigned, the engine may have added or removed vertices since that buffer was used.
+          m_Buffers[m_Back]=m_WorkPositions;
+          m_Back=m_Middle.exchange(m_Back|kDirty,std::memory_order_acq_rel)&~kDirty;
+          m_StepCount.fetch_add(1,std::memory_order_relaxed);
+        }
+
+      next_step+=m_StepInterval;
+      auto now=std::chrono::steady_clock::now();
+      if(next_step>now)
+        {
+          std::this_thread::sleep_until(next_step);
+        }
+      else
+        {
+          next_step=now;
+        }
+    }
+}
+
+
+}
@@ -0,0 +1,120 @@
+#pragma once
+#include "nodesoup.hpp"
+#include "spsc_queue.hpp"
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <vector>
+
+namespace nodesoup
+{
+
+
+// Runs a layout engine on its own thread so slow steps do not stall the UI.
+// The worker publishes every step through a triple buffer: the UI always reads the newest
+// complete frame without waiting, and the worker never waits for the UI.
+// MovePos() calls go to the worker through a lock-free queue.
+// The engine must only be touched from the functions given to Start() while the worker runs.
+class LayoutWorker
+{
+public:
+
+  using init_func_t=std::function<void()>;
+  // Runs one step writing aPositions, returns the energy of the engine
+  using step_func_t=std::function<double(std::vector<NsPosition>& aPositions)>;
+  using move_func_t=std::function<void(vertex_id_t aVertexId,const NsVec2& aDisp,bool aRecalculate)>;
+  // True when the engine has nothing left to do (converged): no step runs nor frame is
+  // published until the next MovePos()
+  using idle_func_t=std::function<bool()>;
+
+  // Steps start at most every aStepInterval, so a fast engine does not take a whole core
+  explicit LayoutWorker(std::chrono::microseconds aStepInterval=std::chrono::microseconds(1000));
+  ~LayoutWorker();
+
+  LayoutWorker(const LayoutWorker&)=delete;
+  LayoutWorker& operator=(const LayoutWorker&)=delete;
+
+  // aPositions is shown until the first step, aInit runs first on the worker thread
+  // (typically the Start() of the engine)
+  void Start(const std::vector<NsPosition>& aPositions,init_func_t aInit,step_func_t aStep,move_func_t aMove
+            ,idle_func_t aIdle=nullptr);
+  // Waits for the current step and drops the frames
+  void Stop();
+  bool IsRunning() const noexcept;
+
+  // UI thread only. Newest frame, valid until the next call. Its size is the vertex count of
+  // the engine at that step, which graph edits change from one frame to the next: index it
+  // by its own size().
+  const std::vector<NsPosition>& GetPositions();
+  void MovePos(vertex_id_t aVertexId,const NsVec2& aDisp,bool aRecalculate);
+
+  double GetEnergy() const noexcept;
+  unsigned long long GetStepCount() const noexcept;
+  bool IsIdle() const noexcept;
+
+private:
+
+  struct Command
+  {
+    vertex_id_t m_VertexId;
+    NsVec2      m_Disp;
+    bool        m_Recalculate;
+  };
+
+  static constexpr unsigned int kDirty=4;
+
+  std::chrono::microseconds m_StepInterval;
+  std::thread       m_Thread;
+  std::atomic<bool> m_Stop;
+
+  init_func_t m_Init;
+  step_func_t m_Step;
+  move_func_t m_Move;
+  idle_func_t m_Idle;
+
+  // m_Buffers[m_Back] belongs to the worker, m_Buffers[m_Front] to the UI, the third one
+  // is exchanged through m_Middle (index | kDirty when it holds a frame the UI has not seen)
+  std::vector<NsPosition>   m_Buffers[3];
+  unsigned int              m_Back;
+  unsigned int              m_Front;
+  std::atomic<unsigned int> m_Middle;
+  std::vector<NsPosition>   m_WorkPositions;
+
+  SpscQueue<Command,256> m_Commands;
+  // Commands that did not fit in the queue, retried on the next UI call
+  std::vector<Command>   m_Pending;
+
+  std::atomic<double>             m_Energy;
+  std::atomic<unsigned long long> m_StepCount;
+  std::atomic<bool>               m_IsIdle;
+
+  void Run();
+  void FlushPending();
+};
+
+
+
+
+inline bool LayoutWorker::IsRunning() const noexcept
+{
+  return m_Thread.joinable();
+}
+
+inline double LayoutWorker::GetEnergy() const noexcept
+{
+  return m_Energy.load(std::memory_order_relaxed);
+}
+
+inline unsigned long long LayoutWorker::GetStepCount() const noexcept
+{
+  return m_StepCount.load(std::memory_order_relaxed);
+}
+
+inline bool LayoutWorker::IsIdle() const noexcept
+{
+  return m_IsIdle.load(std::memory_order_relaxed);
+}
+
+
+}
@@ -0,0 +1,157 @@
+#include "mapped_file.hpp"
+
+#ifdef _WIN32
+  #define WIN32_LEAN_AND_MEAN
+  #include <windows.h>
+#else
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+namespace nodesoup
+{
+
+
+MappedFile::~MappedFile()
+{
+  Close();
+}
+
+
+
+
+#ifdef _WIN32
+
+bool MappedFile::Open(const char* aPath)
+{
+  Close();
+
+  HANDLE file=CreateFileA(aPath,GENERIC_READ,FILE_SHARE_READ,nullptr,OPEN_EXISTING,FILE_FLAG_SEQUENTIAL_SCAN,nullptr);
+  if(file==INVALID_HANDLE_VALUE)
+    {
+      return false;
+    }
+
+  LARGE_INTEGER size;
+  if(!GetFileSizeEx(file,&size))
+    {
+      CloseHandle(file);
+      return false;
+    }
+
+  m_File=file;
+  m_Size=static_cast<std::size_t>(size.QuadPart);
+  m_Open=true;
+
+  // Empty files cannot be mapped, they are just empty
+  if(m_Size==0)
+    {
+      return true;
+    }
+
+  m_Mapping=CreateFileMappingA(file,nullptr,PAGE_READONLY,0,0,nullptr);
+  if(m_Mapping)
+    {
+      m_Data=static_cast<const char*>(MapViewOfFile(m_Mapping,FILE_MAP_READ,0,0,0));
+    }
+
+  if(!m_Data)
+    {
+      Close();
+      return false;
+    }
+
+  return true;
+}
+
+
+
+
+void MappedFile::Close() noexcept
+{
+  if(m_Data)
+    {
+      UnmapViewOfFile(m_Data);
+    }
+  if(m_Mapping)
+    {
+      CloseHandle(m_Mapping);
+    }
+  if(m_File)
+    {
+      CloseHandle(m_File);
+    }
+
+  m_Data=nullptr;
+  m_Mapping=nullptr;
+  m_File=nullptr;
+  m_Size=0;
+  m_Open=false;
+}
+
+#else
+
+bool MappedFile::Open(const char* aPath)
+{
+  Close();
+
+  int fd=open(aPath,O_RDONLY);
+  if(fd<0)
+    {
+      return false;
+    }
+
+  struct stat file_stat;
+  if(fstat(fd,&file_stat)!=0)
+    {
+      close(fd);
+      return false;
+    }
+
+  m_Size=static_cast<std::size_t>(file_stat.st_size);
+  m_Open=true;
+
+  // Empty files cannot be mapped, they are just empty
+  if(m_Size==0)
+    {
+      close(fd);
+      return true;
+    }
+
+  void* data=mmap(nullptr,m_Size,PROT_READ,MAP_PRIVATE,fd,0);
+  // The mapping keeps its own reference to the file
+  close(fd);
+
+  if(data==MAP_FAILED)
+    {
+      m_Size=0;
+      m_Open=false;
+      return false;
+    }
+
+  madvise(data,m_Size,MADV_SEQUENTIAL);
+  m_Data=static_cast<const char*>(data);
+  return true;
+}
+
+
+
+
+void MappedFile::Close() noexcept
+{
+  if(m_Data)
+    {
+      munmap(const_cast<char*>(m_Data),m_Size);
+    }
+
+  m_Data=nullptr;
+  m_Size=0;
+  m_Open=false;
+}
+
+#endif
+
+
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <cstddef>
+#include <string_view>
+
+namespace nodesoup
+{
+
+
+// Read-only memory mapping of a whole file, the data stays valid until Close() or destruction
+class MappedFile
+{
+public:
+
+  MappedFile() noexcept=default;
+  ~MappedFile();
+
+  MappedFile(const MappedFile&)=delete;
+  MappedFile& operator=(const MappedFile&)=delete;
+
+  // False if the file cannot be opened or mapped
+  bool Open(const char* aPath);
+  void Close() noexcept;
+
+  bool             IsOpen() const noexcept;
+  const char*      GetData() const noexcept;
+  std::size_t      GetSize() const noexcept;
+  std::string_view GetView() const noexcept;
+
+private:
+
+  const char* m_Data=nullptr;
+  std::size_t m_Size=0;
+  bool        m_Open=false;
+#ifdef _WIN32
+  void* m_File=nullptr;
+  void* m_Mapping=nullptr;
+#endif
+};
+
+
+
+
+inline bool MappedFile::IsOpen() const noexcept
+{
+  return m_Open;
+}
+
+inline const char* MappedFile::GetData() const noexcept
+{
+  return m_Data;
+}
+
+inline std::size_t MappedFile::GetSize() const noexcept
+{
+  return m_Size;
+}
+
+inline std::string_view MappedFile::GetView() const noexcept
+{
+  return {m_Data,m_Size};
+}
+
+
+}
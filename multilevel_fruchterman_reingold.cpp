@@ -0,0 +1,448 @@
+#include "multilevel_fruchterman_reingold.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace nodesoup
+{
+
+
+constexpr csr_id_t kNoVertex=std::numeric_limits<csr_id_t>::max();
+
+
+
+
+MultilevelFruchtermanReingold::MultilevelFruchtermanReingold(const adj_list_t& aAdjList,double aK,double aTheta)
+    : m_AdjList(&aAdjList)
+    , m_Graph(&m_OwnGraph)
+    , m_K(aK)
+    , m_Theta(aTheta)
+    , m_LocalRelaxation(true)
+    , m_Level(0)
+    , m_LevelIter(0)
+    , m_CurrIter(0)
+{
+}
+
+
+
+
+MultilevelFruchtermanReingold::MultilevelFruchtermanReingold(const CsrGraph& aGraph,double aK,double aTheta)
+    : m_AdjList(nullptr)
+    , m_Graph(&aGraph)
+    , m_K(aK)
+    , m_Theta(aTheta)
+    , m_LocalRelaxation(true)
+    , m_Level(0)
+    , m_LevelIter(0)
+    , m_CurrIter(0)
+{
+}
+
+
+
+
+void MultilevelFruchtermanReingold::Start(bool aStartCircle)
+{
+  Start(aStartCircle ? InitMode::kCircle : InitMode::kRandom);
+}
+
+
+
+
+void MultilevelFruchtermanReingold::Start(InitMode aInitMode)
+{
+  if(m_AdjList)
+    {
+      m_OwnGraph.Assign(*m_AdjList);
+    }
+
+  m_CoarseGraphs.clear();
+  m_Parents.clear();
+  ResetLayout(nullptr);
+  m_Level=0;
+  m_LevelIter=0;
+  m_CurrIter=0;
+
+  if(m_Graph->IsEmpty())
+    {
+      return;
+    }
+
+  while(GetGraph(GetLevelCount()-1).GetVertexCount()>kMinCoarseVertices && Coarsen())
+    {
+    }
+
+  // The coarsest level starts as FruchtermanReingold does, spread to the size of its layout
+  const std::size_t coarsest=GetLevelCount()-1;
+  const std::size_t vertex_count=GetGraph(coarsest).GetVertexCount();
+  const float scale=static_cast<float>(GetLevelK(coarsest)*sqrt(vertex_count));
+
+  m_CoarsePositions.resize(vertex_count);
+  nodesoup::SetInitPositions(aInitMode,GetGraph(coarsest),m_CoarsePositions);
+  for(NsPosition& pos:m_CoarsePositions)
+    {
+      pos.m_Pos*=scale;
+    }
+
+  StartLevel(coarsest,m_CoarsePositions,scale);
+}
+
+
+
+
+// Warm start: there is no need to coarsen a settled layout, it goes on as FruchtermanReingold
+void MultilevelFruchtermanReingold::Start(const std::vector<NsPosition>& aPositions,double aTemperature)
+{
+  if(m_AdjList)
+    {
+      m_OwnGraph.Assign(*m_AdjList);
+    }
+
+  m_CoarseGraphs.clear();
+  m_Parents.clear();
+  ResetLayout(nullptr);
+  m_CurrIter=0;
+
+  if(m_Graph->IsEmpty())
+    {
+      return;
+    }
+
+  StartLevel(0,aPositions,aTemperature);
+  // Single level: the coarsest one, already refined
+  m_LevelIter=kCoarsestIterations;
+}
+
+
+
+
+// Contracts a maximal matching of the coarsest graph into a new level.
+// Vertices are matched lowest degree first with their lowest degree free neighbor, so hubs
+// are left for last and the coarse graph stays balanced.
+// Returns false, without adding a level, when the graph does not shrink enough
+// (stars and other graphs with few independent edges).
+bool MultilevelFruchtermanReingold::Coarsen()
+{
+  const CsrGraph& fine=GetGraph(GetLevelCount()-1);
+  const std::size_t fine_count=fine.GetVertexCount();
+
+  std::vector<csr_id_t> order(fine_count);
+  for(csr_id_t v_id=0; v_id<fine_count; v_id++)
+    {
+      order[v_id]=v_id;
+    }
+  std::stable_sort(order.begin(),order.end(),[&fine](csr_id_t aLhs,csr_id_t aRhs)
+  {
+    return fine.GetDegree(aLhs)<fine.GetDegree(aRhs);
+  });
+
+  std::vector<csr_id_t> mates(fine_count,kNoVertex);
+  std::size_t coarse_count=0;
+  for(csr_id_t v_id:order)
+    {
+      if(mates[v_id]!=kNoVertex)
+        {
+          continue;
+        }
+
+      csr_id_t mate_id=v_id;
+      for(csr_id_t adj_id:fine.GetNeighbors(v_id))
+        {
+          if(mates[adj_id]==kNoVertex && adj_id!=v_id && (mate_id==v_id || fine.GetDegree(adj_id)<fine.GetDegree(mate_id)))
+            {
+              mate_id=adj_id;
+            }
+        }
+
+      mates[v_id]=mate_id;
+      mates[mate_id]=v_id;
+      coarse_count++;
+    }
+
+  if(coarse_count*4>fine_count*3)
+    {
+      return false;
+    }
+
+  // Coarse vertices are numbered in the order of their lowest child, keeping the locality of the ids
+  std::vector<csr_id_t> parents(fine_count);
+  std::vector<csr_id_t> children(2*coarse_count);
+  csr_id_t coarse_id=0;
+  for(csr_id_t v_id=0; v_id<fine_count; v_id++)
+    {
+      if(v_id<=mates[v_id])
+        {
+          parents[v_id]=parents[mates[v_id]]=coarse_id;
+          children[2*coarse_id]=v_id;
+          children[2*coarse_id+1]=mates[v_id];
+          coarse_id++;
+        }
+    }
+
+  // Arcs between the children of different parents, once per pair of parents
+  std::vector<csr_id_t> offsets(coarse_count+1);
+  std::vector<csr_id_t> targets;
+  targets.reserve(fine.GetArcCount());
+  std::vector<csr_id_t> last_seen(coarse_count,kNoVertex);
+
+  for(csr_id_t c_id=0; c_id<coarse_count; c_id++)
+    {
+      offsets[c_id]=static_cast<csr_id_t>(targets.size());
+
+      for(int child=0; child<2; child++)
+        {
+          csr_id_t v_id=children[2*c_id+child];
+          if(child==1 && v_id==children[2*c_id])
+            {
+              break;
+            }
+
+          for(csr_id_t adj_id:fine.GetNeighbors(v_id))
+            {
+              csr_id_t adj_parent=parents[adj_id];
+              if(adj_parent!=c_id && last_seen[adj_parent]!=c_id)
+                {
+                  last_seen[adj_parent]=c_id;
+                  targets.push_back(adj_parent);
+                }
+            }
+        }
+    }
+  offsets[coarse_count]=static_cast<csr_id_t>(targets.size());
+
+  m_Parents.push_back(std::move(parents));
+  m_CoarseGraphs.emplace_back();
+  m_CoarseGraphs.back().Assign(std::move(offsets),std::move(targets));
+
+  return true;
+}
+
+
+
+
+// Natural edge length of each level, grows by sqrt(7/4) per level as the coarse vertices
+// stand for more and more vertices of the graph
+double MultilevelFruchtermanReingold::GetLevelK(std::size_t aLevel) const noexcept
+{
+  return m_K*pow(1.75,0.5*aLevel);
+}
+
+
+
+
+// Keeps the stats of the layout being replaced
+void MultilevelFruchtermanReingold::ResetLayout(FruchtermanReingold* aLayout)
+{
+  if(m_Layout)
+    {
+      m_LevelStats+=m_Layout->GetStats();
+    }
+  m_Layout.reset(aLayout);
+}
+
+
+
+
+void MultilevelFruchtermanReingold::StartLevel(std::size_t aLevel,const std::vector<NsPosition>& aPositions,double aTemperature)
+{
+  ResetLayout(new FruchtermanReingold(GetGraph(aLevel),GetLevelK(aLevel),m_Theta));
+  m_Layout->SetLocalRelaxation(m_LocalRelaxation);
+  m_Layout->Start(aPositions,aTemperature);
+
+  m_Level=aLevel;
+  m_LevelIter=0;
+}
+
+
+
+
+// Every vertex of aLevel starts at its parent on aLevel+1, slightly offset so that both
+// children of a parent do not overlap (vertices at the same position do not repel each other)
+void MultilevelFruchtermanReingold::Prolong(std::size_t aLevel,const std::vector<NsPosition>& aCoarse
+                                            ,std::vector<NsPosition>& aFine) const
+{
+  constexpr float kGoldenAngle=2.39996322972865332f;
+
+  const std::vector<csr_id_t>& parents=m_Parents[aLevel];
+  const float offset=static_cast<float>(0.25*GetLevelK(aLevel));
+
+  aFine.resize(parents.size());
+  for(vertex_id_t v_id=0; v_id<parents.size(); v_id++)
+    {
+      const NsPosition& parent_pos=aCoarse[parents[v_id]];
+      float angle=static_cast<float>(v_id % 65536)*kGoldenAngle;
+
+      aFine[v_id].m_Pos=parent_pos.m_Pos+NsVec2(offset*cosf(angle),offset*sinf(angle));
+      aFine[v_id].m_Fixed=parent_pos.m_Fixed;
+    }
+}
+
+
+
+
+// Vertices of the graph are shown at the position their coarse vertex would give them.
+// Prolong() has no radiuses to carry: a vector without one position per vertex gets the
+// ones of SetRadiuses(), a sized one keeps its own.
+void MultilevelFruchtermanReingold::StorePositions(std::vector<NsPosition>& aPositions)
+{
+  const bool set_radiuses=(aPositions.size()!=m_Graph->GetVertexCount());
+  if(m_Level==0)
+    {
+      m_Layout->GetPositions(aPositions);
+    }
+  else
+    {
+      m_Layout->GetPositions(m_CoarsePositions);
+      for(std::size_t level=m_Level-1; level>0; level--)
+        {
+          Prolong(level,m_CoarsePositions,m_FinePositions);
+          std::swap(m_CoarsePositions,m_FinePositions);
+        }
+
+      Prolong(0,m_CoarsePositions,aPositions);
+    }
+
+  if(set_radiuses)
+    {
+      SetRadiuses(*m_Graph,aPositions);
+    }
+}
+
+
+
+
+void MultilevelFruchtermanReingold::Step(int aStepSize,int aMaxStep,std::vector<NsPosition>& aPositions)
+{
+  if(!m_Layout)
+    {
+      return;
+    }
+
+  const int level_iters=(m_Level==GetLevelCount()-1 ? kCoarsestIterations : kLevelIterations);
+  if(m_LevelIter>=level_iters)
+    {
+      m_Layout->Step(aStepSize,aMaxStep,aPositions);
+      return;
+    }
+
+  int iterations=std::min(aStepSize,level_iters-m_LevelIter);
+  m_Layout->Iterate(iterations);
+  m_LevelIter+=iterations;
+  m_CurrIter+=iterations;
+
+  if(m_LevelIter>=level_iters && m_Level>0)
+    {
+      // Fixed vertices of a coarse level are released on the finer one
+      m_Layout->GetPositions(m_CoarsePositions);
+      Prolong(m_Level-1,m_CoarsePositions,m_FinePositions);
+      for(NsPosition& pos:m_FinePositions)
+        {
+          pos.m_Fixed=false;
+        }
+
+      StartLevel(m_Level-1,m_FinePositions,GetLevelK(m_Level-1));
+    }
+
+  StorePositions(aPositions);
+}
+
+
+
+
+void MultilevelFruchtermanReingold::MovePos(vertex_id_t aVertexId,const NsVec2& aDisp,bool aRecalculate)
+{
+  if(!m_Layout)
+    {
+      return;
+    }
+
+  vertex_id_t level_id=aVertexId;
+  for(std::size_t level=0; level<m_Level; level++)
+    {
+      level_id=m_Parents[level][level_id];
+    }
+
+  m_Layout->MovePos(level_id,aDisp,aRecalculate);
+}
+
+
+
+
+double MultilevelFruchtermanReingold::GetEnergy() const noexcept
+{
+  return m_Layout ? m_Layout->GetEnergy() : 0.0;
+}
+
+
+
+
+double MultilevelFruchtermanReingold::GetTemperature() const noexcept
+{
+  return m_Layout ? m_Layout->GetTemperature() : 0.0;
+}
+
+
+
+
+bool MultilevelFruchtermanReingold::IsConverged() const noexcept
+{
+  if(!m_Layout)
+    {
+      return true;
+    }
+  const int level_iters=(m_Level==GetLevelCount()-1 ? kCoarsestIterations : kLevelIterations);
+  return m_Level==0 && m_LevelIter>=level_iters && m_Layout->IsConverged();
+}
+
+
+
+
+LayoutStats MultilevelFruchtermanReingold::GetStats() const noexcept
+{
+  LayoutStats stats=m_LevelStats;
+  if(m_Layout)
+    {
+      stats+=m_Layout->GetStats();
+    }
+  return stats;
+}
+
+
+
+
+void MultilevelFruchtermanReingold::ResetStats() noexcept
+{
+  m_LevelStats=LayoutStats();
+  if(m_Layout)
+    {
+      m_Layout->ResetStats();
+    }
+}
+
+
+
+
+void MultilevelFruchtermanReingold::SetTheta(double aTheta) noexcept
+{
+  m_Theta=aTheta;
+  if(m_Layout)
+    {
+      m_Layout->SetTheta(aTheta);
+    }
+}
+
+
+
+
+void MultilevelFruchtermanReingold::SetLocalRelaxation(bool aLocal) noexcept
+{
+  m_LocalRelaxation=aLocal;
+  if(m_Layout)
+    {
+      m_Layout->SetLocalRelaxation(aLocal);
+    }
+}
+
+
+}
@@ -0,0 +1,130 @@
+#pragma once
+#include "nodesoup.hpp"
+#include "csr_graph.hpp"
+#include "fruchterman_reingold.hpp"
+#include <memory>
+#include <vector>
+
+namespace nodesoup
+{
+// Multilevel Fruchterman-Reingold (Walshaw, "A multilevel algorithm for force-directed graph drawing").
+// The graph is coarsened by maximal matchings until it is small, the coarsest graph is laid out
+// from scratch and every finer graph starts from the positions of the coarser one.
+
+
+
+class MultilevelFruchtermanReingold
+{
+public:
+
+  MultilevelFruchtermanReingold(const adj_list_t& aAdjList,double aK=15.0,double aTheta=0.0);
+  MultilevelFruchtermanReingold(const CsrGraph& aGraph,double aK=15.0,double aTheta=0.0);
+
+  void Start(bool aStartCircle=true);
+  void Start(InitMode aInitMode);
+  // Warm start of the finest level only, see FruchtermanReingold::Start()
+  void Start(const std::vector<NsPosition>& aPositions,double aTemperature);
+  // Each call runs up to aStepSize iterations of the current level. Once the finest level is
+  // refined, it behaves as FruchtermanReingold::Step().
+  void Step(int aStepSize,int aMaxStep,std::vector<NsPosition>& aPositions);
+
+  // On coarse levels the vertex containing aVertexId is moved
+  void MovePos(vertex_id_t aVertexId,const NsVec2& aDisp,bool aRecalculate);
+
+  int GetCurrIter() const noexcept;
+  double GetEnergy() const noexcept;
+  double GetTemperature() const noexcept;
+  // The finest level is refined and converged, see FruchtermanReingold::IsConverged()
+  bool   IsConverged() const noexcept;
+
+  double GetTheta() const noexcept;
+  void   SetTheta(double aTheta) noexcept;
+
+  // See FruchtermanReingold::SetLocalRelaxation(), applied to every level
+  bool GetLocalRelaxation() const noexcept;
+  void SetLocalRelaxation(bool aLocal) noexcept;
+
+  // Stats of every level laid out so far, see layout_stats.hpp
+  LayoutStats GetStats() const noexcept;
+  void        ResetStats() noexcept;
+
+  // Level 0 is the graph itself
+  std::size_t GetLevel() const noexcept;
+  std::size_t GetLevelCount() const noexcept;
+
+  // Coarsening stops below this size, or when a matching shrinks the graph less than 25%
+  static constexpr std::size_t kMinCoarseVertices=32;
+  static constexpr int kCoarsestIterations=80;
+  static constexpr int kLevelIterations=30;
+
+private:
+
+  // Graphs are read on Start(), an adjacency list is converted to m_OwnGraph
+  const adj_list_t* m_AdjList;
+  const CsrGraph*   m_Graph;
+  CsrGraph          m_OwnGraph;
+  double m_K;
+  double m_Theta;
+  bool   m_LocalRelaxation;
+
+  // m_CoarseGraphs[l-1] is level l, m_Parents[l] maps the vertices of level l to level l+1
+  std::vector<CsrGraph>              m_CoarseGraphs;
+  std::vector<std::vector<csr_id_t>> m_Parents;
+
+  // Layout of the current level, recreated when moving to a finer one
+  std::unique_ptr<FruchtermanReingold> m_Layout;
+  // Stats of the layouts of previous levels
+  LayoutStats m_LevelStats;
+  std::size_t m_Level;
+  int m_LevelIter;
+  int m_CurrIter;
+
+  std::vector<NsPosition> m_CoarsePositions;
+  std::vector<NsPosition> m_FinePositions;
+
+  const CsrGraph& GetGraph(std::size_t aLevel) const noexcept;
+  double GetLevelK(std::size_t aLevel) const noexcept;
+  bool Coarsen();
+  void ResetLayout(FruchtermanReingold* aLayout);
+  void StartLevel(std::size_t aLevel,const std::vector<NsPosition>& aPositions,double aTemperature);
+  void Prolong(std::size_t aLevel,const std::vector<NsPosition>& aCoarse,std::vector<NsPosition>& aFine) const;
+  void StorePositions(std::vector<NsPosition>& aPositions);
+};
+
+
+
+
+inline int MultilevelFruchtermanReingold::GetCurrIter() const noexcept
+{
+  return m_CurrIter;
+}
+
+inline double MultilevelFruchtermanReingold::GetTheta() const noexcept
+{
+  return m_Theta;
+}
+
+inline bool MultilevelFruchtermanReingold::GetLocalRelaxation() const noexcept
+{
+  return m_LocalRelaxation;
+}
+
+inline std::size_t MultilevelFruchtermanReingold::GetLevel() const noexcept
+{
+  return m_Level;
+}
+
+inline std::size_t MultilevelFruchtermanReingold::GetLevelCount() const noexcept
+{
+  return m_CoarseGraphs.size()+1;
+}
+
+inline const CsrGraph& MultilevelFruchtermanReingold::GetGraph(std::size_t aLevel) const noexcept
+{
+  return aLevel ? m_CoarseGraphs[aLevel-1] : *m_Graph;
+}
+
+
+
+
+}
@@ -1,5 +1,7 @@
 
 #include "nodesoup.hpp"
+#include "csr_graph.hpp"
+#include "pivot_mds.hpp"
 #include <cmath>
 #include <cassert>
 
@@ -28,17 +30,44 @@ void SetRadiuses(const adj_list_t& aAdjList,std::vector<NsPosition>& aPositions,
 
 
 
-void SetInitPositions(bool aCircleMode, std::vector<NsPosition>& aPositions)
+void SetRadiuses(const CsrGraph& aGraph,std::vector<NsPosition>& aPositions,float aMinRadius,float aK)
 {
-  constexpr float kPIf=3.14159265358979323846f;
+  assert(aPositions.size() == aGraph.GetVertexCount());
+
+  for (vertex_id_t v_id=0; v_id<aGraph.GetVertexCount(); v_id++)
+    {
+      float delta = log2f(aK * aGraph.GetDegree(v_id) / aGraph.GetVertexCount());
+      float radius = aMinRadius + 2.0f*std::max(0.0f, delta);
+      aPositions[v_id].m_Radius=radius;
+    }
+}
+
+
+
+
+template<typename Scalar,int Dim>
+void SetInitPositions(bool aCircleMode,std::vector<NsBasicPosition<Scalar,Dim>>& aPositions)
+{
+  constexpr Scalar kPI=static_cast<Scalar>(3.14159265358979323846);
 
   if(aCircleMode)
     {
-      float angle = 2.0f*kPIf/aPositions.size();
+      Scalar angle = 2*kPI/aPositions.size();
       for (vertex_id_t v_id=0; v_id<aPositions.size(); v_id++)
         {
-          aPositions[v_id].m_Pos.x=cosf(v_id*angle);
-          aPositions[v_id].m_Pos.y=sinf(v_id*angle);
+          if constexpr(Dim==2)
+            {
+              aPositions[v_id].m_Pos.x=std::cos(v_id*angle);
+              aPositions[v_id].m_Pos.y=std::sin(v_id*angle);
+            }
+          else
+            {
+              // Fibonacci lattice: evenly spaced heights, golden angle turns
+              const Scalar z=1-(2*v_id+1)/static_cast<Scalar>(aPositions.size());
+              const Scalar radius=std::sqrt(1-z*z);
+              const Scalar turn=v_id*kPI*(3-std::sqrt(Scalar(5)));
+              aPositions[v_id].m_Pos=NsVec<Scalar,Dim>(radius*std::cos(turn),radius*std::sin(turn),z);
+            }
           aPositions[v_id].m_Fixed=false;
         }
     }
@@ -46,11 +75,10 @@ void SetInitPositions(bool aCircleMode, std::vector<NsPosition>& aPositions)
     {
       for(vertex_id_t v_id=0; v_id<aPositions.size(); v_id++)
         {
-          float v1=(static_cast<float>(rand())/static_cast<float>(RAND_MAX));
-          float v2=(static_cast<float>(rand())/static_cast<float>(RAND_MAX));
-
-          aPositions[v_id].m_Pos.x=v1;
-          aPositions[v_id].m_Pos.y=v2;
+          for(int axis=0; axis<Dim; axis++)
+            {
+              aPositions[v_id].m_Pos[axis]=static_cast<Scalar>(rand())/static_cast<Scalar>(RAND_MAX);
+            }
           aPositions[v_id].m_Fixed=false;
         }
     }
@@ -58,4 +86,31 @@ void SetInitPositions(bool aCircleMode, std::vector<NsPosition>& aPositions)
 
 
 
+
+template<typename Scalar,typename Index,int Dim>
+void SetInitPositions(InitMode aInitMode,const BasicCsrGraph<Index>& aGraph,std::vector<NsBasicPosition<Scalar,Dim>>& aPositions)
+{
+  if(aInitMode==InitMode::kPivotMds)
+    {
+      SetPivotMdsPositions(aGraph,aPositions);
+      return;
+    }
+
+  SetInitPositions(aInitMode==InitMode::kCircle,aPositions);
+}
+
+
+
+
+#define NODESOUP_INSTANTIATE_(aScalar,aIndex,aDim) \
+  template void SetInitPositions(InitMode,const BasicCsrGraph<aIndex>&,std::vector<NsBasicPosition<aScalar,aDim>>&);
+NODESOUP_FOR_EACH_LAYOUT_TYPE(NODESOUP_INSTANTIATE_)
+#undef NODESOUP_INSTANTIATE_
+
+template void SetInitPositions(bool,std::vector<NsBasicPosition<float,2>>&);
+template void SetInitPositions(bool,std::vector<NsBasicPosition<double,2>>&);
+template void SetInitPositions(bool,std::vector<NsBasicPosition<float,3>>&);
+template void SetInitPositions(bool,std::vector<NsBasicPosition<double,3>>&);
+
+
 }
@@ -1,30 +1,105 @@
 #pragma once
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
 #include <vector>
 
-#define IMGUI_DEFINE_MATH_OPERATORS
-#include "imgui_internal.h"
 
 
+// Vectors of the layouts, with the members and operators of ImVec2 so the engines build
+// without dear imgui. nodesoup_imgui.hpp converts NsVec2 to and from ImVec2.
+// Scalar is float or double, Dim 2 or 3.
+template<typename Scalar,int Dim> struct NsVec;
 
-struct NsPosition
+template<typename Scalar>
+struct NsVec<Scalar,2>
 {
-  ImVec2 m_Pos;
-  float  m_Radius;
-  bool   m_Fixed;
+  using scalar_t=Scalar;
+  static constexpr int kDim=2;
+
+  Scalar x,y;
+
+  constexpr NsVec() noexcept : x(0), y(0) {}
+  constexpr NsVec(Scalar aX,Scalar aY) noexcept : x(aX), y(aY) {}
+
+  constexpr Scalar  operator[](int aAxis) const noexcept { return aAxis==0 ? x : y; }
+  constexpr Scalar& operator[](int aAxis) noexcept       { return aAxis==0 ? x : y; }
+};
+
+template<typename Scalar>
+struct NsVec<Scalar,3>
+{
+  using scalar_t=Scalar;
+  static constexpr int kDim=3;
+
+  Scalar x,y,z;
+
+  constexpr NsVec() noexcept : x(0), y(0), z(0) {}
+  constexpr NsVec(Scalar aX,Scalar aY,Scalar aZ) noexcept : x(aX), y(aY), z(aZ) {}
+
+  constexpr Scalar  operator[](int aAxis) const noexcept { return aAxis==0 ? x : (aAxis==1 ? y : z); }
+  constexpr Scalar& operator[](int aAxis) noexcept       { return aAxis==0 ? x : (aAxis==1 ? y : z); }
 };
 
+using NsVec2=NsVec<float,2>;
+using NsVec3=NsVec<float,3>;
+
+
+// The scalar operand is not deduced, so vec*2.0 works on float vectors as it did on ImVec2
+template<typename S,int D> constexpr NsVec<S,D> operator*(const NsVec<S,D>& aLhs,typename NsVec<S,D>::scalar_t aRhs) noexcept { NsVec<S,D> res; for(int a=0; a<D; a++) { res[a]=aLhs[a]*aRhs; } return res; }
+template<typename S,int D> constexpr NsVec<S,D> operator/(const NsVec<S,D>& aLhs,typename NsVec<S,D>::scalar_t aRhs) noexcept { NsVec<S,D> res; for(int a=0; a<D; a++) { res[a]=aLhs[a]/aRhs; } return res; }
+template<typename S,int D> constexpr NsVec<S,D> operator+(const NsVec<S,D>& aLhs,const NsVec<S,D>& aRhs) noexcept { NsVec<S,D> res; for(int a=0; a<D; a++) { res[a]=aLhs[a]+aRhs[a]; } return res; }
+template<typename S,int D> constexpr NsVec<S,D> operator-(const NsVec<S,D>& aLhs,const NsVec<S,D>& aRhs) noexcept { NsVec<S,D> res; for(int a=0; a<D; a++) { res[a]=aLhs[a]-aRhs[a]; } return res; }
+template<typename S,int D> constexpr NsVec<S,D> operator*(const NsVec<S,D>& aLhs,const NsVec<S,D>& aRhs) noexcept { NsVec<S,D> res; for(int a=0; a<D; a++) { res[a]=aLhs[a]*aRhs[a]; } return res; }
+template<typename S,int D> constexpr NsVec<S,D> operator/(const NsVec<S,D>& aLhs,const NsVec<S,D>& aRhs) noexcept { NsVec<S,D> res; for(int a=0; a<D; a++) { res[a]=aLhs[a]/aRhs[a]; } return res; }
+template<typename S,int D> constexpr NsVec<S,D> operator-(const NsVec<S,D>& aLhs) noexcept                          { NsVec<S,D> res; for(int a=0; a<D; a++) { res[a]=-aLhs[a]; } return res; }
+
+template<typename S,int D> inline NsVec<S,D>& operator*=(NsVec<S,D>& aLhs,typename NsVec<S,D>::scalar_t aRhs) noexcept { for(int a=0; a<D; a++) { aLhs[a]*=aRhs; } return aLhs; }
+template<typename S,int D> inline NsVec<S,D>& operator/=(NsVec<S,D>& aLhs,typename NsVec<S,D>::scalar_t aRhs) noexcept { for(int a=0; a<D; a++) { aLhs[a]/=aRhs; } return aLhs; }
+template<typename S,int D> inline NsVec<S,D>& operator+=(NsVec<S,D>& aLhs,const NsVec<S,D>& aRhs) noexcept { for(int a=0; a<D; a++) { aLhs[a]+=aRhs[a]; } return aLhs; }
+template<typename S,int D> inline NsVec<S,D>& operator-=(NsVec<S,D>& aLhs,const NsVec<S,D>& aRhs) noexcept { for(int a=0; a<D; a++) { aLhs[a]-=aRhs[a]; } return aLhs; }
+template<typename S,int D> inline NsVec<S,D>& operator*=(NsVec<S,D>& aLhs,const NsVec<S,D>& aRhs) noexcept { for(int a=0; a<D; a++) { aLhs[a]*=aRhs[a]; } return aLhs; }
+template<typename S,int D> inline NsVec<S,D>& operator/=(NsVec<S,D>& aLhs,const NsVec<S,D>& aRhs) noexcept { for(int a=0; a<D; a++) { aLhs[a]/=aRhs[a]; } return aLhs; }
+
+
+
+template<typename Scalar,int Dim>
+struct NsBasicPosition
+{
+  NsVec<Scalar,Dim> m_Pos;
+  Scalar            m_Radius;
+  bool              m_Fixed;
+};
+
+using NsPosition=NsBasicPosition<float,2>;
+
 
 constexpr float kInvalidPos=-1000000.0f;
 
 
-inline double norm(const ImVec2& aImVec2) noexcept
+// Calls aMacro(Scalar,Index,Dim) for every combination the layout templates are instantiated
+// for in their .cpp files
+#define NODESOUP_FOR_EACH_LAYOUT_TYPE(aMacro) \
+  aMacro(float,std::uint32_t,2)  aMacro(float,std::uint64_t,2)  aMacro(float,std::uint32_t,3)  aMacro(float,std::uint64_t,3) \
+  aMacro(double,std::uint32_t,2) aMacro(double,std::uint64_t,2) aMacro(double,std::uint32_t,3) aMacro(double,std::uint64_t,3)
+
+
+// In the precision of the vector, float layouts do not go through double
+template<typename S,int D>
+inline S sq_norm(const NsVec<S,D>& aVec) noexcept
 {
-  return sqrt(aImVec2.x * aImVec2.x + aImVec2.y * aImVec2.y);
+  S res=0;
+  for(int a=0; a<D; a++)
+    {
+      res+=aVec[a]*aVec[a];
+    }
+  return res;
 }
 
-inline float sq_norm(const ImVec2& aImVec2) noexcept
+template<typename S,int D>
+inline S norm(const NsVec<S,D>& aVec) noexcept
 {
-  return aImVec2.x*aImVec2.x + aImVec2.y*aImVec2.y;
+  return std::sqrt(sq_norm(aVec));
 }
 
 
@@ -37,12 +112,51 @@ namespace nodesoup
 using vertex_id_t = std::size_t;
 using adj_list_t = std::vector<std::vector<vertex_id_t>>;
 
+template<typename Index> class BasicCsrGraph;
+using CsrGraph=BasicCsrGraph<std::uint32_t>;
+
+
+// Initial layout of the engines
+enum class InitMode
+{
+  kCircle,    // 1.0 radius circle
+  kRandom,    // unit square
+  kPivotMds   // Pivot MDS of the hop distances, see pivot_mds.hpp
+};
+
+
+// Unit vector for the aIndex-th of several vertices placed around a same point: golden angle
+// turns on the circle, and a spiral over the sphere in 3D
+template<typename Scalar,int Dim>
+inline NsVec<Scalar,Dim> GetSpreadDirection(std::size_t aIndex) noexcept
+{
+  constexpr Scalar kGoldenAngle=static_cast<Scalar>(2.39996322972865332);
+  constexpr Scalar kGoldenRatio=static_cast<Scalar>(0.61803398874989485);
+
+  const Scalar angle=static_cast<Scalar>(aIndex % 65536)*kGoldenAngle;
+  if constexpr(Dim==2)
+    {
+      return NsVec<Scalar,Dim>(std::cos(angle),std::sin(angle));
+    }
+  else
+    {
+      const Scalar z=2*std::fmod(static_cast<Scalar>(aIndex % 65536)*kGoldenRatio,Scalar(1))-1;
+      const Scalar radius=std::sqrt(1-z*z);
+      return NsVec<Scalar,Dim>(radius*std::cos(angle),radius*std::sin(angle),z);
+    }
+}
+
 
 // Assigns diameters to vertices based on their degree
 void SetRadiuses(const adj_list_t& aAdjList,std::vector<NsPosition>& aPositions,float aMinRadius=4.0f,float aK=300.0f);
-
-// Distribute vertices equally on a 1.0 radius circle (aCircleMode==true) or randomly in unit square (aCircleMode==false)
-void SetInitPositions(bool aCircleMode,std::vector<NsPosition>& aPositions);
+void SetRadiuses(const CsrGraph& aGraph,std::vector<NsPosition>& aPositions,float aMinRadius=4.0f,float aK=300.0f);
+
+// Distribute vertices equally on a 1.0 radius circle (aCircleMode==true) or randomly in unit square (aCircleMode==false).
+// 3D layouts get the unit sphere and the unit cube.
+template<typename Scalar,int Dim>
+void SetInitPositions(bool aCircleMode,std::vector<NsBasicPosition<Scalar,Dim>>& aPositions);
+template<typename Scalar,typename Index,int Dim>
+void SetInitPositions(InitMode aInitMode,const BasicCsrGraph<Index>& aGraph,std::vector<NsBasicPosition<Scalar,Dim>>& aPositions);
 
 }
 
@@ -0,0 +1,18 @@
+#pragma once
+#include "nodesoup.hpp"
+#include "imgui.h"
+
+// Conversions between the layout vectors and dear imgui, for the UI side only:
+// the engines themselves do not include imgui.
+
+
+
+inline ImVec2 ToImVec2(const NsVec2& aVec2) noexcept
+{
+  return ImVec2(aVec2.x,aVec2.y);
+}
+
+inline NsVec2 ToNsVec2(const ImVec2& aVec2) noexcept
+{
+  return NsVec2(aVec2.x,aVec2.y);
+}
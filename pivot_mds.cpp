@@ -0,0 +1,241 @@
+#include "pivot_mds.hpp"
+#include "shortest_paths.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace nodesoup
+{
+
+
+// Dominant eigenvector of the symmetric aSize x aSize aMatrix, orthogonal to the aOrthogonalCount
+// (orthonormal) vectors of aOrthogonalTo
+static void power_iteration_(const std::vector<double>& aMatrix,std::size_t aSize,const std::vector<double>* aOrthogonalTo
+                            ,int aOrthogonalCount,std::vector<double>& aVector)
+{
+  constexpr int kMaxIterations=200;
+
+  auto orthonormalize=[aSize,aOrthogonalTo,aOrthogonalCount](std::vector<double>& aV)
+  {
+    for(int k=0; k<aOrthogonalCount; k++)
+      {
+        const std::vector<double>& other=aOrthogonalTo[k];
+        double dot=0.0;
+        for(std::size_t i=0; i<aSize; i++)
+          {
+            dot+=aV[i]*other[i];
+          }
+        for(std::size_t i=0; i<aSize; i++)
+          {
+            aV[i]-=dot*other[i];
+          }
+      }
+
+    double sq_norm=0.0;
+    for(double value:aV)
+      {
+        sq_norm+=value*value;
+      }
+    if(sq_norm>0.0)
+      {
+        double inv_norm=1.0/sqrt(sq_norm);
+        for(double& value:aV)
+          {
+            value*=inv_norm;
+          }
+      }
+  };
+
+  // Deterministic start, unlikely to be orthogonal to the eigenvector
+  aVector.resize(aSize);
+  for(std::size_t i=0; i<aSize; i++)
+    {
+      aVector[i]=1.0/(i+1.0);
+    }
+  orthonormalize(aVector);
+
+  std::vector<double> next(aSize);
+  for(int iter=0; iter<kMaxIterations; iter++)
+    {
+      for(std::size_t i=0; i<aSize; i++)
+        {
+          double sum=0.0;
+          for(std::size_t j=0; j<aSize; j++)
+            {
+              sum+=aMatrix[i*aSize+j]*aVector[j];
+            }
+          next[i]=sum;
+        }
+      orthonormalize(next);
+
+      double change=0.0;
+      for(std::size_t i=0; i<aSize; i++)
+        {
+          change+=std::abs(next[i]-aVector[i]);
+        }
+      aVector.swap(next);
+
+      if(change<1e-9)
+        {
+          break;
+        }
+    }
+}
+
+
+
+
+template<typename Scalar,typename Index,int Dim>
+void SetPivotMdsPositions(const BasicCsrGraph<Index>& aGraph,std::vector<NsBasicPosition<Scalar,Dim>>& aPositions,std::size_t aPivotCount)
+{
+  const std::size_t vertex_count=aGraph.GetVertexCount();
+  assert(aPositions.size()==vertex_count);
+
+  if(vertex_count<3 || aGraph.GetArcCount()==0 || aPivotCount<2)
+    {
+      SetInitPositions(true,aPositions);
+      return;
+    }
+
+  const std::size_t pivot_count=std::min(aPivotCount,vertex_count);
+
+  // Hop distances to the pivots, vertex_count rows of pivot_count columns, in float as they
+  // are the bulk of the memory (200 MB for 1M vertices and 50 pivots). Sums are in double.
+  // Each pivot is the vertex farthest from the previous ones, other components first.
+  std::vector<float> columns(vertex_count*pivot_count);
+  std::vector<hop_t> distances;
+  std::vector<hop_t> min_distances(vertex_count,kUnreachable);
+  hop_t max_distance=0;
+  Index pivot_id=0;
+
+  for(std::size_t pivot=0; pivot<pivot_count; pivot++)
+    {
+      HopDistancesFrom(aGraph,pivot_id,distances);
+
+      for(vertex_id_t v_id=0; v_id<vertex_count; v_id++)
+        {
+          columns[v_id*pivot_count+pivot]=distances[v_id];
+          min_distances[v_id]=std::min(min_distances[v_id],distances[v_id]);
+          if(distances[v_id]!=kUnreachable)
+            {
+              max_distance=std::max(max_distance,distances[v_id]);
+            }
+        }
+
+      pivot_id=static_cast<Index>(std::max_element(min_distances.begin(),min_distances.end())-min_distances.begin());
+    }
+
+  // Double centering of the squared distances, unreachable pairs one hop past the farthest ones
+  std::vector<double> column_means(pivot_count,0.0);
+  for(vertex_id_t v_id=0; v_id<vertex_count; v_id++)
+    {
+      float* row=&columns[v_id*pivot_count];
+      for(std::size_t pivot=0; pivot<pivot_count; pivot++)
+        {
+          double distance=(row[pivot]==kUnreachable ? max_distance+1.0 : row[pivot]);
+          row[pivot]=static_cast<float>(distance*distance);
+          column_means[pivot]+=row[pivot];
+        }
+    }
+
+  double total_mean=0.0;
+  for(double& mean:column_means)
+    {
+      mean/=vertex_count;
+      total_mean+=mean;
+    }
+  total_mean/=pivot_count;
+
+  for(vertex_id_t v_id=0; v_id<vertex_count; v_id++)
+    {
+      float* row=&columns[v_id*pivot_count];
+      double row_mean=0.0;
+      for(std::size_t pivot=0; pivot<pivot_count; pivot++)
+        {
+          row_mean+=row[pivot];
+        }
+      row_mean/=pivot_count;
+
+      for(std::size_t pivot=0; pivot<pivot_count; pivot++)
+        {
+          row[pivot]=static_cast<float>(-0.5*(row[pivot]-row_mean-column_means[pivot]+total_mean));
+        }
+    }
+
+  // The Dim dominant eigenvectors of C^T*C (pivot_count x pivot_count) give the axes
+  std::vector<double> product(pivot_count*pivot_count,0.0);
+  for(vertex_id_t v_id=0; v_id<vertex_count; v_id++)
+    {
+      const float* row=&columns[v_id*pivot_count];
+      for(std::size_t i=0; i<pivot_count; i++)
+        {
+          for(std::size_t j=0; j<=i; j++)
+            {
+              product[i*pivot_count+j]+=static_cast<double>(row[i])*row[j];
+            }
+        }
+    }
+  for(std::size_t i=0; i<pivot_count; i++)
+    {
+      for(std::size_t j=0; j<i; j++)
+        {
+          product[j*pivot_count+i]=product[i*pivot_count+j];
+        }
+    }
+
+  std::vector<double> axes[Dim];
+  for(int axis=0; axis<Dim; axis++)
+    {
+      power_iteration_(product,pivot_count,axes,axis,axes[axis]);
+    }
+
+  double means[Dim]={};
+  for(vertex_id_t v_id=0; v_id<vertex_count; v_id++)
+    {
+      const float* row=&columns[v_id*pivot_count];
+      for(int axis=0; axis<Dim; axis++)
+        {
+          double coord=0.0;
+          for(std::size_t pivot=0; pivot<pivot_count; pivot++)
+            {
+              coord+=row[pivot]*axes[axis][pivot];
+            }
+          aPositions[v_id].m_Pos[axis]=static_cast<Scalar>(coord);
+          means[axis]+=coord;
+        }
+      aPositions[v_id].m_Fixed=false;
+    }
+
+  // Center, fit in a 1.0 radius and separate vertices with the same distances to every pivot
+  // (leaves of a same vertex), as the layouts cannot pull apart vertices at the same position
+  NsVec<Scalar,Dim> center;
+  for(int axis=0; axis<Dim; axis++)
+    {
+      center[axis]=static_cast<Scalar>(means[axis]/vertex_count);
+    }
+  Scalar max_radius=0;
+  for(NsBasicPosition<Scalar,Dim>& pos:aPositions)
+    {
+      pos.m_Pos-=center;
+      max_radius=std::max(max_radius,sq_norm(pos.m_Pos));
+    }
+  max_radius=std::sqrt(max_radius);
+
+  const Scalar scale=max_radius>0 ? 1/max_radius : 1;
+  const Scalar offset=static_cast<Scalar>(0.05)/std::sqrt(static_cast<Scalar>(vertex_count));
+  for(vertex_id_t v_id=0; v_id<vertex_count; v_id++)
+    {
+      aPositions[v_id].m_Pos=aPositions[v_id].m_Pos*scale+GetSpreadDirection<Scalar,Dim>(v_id)*offset;
+    }
+}
+
+
+
+
+#define NODESOUP_INSTANTIATE_(aScalar,aIndex,aDim) \
+  template void SetPivotMdsPositions(const BasicCsrGraph<aIndex>&,std::vector<NsBasicPosition<aScalar,aDim>>&,std::size_t);
+NODESOUP_FOR_EACH_LAYOUT_TYPE(NODESOUP_INSTANTIATE_)
+#undef NODESOUP_INSTANTIATE_
+
+
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include "nodesoup.hpp"
+#include "csr_graph.hpp"
+#include <vector>
+
+namespace nodesoup
+{
+// Pivot MDS, Brandes, Pich, "Eigensolver methods for progressive multidimensional scaling of large data".
+// Classical MDS of the hop distances restricted to a few pivot vertices: O(k*m) for the k BFS
+// plus O(n*k^2) for the projection, instead of the O(n*m) all pairs distances. The n*k
+// distances to the pivots are kept in float, 4*n*k bytes.
+
+
+
+// Places the vertices of aGraph from the hop distances to aPivotCount pivots picked by
+// max-min distance. The layout is centered and fits in a 1.0 radius, like SetInitPositions().
+// Graphs with fewer than 3 vertices or no edges are placed on the circle.
+// 3D layouts take a third axis from the next eigenvector.
+template<typename Scalar,typename Index,int Dim>
+void SetPivotMdsPositions(const BasicCsrGraph<Index>& aGraph,std::vector<NsBasicPosition<Scalar,Dim>>& aPositions,std::size_t aPivotCount=50);
+
+
+}
@@ -0,0 +1,334 @@
+#include "shortest_paths.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <mutex>
+
+namespace nodesoup
+{
+
+
+// Fills aDistances (all kUnreachable on entry) with the hop distances from aSource.
+// aQueue ends up holding the reached vertices, so they can be reset cheaply.
+template<typename Index>
+static void bfs_(const BasicCsrGraph<Index>& aGraph,Index aSource,std::vector<hop_t>& aDistances,std::vector<Index>& aQueue)
+{
+  aQueue.clear();
+  aQueue.push_back(aSource);
+  aDistances[aSource]=0;
+
+  for(std::size_t head=0; head<aQueue.size(); head++)
+    {
+      Index v_id=aQueue[head];
+      hop_t next_distance=std::min<hop_t>(aDistances[v_id]+1,kMaxHops);
+
+      for(Index adj_id:aGraph.GetNeighbors(v_id))
+        {
+          if(aDistances[adj_id]==kUnreachable)
+            {
+              aDistances[adj_id]=next_distance;
+              aQueue.push_back(adj_id);
+            }
+        }
+    }
+}
+
+
+
+
+void HopMatrix::Resize(std::size_t aVertexCount)
+{
+  m_VertexCount=aVertexCount;
+  m_Data.assign(GetRowOffset(aVertexCount),kUnreachable);
+  m_HopCounts.clear();
+  m_UnreachableCount=m_Data.size();
+}
+
+
+
+
+void HopMatrix::AddVertex()
+{
+  m_UnreachableCount+=m_VertexCount;
+  m_VertexCount++;
+  m_Data.resize(GetRowOffset(m_VertexCount),kUnreachable);
+}
+
+
+
+
+// Keeps the counts, the longest distance is the last non zero count
+void HopMatrix::Change(vertex_id_t aVertexId,vertex_id_t aOtherId,hop_t aHops,const hop_change_func_t& aOnChange)
+{
+  const hop_t old_hops=Get(aVertexId,aOtherId);
+  if(old_hops==aHops)
+    {
+      return;
+    }
+
+  Set(aVertexId,aOtherId,aHops);
+  if(old_hops==kUnreachable)
+    {
+      m_UnreachableCount--;
+    }
+  else
+    {
+      m_HopCounts[old_hops]--;
+    }
+
+  if(aHops==kUnreachable)
+    {
+      m_UnreachableCount++;
+    }
+  else
+    {
+      if(aHops>=m_HopCounts.size())
+        {
+          m_HopCounts.resize(aHops+1,0);
+        }
+      m_HopCounts[aHops]++;
+    }
+
+  while(!m_HopCounts.empty() && !m_HopCounts.back())
+    {
+      m_HopCounts.pop_back();
+    }
+
+  if(aOnChange)
+    {
+      aOnChange(aVertexId,aOtherId,old_hops,aHops);
+    }
+}
+
+
+
+
+// A new shortest path x..aFrom-aTo..y only helps when x is closer to aFrom than to aTo by
+// two hops or more. For each such x the ys are searched from aTo down its shortest paths,
+// which do not take the new edge; a y that gets no closer to x ends the search below it,
+// as every vertex past it then has a path through it as short as the new one (Ramalingam
+// and Reps, incremental shortest paths).
+template<typename Index>
+void HopMatrix::InsertEdge(const BasicCsrGraph<Index>& aGraph,vertex_id_t aFrom,vertex_id_t aTo,const hop_change_func_t& aOnChange)
+{
+  std::vector<hop_t> from_row(m_VertexCount);
+  std::vector<hop_t> to_row(m_VertexCount);
+  for(vertex_id_t v_id=0; v_id<m_VertexCount; v_id++)
+    {
+      from_row[v_id]=Get(aFrom,v_id);
+      to_row[v_id]=Get(aTo,v_id);
+    }
+
+  std::vector<Index> queue;
+  std::vector<uint8_t> queued(m_VertexCount,0);
+  for(vertex_id_t x_id=0; x_id<m_VertexCount; x_id++)
+    {
+      const bool near_from=from_row[x_id]!=kUnreachable && (to_row[x_id]==kUnreachable || from_row[x_id]+1<to_row[x_id]);
+      if(!near_from)
+        {
+          continue;
+        }
+
+      queue.assign(1,static_cast<Index>(aTo));
+      queued[aTo]=1;
+      for(std::size_t head=0; head<queue.size(); head++)
+        {
+          const Index y_id=queue[head];
+          const hop_t hops=static_cast<hop_t>(std::min<unsigned int>(from_row[x_id]+1u+to_row[y_id],kMaxHops));
+          if(hops>=Get(x_id,y_id))
+            {
+              continue;
+            }
+
+          Change(x_id,y_id,hops,aOnChange);
+          for(Index adj_id:aGraph.GetNeighbors(y_id))
+            {
+              if(!queued[adj_id] && to_row[adj_id]==to_row[y_id]+1)
+                {
+                  queued[adj_id]=1;
+                  queue.push_back(adj_id);
+                }
+            }
+        }
+
+      for(Index reached_id:queue)
+        {
+          queued[reached_id]=0;
+        }
+    }
+}
+
+
+
+
+// The distances from x only change when the farther end of the edge has no other neighbour
+// one hop closer to x: those vertices get a new BFS, the others keep their distances
+template<typename Index>
+void HopMatrix::RemoveEdge(const BasicCsrGraph<Index>& aGraph,vertex_id_t aFrom,vertex_id_t aTo,const hop_change_func_t& aOnChange)
+{
+  std::vector<vertex_id_t> sources;
+  for(vertex_id_t v_id=0; v_id<m_VertexCount; v_id++)
+    {
+      const hop_t from_hops=Get(v_id,aFrom);
+      const hop_t to_hops=Get(v_id,aTo);
+      if(from_hops==to_hops)
+        {
+          continue;
+        }
+
+      const vertex_id_t far_id=(from_hops<to_hops ? aTo : aFrom);
+      const hop_t near_hops=std::min(from_hops,to_hops);
+      bool other_path=false;
+      for(Index adj_id:aGraph.GetNeighbors(far_id))
+        {
+          if(Get(v_id,adj_id)==near_hops)
+            {
+              other_path=true;
+              break;
+            }
+        }
+
+      if(!other_path)
+        {
+          sources.push_back(v_id);
+        }
+    }
+
+  std::vector<hop_t> distances(m_VertexCount,kUnreachable);
+  std::vector<Index> queue;
+  for(vertex_id_t source_id:sources)
+    {
+      bfs_(aGraph,static_cast<Index>(source_id),distances,queue);
+      for(vertex_id_t v_id=0; v_id<m_VertexCount; v_id++)
+        {
+          if(v_id!=source_id)
+            {
+              Change(source_id,v_id,distances[v_id],aOnChange);
+            }
+        }
+
+      for(Index reached_id:queue)
+        {
+          distances[reached_id]=kUnreachable;
+        }
+    }
+}
+
+
+
+
+void HopMatrix::RemoveVertex(vertex_id_t aVertexId)
+{
+  const vertex_id_t last=m_VertexCount-1;
+  if(aVertexId!=last)
+    {
+      for(vertex_id_t v_id=0; v_id<last; v_id++)
+        {
+          if(v_id!=aVertexId)
+            {
+              Set(aVertexId,v_id,Get(last,v_id));
+            }
+        }
+    }
+
+  m_UnreachableCount-=last;
+  m_VertexCount--;
+  m_Data.resize(GetRowOffset(m_VertexCount));
+}
+
+
+
+
+template<typename Index>
+void HopDistancesFrom(const BasicCsrGraph<Index>& aGraph,typename BasicCsrGraph<Index>::index_t aSource,std::vector<hop_t>& aDistances)
+{
+  aDistances.assign(aGraph.GetVertexCount(),kUnreachable);
+
+  std::vector<Index> queue;
+  queue.reserve(aGraph.GetVertexCount());
+  bfs_(aGraph,aSource,aDistances,queue);
+}
+
+
+
+
+template<typename Index>
+HopMatrix AllPairsHopDistances(const BasicCsrGraph<Index>& aGraph,ThreadPool& aThreadPool)
+{
+  HopMatrix distances;
+  const std::size_t vertex_count=aGraph.GetVertexCount();
+  distances.Resize(vertex_count);
+  distances.m_UnreachableCount=0;
+
+  std::mutex result_mutex;
+
+  aThreadPool.ParallelFor(vertex_count,16,[&aGraph,vertex_count,&distances,&result_mutex](std::size_t aBegin,std::size_t aEnd)
+  {
+    std::vector<hop_t> v_distances(vertex_count,kUnreachable);
+    std::vector<Index> queue;
+    queue.reserve(vertex_count);
+
+    std::vector<std::size_t> hop_counts;
+    std::size_t unreachable_count=0;
+
+    for(std::size_t v_id=aBegin; v_id<aEnd; v_id++)
+      {
+        bfs_(aGraph,static_cast<Index>(v_id),v_distances,queue);
+
+        if(v_distances[queue.back()]>=hop_counts.size())
+          {
+            hop_counts.resize(v_distances[queue.back()]+1,0);
+          }
+        for(std::size_t other_id=0; other_id<v_id; other_id++)
+          {
+            if(v_distances[other_id]==kUnreachable)
+              {
+                unreachable_count++;
+              }
+            else
+              {
+                hop_counts[v_distances[other_id]]++;
+              }
+          }
+
+        std::copy(v_distances.begin(),v_distances.begin()+v_id,distances.GetRow(v_id));
+
+        for(Index reached_id:queue)
+          {
+            v_distances[reached_id]=kUnreachable;
+          }
+      }
+
+    std::lock_guard<std::mutex> lock(result_mutex);
+    if(hop_counts.size()>distances.m_HopCounts.size())
+      {
+        distances.m_HopCounts.resize(hop_counts.size(),0);
+      }
+    for(std::size_t hops=0; hops<hop_counts.size(); hops++)
+      {
+        distances.m_HopCounts[hops]+=hop_counts[hops];
+      }
+    distances.m_UnreachableCount+=unreachable_count;
+  });
+
+  while(!distances.m_HopCounts.empty() && !distances.m_HopCounts.back())
+    {
+      distances.m_HopCounts.pop_back();
+    }
+
+  return distances;
+}
+
+
+
+
+template void HopMatrix::InsertEdge(const BasicCsrGraph<std::uint32_t>&,vertex_id_t,vertex_id_t,const hop_change_func_t&);
+template void HopMatrix::InsertEdge(const BasicCsrGraph<std::uint64_t>&,vertex_id_t,vertex_id_t,const hop_change_func_t&);
+template void HopMatrix::RemoveEdge(const BasicCsrGraph<std::uint32_t>&,vertex_id_t,vertex_id_t,const hop_change_func_t&);
+template void HopMatrix::RemoveEdge(const BasicCsrGraph<std::uint64_t>&,vertex_id_t,vertex_id_t,const hop_change_func_t&);
+template HopMatrix AllPairsHopDistances(const BasicCsrGraph<std::uint32_t>&,ThreadPool&);
+template HopMatrix AllPairsHopDistances(const BasicCsrGraph<std::uint64_t>&,ThreadPool&);
+template void HopDistancesFrom(const BasicCsrGraph<std::uint32_t>&,std::uint32_t,std::vector<hop_t>&);
+template void HopDistancesFrom(const BasicCsrGraph<std::uint64_t>&,std::uint64_t,std::vector<hop_t>&);
+
+
+}
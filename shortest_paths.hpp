@@ -0,0 +1,183 @@
+#pragma once
+#include "nodesoup.hpp"
+#include "aligned_allocator.hpp"
+#include "csr_graph.hpp"
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace nodesoup
+{
+
+class ThreadPool;
+
+
+using hop_t=std::uint16_t;
+
+// Stored for vertex pairs in different connected components
+constexpr hop_t kUnreachable=0xFFFF;
+// Longer paths are saturated to this value
+constexpr hop_t kMaxHops=kUnreachable-1;
+
+// Called for every pair whose distance changes in an update of a HopMatrix
+using hop_change_func_t=std::function<void(vertex_id_t aVertexId,vertex_id_t aOtherId,hop_t aOldHops,hop_t aNewHops)>;
+
+
+
+
+// Symmetric matrix of hop distances. Only the lower triangle is stored, row after row:
+// row i holds the distances to vertices 0..i-1, so (i,j) with i>j is at i*(i-1)/2+j.
+// The matrix follows edits of its graph without being computed again: only the pairs
+// whose distance changes are written.
+class HopMatrix
+{
+public:
+
+  void Resize(std::size_t aVertexCount);
+
+  std::size_t GetVertexCount() const noexcept;
+
+  hop_t Get(vertex_id_t aVertexId,vertex_id_t aOtherId) const noexcept;
+
+  // Distances from aVertexId to vertices 0..aVertexId-1
+  const hop_t* GetRow(vertex_id_t aVertexId) const noexcept;
+  hop_t*       GetRow(vertex_id_t aVertexId) noexcept;
+
+  static std::size_t GetRowOffset(vertex_id_t aVertexId) noexcept;
+
+  // Calls aFunc(other_id,hops) for every other vertex, in order
+  template<typename Func> void ForEachDistance(vertex_id_t aVertexId,Func aFunc) const;
+
+  // Longest finite distance, and whether some pair is unreachable
+  hop_t GetMaxDistance() const noexcept;
+  bool  HasUnreachable() const noexcept;
+
+  // Updates for an edit of the graph, made to aGraph beforehand.
+  // A new vertex is unreachable from all the others, O(n).
+  void AddVertex();
+  // Pairs getting closer through the new edge: a search from aTo for each vertex closer to
+  // aFrom, pruned at the pairs that do not change, O(n+changed pairs*deg)
+  template<typename Index>
+  void InsertEdge(const BasicCsrGraph<Index>& aGraph,vertex_id_t aFrom,vertex_id_t aTo,const hop_change_func_t& aOnChange);
+  // One BFS from every vertex whose distances change, O(n*deg+affected*m)
+  template<typename Index>
+  void RemoveEdge(const BasicCsrGraph<Index>& aGraph,vertex_id_t aFrom,vertex_id_t aTo,const hop_change_func_t& aOnChange);
+  // aVertexId must have no edges left, the last vertex takes its id as in CsrGraph, O(n)
+  void RemoveVertex(vertex_id_t aVertexId);
+
+  std::size_t GetMemorySize() const noexcept;
+
+private:
+
+  std::size_t m_VertexCount=0;
+  std::vector<hop_t,AlignedAllocator<hop_t>> m_Data;
+  // Number of pairs at each finite distance and unreachable, so edits keep the maximum
+  std::vector<std::size_t> m_HopCounts;
+  std::size_t              m_UnreachableCount=0;
+
+  void Set(vertex_id_t aVertexId,vertex_id_t aOtherId,hop_t aHops) noexcept;
+  void Change(vertex_id_t aVertexId,vertex_id_t aOtherId,hop_t aHops,const hop_change_func_t& aOnChange);
+
+  template<typename Index>
+  friend HopMatrix AllPairsHopDistances(const BasicCsrGraph<Index>& aGraph,ThreadPool& aThreadPool);
+};
+
+
+
+
+// Hop distance between every pair of vertices, one BFS per source vertex, O(n*m).
+// Sources are spread across aThreadPool.
+template<typename Index>
+HopMatrix AllPairsHopDistances(const BasicCsrGraph<Index>& aGraph,ThreadPool& aThreadPool);
+
+// Hop distances from aSource to every vertex (kUnreachable for other components), O(m)
+template<typename Index>
+void HopDistancesFrom(const BasicCsrGraph<Index>& aGraph,typename BasicCsrGraph<Index>::index_t aSource,std::vector<hop_t>& aDistances);
+
+
+
+
+inline std::size_t HopMatrix::GetVertexCount() const noexcept
+{
+  return m_VertexCount;
+}
+
+inline std::size_t HopMatrix::GetRowOffset(vertex_id_t aVertexId) noexcept
+{
+  return aVertexId ? aVertexId*(aVertexId-1)/2 : 0;
+}
+
+inline hop_t HopMatrix::Get(vertex_id_t aVertexId,vertex_id_t aOtherId) const noexcept
+{
+  if(aVertexId==aOtherId)
+    {
+      return 0;
+    }
+  return aVertexId>aOtherId ? m_Data[GetRowOffset(aVertexId)+aOtherId] : m_Data[GetRowOffset(aOtherId)+aVertexId];
+}
+
+inline const hop_t* HopMatrix::GetRow(vertex_id_t aVertexId) const noexcept
+{
+  return m_Data.data()+GetRowOffset(aVertexId);
+}
+
+inline hop_t* HopMatrix::GetRow(vertex_id_t aVertexId) noexcept
+{
+  return m_Data.data()+GetRowOffset(aVertexId);
+}
+
+inline void HopMatrix::Set(vertex_id_t aVertexId,vertex_id_t aOtherId,hop_t aHops) noexcept
+{
+  if(aVertexId>aOtherId)
+    {
+      m_Data[GetRowOffset(aVertexId)+aOtherId]=aHops;
+    }
+  else
+    {
+      m_Data[GetRowOffset(aOtherId)+aVertexId]=aHops;
+    }
+}
+
+inline hop_t HopMatrix::GetMaxDistance() const noexcept
+{
+  return m_HopCounts.empty() ? 0 : static_cast<hop_t>(m_HopCounts.size()-1);
+}
+
+inline bool HopMatrix::HasUnreachable() const noexcept
+{
+  return m_UnreachableCount>0;
+}
+
+inline std::size_t HopMatrix::GetMemorySize() const noexcept
+{
+  return m_Data.capacity()*sizeof(hop_t)+m_HopCounts.capacity()*sizeof(std::size_t);
+}
+
+
+
+
+// Distances to lower ids are contiguous in the triangle, distances to higher ids are one per row
+template<typename Func>
+void HopMatrix::ForEachDistance(vertex_id_t aVertexId,Func aFunc) const
+{
+  const hop_t* row=GetRow(aVertexId);
+  for(vertex_id_t other_id=0; other_id<aVertexId; other_id++)
+    {
+      aFunc(other_id,row[other_id]);
+    }
+
+  if(aVertexId+1>=m_VertexCount)
+    {
+      return;
+    }
+
+  const hop_t* column=GetRow(aVertexId+1)+aVertexId;
+  for(vertex_id_t other_id=aVertexId+1; other_id<m_VertexCount; other_id++)
+    {
+      aFunc(other_id,*column);
+      column+=other_id;
+    }
+}
+
+
+}
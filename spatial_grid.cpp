@@ -0,0 +1,306 @@
+#include "spatial_grid.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace nodesoup
+{
+
+
+void SpatialGrid::Build(const std::vector<NsPosition>& aPositions)
+{
+  Clear();
+
+  const std::size_t vertex_count=aPositions.size();
+  if(!vertex_count)
+    {
+      return;
+    }
+
+  // Bounding box of the finite positions, the others end in a border cell and never match
+  NsVec2 max{std::numeric_limits<float>::lowest(),std::numeric_limits<float>::lowest()};
+  m_Min={std::numeric_limits<float>::max(),std::numeric_limits<float>::max()};
+  for(const NsPosition& pos:aPositions)
+    {
+      if(std::isfinite(pos.m_Pos.x) && std::isfinite(pos.m_Pos.y))
+        {
+          m_Min.x=std::min(m_Min.x,pos.m_Pos.x);
+          m_Min.y=std::min(m_Min.y,pos.m_Pos.y);
+          max.x=std::max(max.x,pos.m_Pos.x);
+          max.y=std::max(max.y,pos.m_Pos.y);
+        }
+      m_MaxRadius=std::max(m_MaxRadius,pos.m_Radius);
+    }
+  if(m_Min.x>max.x)
+    {
+      m_Min=max={0.0f,0.0f};
+    }
+
+  // Square cells, no longer side than needed for a thin layout (a path, a single vertex)
+  const float width=max.x-m_Min.x;
+  const float height=max.y-m_Min.y;
+  const float cell_count=std::max(1.0f,static_cast<float>(vertex_count)/kVerticesPerCell);
+  float cell_size=std::max(std::sqrt(width*height/cell_count),std::max(width,height)/cell_count);
+  if(!(cell_size>0.0f))
+    {
+      cell_size=1.0f;
+    }
+
+  m_CellSize=cell_size;
+  m_InvCellSize=1.0f/cell_size;
+  m_Columns=static_cast<int>(width*m_InvCellSize)+1;
+  m_Rows=static_cast<int>(height*m_InvCellSize)+1;
+
+  // Counting sort of the vertices by cell
+  std::vector<unsigned int> cells(vertex_count);
+  m_CellStart.assign(static_cast<std::size_t>(m_Columns)*m_Rows+1,0);
+  for(vertex_id_t v_id=0; v_id<vertex_count; v_id++)
+    {
+      const NsVec2 pos=aPositions[v_id].m_Pos;
+      cells[v_id]=static_cast<unsigned int>(GetRow(pos.y)*m_Columns+GetColumn(pos.x));
+      m_CellStart[cells[v_id]+1]++;
+    }
+  for(std::size_t cell=1; cell<m_CellStart.size(); cell++)
+    {
+      m_CellStart[cell]+=m_CellStart[cell-1];
+    }
+
+  std::vector<unsigned int> fill(m_CellStart.begin(),m_CellStart.end()-1);
+  m_Ids.resize(vertex_count);
+  m_X.resize(vertex_count);
+  m_Y.resize(vertex_count);
+  m_Radius.resize(vertex_count);
+  for(vertex_id_t v_id=0; v_id<vertex_count; v_id++)
+    {
+      const unsigned int index=fill[cells[v_id]]++;
+      m_Ids[index]=v_id;
+      m_X[index]=aPositions[v_id].m_Pos.x;
+      m_Y[index]=aPositions[v_id].m_Pos.y;
+      m_Radius[index]=aPositions[v_id].m_Radius;
+    }
+}
+
+
+
+
+// One pass in cell order, gathering the new positions
+bool SpatialGrid::Update(const std::vector<NsPosition>& aPositions)
+{
+  if(aPositions.size()!=m_Ids.size() || m_Ids.empty())
+    {
+      Build(aPositions);
+      return true;
+    }
+
+  const float slack=kSlack*m_CellSize;
+  float max_radius=0.0f;
+  for(int row=0; row<m_Rows; row++)
+    {
+      const float min_y=m_Min.y+row*m_CellSize-slack;
+      const float max_y=min_y+m_CellSize+2.0f*slack;
+      for(int column=0; column<m_Columns; column++)
+        {
+          const float min_x=m_Min.x+column*m_CellSize-slack;
+          const float max_x=min_x+m_CellSize+2.0f*slack;
+
+          const std::size_t cell=static_cast<std::size_t>(row)*m_Columns+column;
+          for(unsigned int index=m_CellStart[cell]; index<m_CellStart[cell+1]; index++)
+            {
+              const NsPosition& pos=aPositions[m_Ids[index]];
+              if(!(pos.m_Pos.x>=min_x && pos.m_Pos.x<=max_x && pos.m_Pos.y>=min_y && pos.m_Pos.y<=max_y))
+                {
+                  Build(aPositions);
+                  return true;
+                }
+
+              m_X[index]=pos.m_Pos.x;
+              m_Y[index]=pos.m_Pos.y;
+              m_Radius[index]=pos.m_Radius;
+              max_radius=std::max(max_radius,pos.m_Radius);
+            }
+        }
+    }
+
+  m_MaxRadius=max_radius;
+  return false;
+}
+
+
+
+
+void SpatialGrid::Clear() noexcept
+{
+  m_Min={0.0f,0.0f};
+  m_CellSize=1.0f;
+  m_InvCellSize=1.0f;
+  m_Columns=0;
+  m_Rows=0;
+  m_MaxRadius=0.0f;
+  m_CellStart.clear();
+  m_Ids.clear();
+  m_X.clear();
+  m_Y.clear();
+  m_Radius.clear();
+}
+
+
+
+
+// Clamped to the grid, NaN goes to the first cell
+int SpatialGrid::GetColumn(float aX) const noexcept
+{
+  const float column=(aX-m_Min.x)*m_InvCellSize;
+  if(!(column>=0.0f))
+    {
+      return 0;
+    }
+  return column<m_Columns ? static_cast<int>(column) : m_Columns-1;
+}
+
+int SpatialGrid::GetRow(float aY) const noexcept
+{
+  const float row=(aY-m_Min.y)*m_InvCellSize;
+  if(!(row>=0.0f))
+    {
+      return 0;
+    }
+  return row<m_Rows ? static_cast<int>(row) : m_Rows-1;
+}
+
+
+
+
+template<typename Func>
+void SpatialGrid::ForEachInRect(const NsVec2& aMin,const NsVec2& aMax,Func aFunc) const
+{
+  if(m_Ids.empty())
+    {
+      return;
+    }
+
+  const float slack=kSlack*m_CellSize;
+  const int first_column=GetColumn(aMin.x-slack);
+  const int last_column=GetColumn(aMax.x+slack);
+  const int last_row=GetRow(aMax.y+slack);
+  for(int row=GetRow(aMin.y-slack); row<=last_row; row++)
+    {
+      // Cells of a row are contiguous, so are their vertices
+      const std::size_t row_start=static_cast<std::size_t>(row)*m_Columns;
+      const unsigned int end=m_CellStart[row_start+last_column+1];
+      for(unsigned int index=m_CellStart[row_start+first_column]; index<end; index++)
+        {
+          aFunc(index);
+        }
+    }
+}
+
+
+
+
+vertex_id_t SpatialGrid::FindNearest(const NsVec2& aPos,float aMaxDistance) const noexcept
+{
+  vertex_id_t nearest=kNoVertex;
+  float nearest_sq_dist=aMaxDistance*aMaxDistance;
+
+  const NsVec2 extent(aMaxDistance,aMaxDistance);
+  ForEachInRect(aPos-extent,aPos+extent,[&](unsigned int aIndex)
+  {
+    const float dx=m_X[aIndex]-aPos.x;
+    const float dy=m_Y[aIndex]-aPos.y;
+    const float sq_dist=dx*dx+dy*dy;
+    if(sq_dist<=nearest_sq_dist)
+      {
+        nearest_sq_dist=sq_dist;
+        nearest=m_Ids[aIndex];
+      }
+  });
+
+  return nearest;
+}
+
+
+
+
+vertex_id_t SpatialGrid::Pick(const NsVec2& aPos,float aRadiusScale) const noexcept
+{
+  vertex_id_t nearest=kNoVertex;
+  float nearest_sq_dist=std::numeric_limits<float>::max();
+
+  const float max_distance=m_MaxRadius*aRadiusScale;
+  const NsVec2 extent(max_distance,max_distance);
+  ForEachInRect(aPos-extent,aPos+extent,[&](unsigned int aIndex)
+  {
+    const float dx=m_X[aIndex]-aPos.x;
+    const float dy=m_Y[aIndex]-aPos.y;
+    const float sq_dist=dx*dx+dy*dy;
+    const float radius=m_Radius[aIndex]*aRadiusScale;
+    if(sq_dist<=radius*radius && sq_dist<nearest_sq_dist)
+      {
+        nearest_sq_dist=sq_dist;
+        nearest=m_Ids[aIndex];
+      }
+  });
+
+  return nearest;
+}
+
+
+
+
+void SpatialGrid::QueryRect(const NsVec2& aMin,const NsVec2& aMax,std::vector<vertex_id_t>& aResult) const
+{
+  ForEachInRect(aMin,aMax,[&](unsigned int aIndex)
+  {
+    if(m_X[aIndex]>=aMin.x && m_X[aIndex]<=aMax.x && m_Y[aIndex]>=aMin.y && m_Y[aIndex]<=aMax.y)
+      {
+        aResult.push_back(m_Ids[aIndex]);
+      }
+  });
+}
+
+
+
+
+void SpatialGrid::QueryLasso(const std::vector<NsVec2>& aPolygon,std::vector<vertex_id_t>& aResult) const
+{
+  if(aPolygon.size()<3)
+    {
+      return;
+    }
+
+  NsVec2 min=aPolygon[0];
+  NsVec2 max=aPolygon[0];
+  for(const NsVec2& point:aPolygon)
+    {
+      min.x=std::min(min.x,point.x);
+      min.y=std::min(min.y,point.y);
+      max.x=std::max(max.x,point.x);
+      max.y=std::max(max.y,point.y);
+    }
+
+  ForEachInRect(min,max,[&](unsigned int aIndex)
+  {
+    const float x=m_X[aIndex];
+    const float y=m_Y[aIndex];
+
+    // Crossings of a horizontal ray from the vertex with the polygon sides
+    bool inside=false;
+    for(std::size_t i=0,j=aPolygon.size()-1; i<aPolygon.size(); j=i++)
+      {
+        const NsVec2& a=aPolygon[i];
+        const NsVec2& b=aPolygon[j];
+        if((a.y>y)!=(b.y>y) && x<(b.x-a.x)*(y-a.y)/(b.y-a.y)+a.x)
+          {
+            inside=!inside;
+          }
+      }
+
+    if(inside)
+      {
+        aResult.push_back(m_Ids[aIndex]);
+      }
+  });
+}
+
+
+}
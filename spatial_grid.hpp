@@ -0,0 +1,82 @@
+#pragma once
+#include "nodesoup.hpp"
+#include <vector>
+
+namespace nodesoup
+{
+// Uniform grid over vertex positions for hit-testing and selection queries.
+// Vertices are bucketed by cell with a counting sort. The cells are loose: as the layout
+// moves, Update() refreshes the positions in place while every vertex stays within
+// kSlack cells of its own cell, and only rebuilds when one gets farther.
+// Queries are in layout coordinates (NsPosition::m_Pos), before any view transform.
+
+
+
+class SpatialGrid
+{
+public:
+
+  static constexpr vertex_id_t kNoVertex=static_cast<vertex_id_t>(-1);
+
+  // About this many vertices per cell on average
+  static constexpr float kVerticesPerCell=2.0f;
+  // Distance a vertex may leave its cell before a rebuild, in cell sizes
+  static constexpr float kSlack=0.5f;
+
+  void Build(const std::vector<NsPosition>& aPositions);
+  // Same vertices at new positions, rebuilds only if needed. Returns true on rebuilds.
+  bool Update(const std::vector<NsPosition>& aPositions);
+  void Clear() noexcept;
+
+  // Nearest vertex no farther than aMaxDistance, kNoVertex if none
+  vertex_id_t FindNearest(const NsVec2& aPos,float aMaxDistance) const noexcept;
+  // Nearest vertex whose circle of radius m_Radius*aRadiusScale contains aPos, kNoVertex if none
+  vertex_id_t Pick(const NsVec2& aPos,float aRadiusScale) const noexcept;
+
+  // Append the vertices inside the rectangle, or inside the polygon (even-odd rule)
+  void QueryRect(const NsVec2& aMin,const NsVec2& aMax,std::vector<vertex_id_t>& aResult) const;
+  void QueryLasso(const std::vector<NsVec2>& aPolygon,std::vector<vertex_id_t>& aResult) const;
+
+  std::size_t GetVertexCount() const noexcept;
+  float       GetMaxRadius() const noexcept;
+
+private:
+
+  NsVec2 m_Min{0.0f,0.0f};
+  float  m_CellSize=1.0f;
+  float  m_InvCellSize=1.0f;
+  int    m_Columns=0;
+  int    m_Rows=0;
+  float  m_MaxRadius=0.0f;
+
+  // Vertices of cell c are m_Ids[m_CellStart[c]] .. m_Ids[m_CellStart[c+1]-1],
+  // their positions and radiuses are copied in the same order
+  std::vector<unsigned int> m_CellStart;
+  std::vector<vertex_id_t>  m_Ids;
+  std::vector<float>        m_X;
+  std::vector<float>        m_Y;
+  std::vector<float>        m_Radius;
+
+  int GetColumn(float aX) const noexcept;
+  int GetRow(float aY) const noexcept;
+
+  // Calls aFunc(index) for every vertex in the cells overlapping the rectangle grown by
+  // the slack
+  template<typename Func> void ForEachInRect(const NsVec2& aMin,const NsVec2& aMax,Func aFunc) const;
+};
+
+
+
+
+inline std::size_t SpatialGrid::GetVertexCount() const noexcept
+{
+  return m_Ids.size();
+}
+
+inline float SpatialGrid::GetMaxRadius() const noexcept
+{
+  return m_MaxRadius;
+}
+
+
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+namespace nodesoup
+{
+
+
+// Lock-free bounded queue for exactly one producer thread and one consumer thread.
+// Capacity must be a power of two, one slot is left empty to tell full from empty.
+template<typename T,std::size_t Capacity>
+class SpscQueue
+{
+  static_assert(Capacity>=2 && (Capacity&(Capacity-1))==0,"Capacity must be a power of two");
+
+public:
+
+  // Producer side, false when the queue is full
+  bool Push(const T& aItem) noexcept;
+  // Consumer side, false when the queue is empty
+  bool Pop(T& aItem) noexcept;
+
+  // Only meaningful while neither side is running
+  void Clear() noexcept;
+
+private:
+
+  // Producer and consumer indices on their own cache lines
+  alignas(64) std::atomic<std::size_t> m_Head{0};   // next item to pop
+  alignas(64) std::atomic<std::size_t> m_Tail{0};   // next free slot
+  alignas(64) std::array<T,Capacity> m_Items;
+};
+
+
+
+
+template<typename T,std::size_t Capacity>
+bool SpscQueue<T,Capacity>::Push(const T& aItem) noexcept
+{
+  const std::size_t tail=m_Tail.load(std::memory_order_relaxed);
+  const std::size_t next_tail=(tail+1)&(Capacity-1);
+  if(next_tail==m_Head.load(std::memory_order_acquire))
+    {
+      return false;
+    }
+
+  m_Items[tail]=aItem;
+  m_Tail.store(next_tail,std::memory_order_release);
+  return true;
+}
+
+template<typename T,std::size_t Capacity>
+bool SpscQueue<T,Capacity>::Pop(T& aItem) noexcept
+{
+  const std::size_t head=m_Head.load(std::memory_order_relaxed);
+  if(head==m_Tail.load(std::memory_order_acquire))
+    {
+      return false;
+    }
+
+  aItem=m_Items[head];
+  m_Head.store((head+1)&(Capacity-1),std::memory_order_release);
+  return true;
+}
+
+template<typename T,std::size_t Capacity>
+void SpscQueue<T,Capacity>::Clear() noexcept
+{
+  m_Head.store(0,std::memory_order_relaxed);
+  m_Tail.store(0,std::memory_order_relaxed);
+}
+
+
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <chrono>
+
+namespace nodesoup
+{
+
+
+// Work done by a time budgeted StepFor()
+struct StepProgress
+{
+  int  m_Iterations=0;                        // FR iterations or KK vertex moves
+  std::chrono::microseconds m_Elapsed{0};
+  bool m_Converged=false;                     // nothing left to do, further calls do no work
+};
+
+
+
+
+// Running average of the cost of one iteration, so a budgeted step stops before the
+// next iteration would overrun the budget
+class IterationCost
+{
+public:
+
+  std::chrono::nanoseconds Get() const noexcept;
+  void Add(std::chrono::nanoseconds aSample) noexcept;
+
+private:
+
+  double m_Nanoseconds=0.0;
+  bool   m_HasSample=false;
+};
+
+
+
+
+inline std::chrono::nanoseconds IterationCost::Get() const noexcept
+{
+  return std::chrono::nanoseconds(static_cast<long long>(m_Nanoseconds));
+}
+
+// Exponential average, 1/8 of the weight to the newest sample
+inline void IterationCost::Add(std::chrono::nanoseconds aSample) noexcept
+{
+  const double sample=static_cast<double>(aSample.count());
+  m_Nanoseconds=m_HasSample ? m_Nanoseconds+(sample-m_Nanoseconds)/8.0 : sample;
+  m_HasSample=true;
+}
+
+
+}
@@ -0,0 +1,434 @@
+#include "stress_majorization.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+namespace nodesoup
+{
+
+
+StressMajorization::StressMajorization(const adj_list_t& aAdjList,double aK,double aTolerance)
+    : m_AdjList(&aAdjList)
+    , m_Graph(&m_OwnGraph)
+    , m_Distances(&m_OwnDistances)
+    , m_Tolerance(aTolerance)
+    , m_K(aK)
+    , m_Stress(0.0)
+    , m_PrevStress(0.0)
+    , m_Converged(false)
+    , m_CurrIter(0)
+    , m_ThreadPool(&DefaultThreadPool())
+    , m_StatsMemorySize(0)
+{
+}
+
+
+
+
+StressMajorization::StressMajorization(const CsrGraph& aGraph,double aK,double aTolerance)
+    : m_AdjList(nullptr)
+    , m_Graph(&aGraph)
+    , m_Distances(&m_OwnDistances)
+    , m_Tolerance(aTolerance)
+    , m_K(aK)
+    , m_Stress(0.0)
+    , m_PrevStress(0.0)
+    , m_Converged(false)
+    , m_CurrIter(0)
+    , m_ThreadPool(&DefaultThreadPool())
+    , m_StatsMemorySize(0)
+{
+}
+
+
+
+
+void StressMajorization::Start(bool aStartCircle)
+{
+  Start(aStartCircle ? InitMode::kCircle : InitMode::kRandom);
+}
+
+
+
+
+void StressMajorization::Start(InitMode aInitMode)
+{
+  if(m_AdjList)
+    {
+      m_OwnGraph.Assign(*m_AdjList);
+    }
+
+  ComputeDistances();
+  Init(aInitMode);
+}
+
+
+
+
+void StressMajorization::Start(const HopMatrix& aDistances,InitMode aInitMode)
+{
+  if(m_AdjList)
+    {
+      m_OwnGraph.Assign(*m_AdjList);
+    }
+
+  assert(aDistances.GetVertexCount()==m_Graph->GetVertexCount());
+  m_OwnDistances=HopMatrix();
+  m_Distances=&aDistances;
+  Init(aInitMode);
+}
+
+
+
+
+// Warm start from a layout of the same engine (a saved one)
+void StressMajorization::Start(const std::vector<NsPosition>& aPositions)
+{
+  if(m_AdjList)
+    {
+      m_OwnGraph.Assign(*m_AdjList);
+    }
+
+  assert(aPositions.size()==m_Graph->GetVertexCount());
+  ComputeDistances();
+  Init(InitMode::kCircle,&aPositions);
+}
+
+
+
+
+void StressMajorization::ComputeDistances()
+{
+  NODESOUP_SCOPED_TIMER(m_Stats.m_Phases[LayoutStats::kDistances]);
+  m_OwnDistances=AllPairsHopDistances(*m_Graph,*m_ThreadPool);
+  m_Distances=&m_OwnDistances;
+}
+
+
+
+
+void StressMajorization::Init(InitMode aInitMode,const std::vector<NsPosition>* aWarmPositions)
+{
+  const std::size_t vertex_count=m_Distances->GetVertexCount();
+
+  // Unreachable pairs are kept one hop farther than the farthest reachable ones
+  const std::size_t max_distance=m_Distances->GetMaxDistance();
+  m_Weights.resize(max_distance+2);
+  m_Lengths.resize(max_distance+2);
+  m_Weights[0]=0.0;
+  m_Lengths[0]=0.0;
+  for(std::size_t distance=1; distance<m_Weights.size(); distance++)
+    {
+      m_Weights[distance]=1.0/(distance*distance);
+      m_Lengths[distance]=m_K*distance;
+    }
+
+  // Initial positions spread to about the size of the final layout, warm starts are
+  // already in edge lengths
+  std::vector<NsPosition> positions;
+  double scale=1.0;
+  if(!aWarmPositions)
+    {
+      positions.resize(vertex_count);
+      nodesoup::SetInitPositions(aInitMode,*m_Graph,positions);
+      scale=0.5*m_K*(max_distance+1);
+      aWarmPositions=&positions;
+    }
+
+  m_X.resize(vertex_count);
+  m_Y.resize(vertex_count);
+  m_Fixed.resize(vertex_count);
+  for(vertex_id_t v_id=0; v_id<vertex_count; v_id++)
+    {
+      m_X[v_id]=scale*(*aWarmPositions)[v_id].m_Pos.x;
+      m_Y[v_id]=scale*(*aWarmPositions)[v_id].m_Pos.y;
+      m_Fixed[v_id]=(*aWarmPositions)[v_id].m_Fixed;
+    }
+
+  m_Diagonal.assign(vertex_count,0.0);
+  m_ThreadPool->ParallelFor(vertex_count,64,[this](std::size_t aBegin,std::size_t aEnd)
+  {
+    for(vertex_id_t v_id=aBegin; v_id<aEnd; v_id++)
+      {
+        double diagonal=0.0;
+        m_Distances->ForEachDistance(v_id,[this,&diagonal](vertex_id_t,hop_t aHops)
+        {
+          diagonal+=m_Weights[GetTableIndex(aHops)];
+        });
+        m_Diagonal[v_id]=diagonal;
+      }
+  });
+
+  for(std::vector<double>* buffer:{&m_BX,&m_BY,&m_RX,&m_RY,&m_ZX,&m_ZY,&m_PX,&m_PY,&m_QX,&m_QY,&m_VertexStress})
+    {
+      buffer->assign(vertex_count,0.0);
+    }
+
+  m_Stress=0.0;
+  m_PrevStress=std::numeric_limits<double>::max();
+  m_Converged=vertex_count<2;
+  m_CurrIter=0;
+  NODESOUP_STATS_ONLY(m_Stats.CountGrowth(GetMemorySize(),m_StatsMemorySize);)
+}
+
+
+
+
+std::size_t StressMajorization::GetMemorySize() const noexcept
+{
+  std::size_t memory_size=m_Fixed.capacity()+m_OwnDistances.GetMemorySize()+m_OwnGraph.GetMemorySize();
+  for(const std::vector<double>* buffer:{&m_Weights,&m_Lengths,&m_X,&m_Y,&m_Diagonal,&m_BX,&m_BY,&m_RX,&m_RY
+                                        ,&m_ZX,&m_ZY,&m_PX,&m_PY,&m_QX,&m_QY,&m_VertexStress})
+    {
+      memory_size+=buffer->capacity()*sizeof(double);
+    }
+  return memory_size;
+}
+
+
+
+
+// b=L_z*z: each vertex is pulled along its pairs towards their ideal length.
+// The stress of the current layout comes for free.
+void StressMajorization::ComputeRightHandSide()
+{
+  m_ThreadPool->ParallelFor(m_X.size(),16,[this](std::size_t aBegin,std::size_t aEnd)
+  {
+    for(vertex_id_t v_id=aBegin; v_id<aEnd; v_id++)
+      {
+        const double x=m_X[v_id];
+        const double y=m_Y[v_id];
+        double b_x=0.0;
+        double b_y=0.0;
+        double stress=0.0;
+
+        m_Distances->ForEachDistance(v_id,[&](vertex_id_t aOtherId,hop_t aHops)
+        {
+          const std::size_t index=GetTableIndex(aHops);
+          const double delta_x=x-m_X[aOtherId];
+          const double delta_y=y-m_Y[aOtherId];
+          const double distance=sqrt(delta_x*delta_x+delta_y*delta_y);
+          const double error=distance-m_Lengths[index];
+
+          stress+=m_Weights[index]*error*error;
+          // Coincident vertices have no direction to be pulled in
+          if(distance>0.0)
+            {
+              const double factor=m_Weights[index]*m_Lengths[index]/distance;
+              b_x+=factor*delta_x;
+              b_y+=factor*delta_y;
+            }
+        });
+
+        m_BX[v_id]=b_x;
+        m_BY[v_id]=b_y;
+        m_VertexStress[v_id]=stress;
+      }
+  });
+
+  // Every pair was counted twice, summed serially so the result does not depend on the threads
+  double stress=0.0;
+  for(double vertex_stress:m_VertexStress)
+    {
+      stress+=vertex_stress;
+    }
+  m_Stress=0.5*stress/(m_K*m_K);
+  NODESOUP_COUNT(m_Stats.m_PairEvaluations,m_X.size()*m_X.size());
+}
+
+
+
+
+// aOut=L_w*a on the rows of free vertices, 0 on fixed ones
+void StressMajorization::MultiplyLaplacian(const std::vector<double>& aX,const std::vector<double>& aY
+                                          ,std::vector<double>& aOutX,std::vector<double>& aOutY)
+{
+  m_ThreadPool->ParallelFor(aX.size(),16,[&](std::size_t aBegin,std::size_t aEnd)
+  {
+    for(vertex_id_t v_id=aBegin; v_id<aEnd; v_id++)
+      {
+        if(m_Fixed[v_id])
+          {
+            aOutX[v_id]=0.0;
+            aOutY[v_id]=0.0;
+            continue;
+          }
+
+        double sum_x=0.0;
+        double sum_y=0.0;
+        m_Distances->ForEachDistance(v_id,[&](vertex_id_t aOtherId,hop_t aHops)
+        {
+          const double weight=m_Weights[GetTableIndex(aHops)];
+          sum_x+=weight*aX[aOtherId];
+          sum_y+=weight*aY[aOtherId];
+        });
+
+        aOutX[v_id]=m_Diagonal[v_id]*aX[v_id]-sum_x;
+        aOutY[v_id]=m_Diagonal[v_id]*aY[v_id]-sum_y;
+      }
+  });
+  NODESOUP_COUNT(m_Stats.m_PairEvaluations,aX.size()*aX.size());
+}
+
+
+
+
+// Preconditioned conjugate gradient on L_w*x=b, both coordinates at once, starting
+// from the current positions. Fixed vertices keep their position.
+void StressMajorization::SolveLaplacian()
+{
+  const std::size_t vertex_count=m_X.size();
+
+  MultiplyLaplacian(m_X,m_Y,m_QX,m_QY);
+
+  double rz_x=0.0;
+  double rz_y=0.0;
+  for(vertex_id_t v_id=0; v_id<vertex_count; v_id++)
+    {
+      const bool free=!m_Fixed[v_id] && m_Diagonal[v_id]>0.0;
+      m_RX[v_id]=free ? m_BX[v_id]-m_QX[v_id] : 0.0;
+      m_RY[v_id]=free ? m_BY[v_id]-m_QY[v_id] : 0.0;
+      m_ZX[v_id]=free ? m_RX[v_id]/m_Diagonal[v_id] : 0.0;
+      m_ZY[v_id]=free ? m_RY[v_id]/m_Diagonal[v_id] : 0.0;
+      m_PX[v_id]=m_ZX[v_id];
+      m_PY[v_id]=m_ZY[v_id];
+      rz_x+=m_RX[v_id]*m_ZX[v_id];
+      rz_y+=m_RY[v_id]*m_ZY[v_id];
+      NODESOUP_COUNT(m_Stats.m_VerticesMoved,free);
+    }
+
+  // Positions are only needed to a fraction of an edge length
+  const double threshold_x=1e-6*rz_x;
+  const double threshold_y=1e-6*rz_y;
+
+  for(int iter=0; iter<kMaxSolverIterations && (rz_x>threshold_x || rz_y>threshold_y); iter++)
+    {
+      MultiplyLaplacian(m_PX,m_PY,m_QX,m_QY);
+
+      double pq_x=0.0;
+      double pq_y=0.0;
+      for(vertex_id_t v_id=0; v_id<vertex_count; v_id++)
+        {
+          pq_x+=m_PX[v_id]*m_QX[v_id];
+          pq_y+=m_PY[v_id]*m_QY[v_id];
+        }
+
+      const double alpha_x=pq_x>0.0 ? rz_x/pq_x : 0.0;
+      const double alpha_y=pq_y>0.0 ? rz_y/pq_y : 0.0;
+
+      double next_rz_x=0.0;
+      double next_rz_y=0.0;
+      for(vertex_id_t v_id=0; v_id<vertex_count; v_id++)
+        {
+          m_X[v_id]+=alpha_x*m_PX[v_id];
+          m_Y[v_id]+=alpha_y*m_PY[v_id];
+          m_RX[v_id]-=alpha_x*m_QX[v_id];
+          m_RY[v_id]-=alpha_y*m_QY[v_id];
+
+          if(m_RX[v_id]!=0.0 || m_RY[v_id]!=0.0)
+            {
+              m_ZX[v_id]=m_RX[v_id]/m_Diagonal[v_id];
+              m_ZY[v_id]=m_RY[v_id]/m_Diagonal[v_id];
+            }
+          else
+            {
+              m_ZX[v_id]=m_ZY[v_id]=0.0;
+            }
+          next_rz_x+=m_RX[v_id]*m_ZX[v_id];
+          next_rz_y+=m_RY[v_id]*m_ZY[v_id];
+        }
+
+      const double beta_x=rz_x>0.0 ? next_rz_x/rz_x : 0.0;
+      const double beta_y=rz_y>0.0 ? next_rz_y/rz_y : 0.0;
+      for(vertex_id_t v_id=0; v_id<vertex_count; v_id++)
+        {
+          m_PX[v_id]=m_ZX[v_id]+beta_x*m_PX[v_id];
+          m_PY[v_id]=m_ZY[v_id]+beta_y*m_PY[v_id];
+        }
+
+      rz_x=next_rz_x;
+      rz_y=next_rz_y;
+    }
+}
+
+
+
+
+void StressMajorization::DoStep()
+{
+  NODESOUP_SCOPED_TIMER(m_Stats.m_Phases[LayoutStats::kSolver]);
+  ComputeRightHandSide();
+
+  // Each iteration can only lower the stress, stop when it barely does
+  if(m_PrevStress-m_Stress<m_Tolerance*m_PrevStress)
+    {
+      m_Converged=true;
+      return;
+    }
+  m_PrevStress=m_Stress;
+
+  SolveLaplacian();
+  m_CurrIter++;
+}
+
+
+
+
+void StressMajorization::Step(int aStepSize,std::vector<NsPosition>& aPositions)
+{
+  for(int k=0;k<aStepSize && !m_Converged;++k)
+    {
+      DoStep();
+    }
+
+  StorePositions(aPositions);
+}
+
+
+
+
+void StressMajorization::StorePositions(std::vector<NsPosition>& aPositions) const
+{
+  assert(aPositions.size()==m_X.size());
+
+  for(vertex_id_t v_id=0; v_id<m_X.size(); v_id++)
+    {
+      aPositions[v_id].m_Pos.x=static_cast<float>(m_X[v_id]);
+      aPositions[v_id].m_Pos.y=static_cast<float>(m_Y[v_id]);
+      aPositions[v_id].m_Fixed=m_Fixed[v_id];
+    }
+}
+
+
+
+
+void StressMajorization::MovePos(vertex_id_t aVertexId,const NsVec2& aDisp,bool aRecalculate)
+{
+  assert(aVertexId<m_X.size());
+
+  if(aRecalculate)
+    {
+      if(aDisp.x==kInvalidPos && aDisp.y==kInvalidPos)
+        {
+          m_Fixed[aVertexId]=!m_Fixed[aVertexId];
+        }
+    }
+  else
+    {
+      m_X[aVertexId]+=aDisp.x;
+      m_Y[aVertexId]+=aDisp.y;
+      if(sq_norm(aDisp)>0.0f)
+        {
+          m_Fixed[aVertexId]=true;
+        }
+    }
+
+  // The stress may go up from here, start converging again
+  m_PrevStress=std::numeric_limits<double>::max();
+  m_Converged=m_X.size()<2;
+}
+
+
+}
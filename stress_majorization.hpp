@@ -0,0 +1,143 @@
+#pragma once
+#include "nodesoup.hpp"
+#include "csr_graph.hpp"
+#include "layout_stats.hpp"
+#include "shortest_paths.hpp"
+#include <cstdint>
+#include <vector>
+
+namespace nodesoup
+{
+// Stress majorization (SMACOF), Gansner, Koren, North, "Graph drawing by stress majorization".
+// Minimizes the same energy as KamadaKawai, sum of w_ij*(|x_i-x_j|-d_ij)^2 with w_ij=d_ij^-2,
+// but moves every vertex at once: each iteration solves L_w*x=L_z*z by conjugate gradient.
+
+class ThreadPool;
+
+
+
+class StressMajorization
+{
+public:
+
+  // aK: length of an edge
+  StressMajorization(const adj_list_t& aAdjList,double aK=15.0,double aTolerance=1e-4);
+  StressMajorization(const CsrGraph& aGraph,double aK=15.0,double aTolerance=1e-4);
+
+  void Start(bool aStartCircle=true);
+  void Start(InitMode aInitMode);
+  // Uses hop distances already computed for the same graph (KamadaKawai::GetDistances()),
+  // which must outlive the layout
+  void Start(const HopMatrix& aDistances,InitMode aInitMode=InitMode::kCircle);
+  // Warm start from positions in edge lengths, as written by Step()
+  void Start(const std::vector<NsPosition>& aPositions);
+  // Runs up to aStepSize iterations, none once the stress stops decreasing
+  void Step(int aStepSize,std::vector<NsPosition>& aPositions);
+
+  void MovePos(vertex_id_t aVertexId,const NsVec2& aDisp,bool aRecalculate);
+
+  int  GetCurrIter() const noexcept;
+  bool IsConverged() const noexcept;
+  // Stress of the current layout, in edge lengths
+  double GetEnergy() const noexcept;
+
+  // Phase times and counters, see layout_stats.hpp
+  const LayoutStats& GetStats() const noexcept;
+  void               ResetStats() noexcept;
+  // Bytes of the engine buffers, the graph and distances included when owned
+  std::size_t        GetMemorySize() const noexcept;
+
+  void SetThreadPool(ThreadPool& aThreadPool) noexcept;
+
+  static constexpr int kMaxSolverIterations=20;
+
+private:
+
+  // Graphs are read on Start(), an adjacency list is converted to m_OwnGraph
+  const adj_list_t* m_AdjList;
+  const CsrGraph*   m_Graph;
+  CsrGraph          m_OwnGraph;
+  const HopMatrix*  m_Distances;
+  HopMatrix         m_OwnDistances;
+  const double m_Tolerance;
+  double m_K;
+
+  // Weight and length for each hop distance, the last item is used for unreachable pairs
+  std::vector<double> m_Weights;
+  std::vector<double> m_Lengths;
+
+  std::vector<double>  m_X;
+  std::vector<double>  m_Y;
+  std::vector<uint8_t> m_Fixed;
+  // Diagonal of L_w, also the Jacobi preconditioner
+  std::vector<double>  m_Diagonal;
+
+  // Solver buffers: right-hand side, residual, preconditioned residual, direction and L_w*direction
+  std::vector<double> m_BX,m_BY;
+  std::vector<double> m_RX,m_RY;
+  std::vector<double> m_ZX,m_ZY;
+  std::vector<double> m_PX,m_PY;
+  std::vector<double> m_QX,m_QY;
+  std::vector<double> m_VertexStress;
+
+  double m_Stress;
+  double m_PrevStress;
+  bool   m_Converged;
+  int    m_CurrIter;
+
+  ThreadPool* m_ThreadPool;
+
+  LayoutStats m_Stats;
+  std::size_t m_StatsMemorySize;
+
+  void ComputeDistances();
+  void Init(InitMode aInitMode,const std::vector<NsPosition>* aWarmPositions=nullptr);
+  std::size_t GetTableIndex(hop_t aHops) const noexcept;
+  void DoStep();
+  void ComputeRightHandSide();
+  void MultiplyLaplacian(const std::vector<double>& aX,const std::vector<double>& aY
+                        ,std::vector<double>& aOutX,std::vector<double>& aOutY);
+  void SolveLaplacian();
+  void StorePositions(std::vector<NsPosition>& aPositions) const;
+};
+
+
+
+
+inline int StressMajorization::GetCurrIter() const noexcept
+{
+  return m_CurrIter;
+}
+
+inline bool StressMajorization::IsConverged() const noexcept
+{
+  return m_Converged;
+}
+
+inline double StressMajorization::GetEnergy() const noexcept
+{
+  return m_Stress;
+}
+
+inline const LayoutStats& StressMajorization::GetStats() const noexcept
+{
+  return m_Stats;
+}
+
+inline void StressMajorization::ResetStats() noexcept
+{
+  m_Stats=LayoutStats();
+}
+
+inline void StressMajorization::SetThreadPool(ThreadPool& aThreadPool) noexcept
+{
+  m_ThreadPool=&aThreadPool;
+}
+
+inline std::size_t StressMajorization::GetTableIndex(hop_t aHops) const noexcept
+{
+  return aHops==kUnreachable ? m_Weights.size()-1 : aHops;
+}
+
+
+}
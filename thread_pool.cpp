@@ -0,0 +1,173 @@
+#include "thread_pool.hpp"
+#include <algorithm>
+
+namespace nodesoup
+{
+
+
+// Set while a thread runs pool work, nested ParallelFor calls then run serially
+static thread_local bool tInsidePool=false;
+
+
+ThreadPool::ThreadPool(unsigned int aThreadCount)
+    : m_Func(nullptr)
+    , m_Count(0)
+    , m_Grain(1)
+    , m_NextChunk(0)
+    , m_ActiveWorkers(0)
+    , m_BusyWorkers(0)
+    , m_Generation(0)
+    , m_Stop(false)
+{
+  if(!aThreadCount)
+    {
+      aThreadCount=std::max(1u,std::thread::hardware_concurrency());
+    }
+
+  m_Workers.reserve(aThreadCount-1);
+  for(unsigned int k=0; k+1<aThreadCount; ++k)
+    {
+      m_Workers.emplace_back(&ThreadPool::WorkerLoop,this,k);
+    }
+}
+
+
+
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Stop=true;
+  }
+  m_WakeUp.notify_all();
+
+  for(std::thread& worker:m_Workers)
+    {
+      worker.join();
+    }
+}
+
+
+
+
+void ThreadPool::RunChunks()
+{
+  const std::size_t chunk_count=(m_Count+m_Grain-1)/m_Grain;
+  for(;;)
+    {
+      std::size_t chunk=m_NextChunk.fetch_add(1,std::memory_order_relaxed);
+      if(chunk>=chunk_count)
+        {
+          return;
+        }
+
+      std::size_t begin=chunk*m_Grain;
+      std::size_t end=std::min(begin+m_Grain,m_Count);
+      (*m_Func)(begin,end);
+    }
+}
+
+
+
+
+void ThreadPool::WorkerLoop(unsigned int aWorkerId)
+{
+  unsigned long long seen_generation=0;
+  tInsidePool=true;
+
+  for(;;)
+    {
+      {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        m_WakeUp.wait(lock,[this,&seen_generation]{ return m_Stop || m_Generation!=seen_generation; });
+        if(m_Stop)
+          {
+            return;
+          }
+
+        seen_generation=m_Generation;
+        if(aWorkerId>=m_ActiveWorkers)
+          {
+            continue;
+          }
+        m_BusyWorkers++;
+      }
+
+      RunChunks();
+
+      {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_BusyWorkers--;
+      }
+      m_Done.notify_one();
+    }
+}
+
+
+
+
+void ThreadPool::ParallelFor(std::size_t aCount,std::size_t aGrain,const std::function<void(std::size_t,std::size_t)>& aFunc,unsigned int aMaxThreads)
+{
+  if(!aCount)
+    {
+      return;
+    }
+
+  aGrain=std::max<std::size_t>(1,aGrain);
+  const std::size_t chunk_count=(aCount+aGrain-1)/aGrain;
+
+  unsigned int threads=GetThreadCount();
+  if(aMaxThreads)
+    {
+      threads=std::min(threads,aMaxThreads);
+    }
+  if(chunk_count<threads)
+    {
+      threads=static_cast<unsigned int>(chunk_count);
+    }
+
+  // Not worth waking anybody, or the pool is already busy with another job
+  std::unique_lock<std::mutex> job_lock(m_JobMutex,std::defer_lock);
+  if(threads<=1 || tInsidePool || !job_lock.try_lock())
+    {
+      for(std::size_t begin=0; begin<aCount; begin+=aGrain)
+        {
+          aFunc(begin,std::min(begin+aGrain,aCount));
+        }
+      return;
+    }
+
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Func=&aFunc;
+    m_Count=aCount;
+    m_Grain=aGrain;
+    m_NextChunk.store(0,std::memory_order_relaxed);
+    m_ActiveWorkers=threads-1;
+    m_Generation++;
+  }
+  m_WakeUp.notify_all();
+
+  tInsidePool=true;
+  RunChunks();
+  tInsidePool=false;
+
+  // Wait until the workers have left RunChunks, late ones will find no chunk left
+  std::unique_lock<std::mutex> lock(m_Mutex);
+  m_Done.wait(lock,[this]{ return m_BusyWorkers==0 && m_NextChunk.load(std::memory_order_relaxed)>=(m_Count+m_Grain-1)/m_Grain; });
+  m_ActiveWorkers=0;
+  m_Func=nullptr;
+}
+
+
+
+
+ThreadPool& DefaultThreadPool()
+{
+  static ThreadPool pool;
+  return pool;
+}
+
+
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace nodesoup
+{
+
+
+// Fixed set of worker threads reused across calls. The calling thread takes part in the work.
+// One job runs at a time: concurrent or nested ParallelFor calls run serially on their caller.
+class ThreadPool
+{
+public:
+
+  // aThreadCount==0: one thread per hardware thread
+  explicit ThreadPool(unsigned int aThreadCount=0);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&)=delete;
+  ThreadPool& operator=(const ThreadPool&)=delete;
+
+  unsigned int GetThreadCount() const noexcept;
+
+  // Calls aFunc(begin,end) over [0,aCount) split in chunks of aGrain items, using up to
+  // aMaxThreads threads (0: all). Returns when every chunk is done.
+  void ParallelFor(std::size_t aCount,std::size_t aGrain,const std::function<void(std::size_t,std::size_t)>& aFunc,unsigned int aMaxThreads=0);
+
+private:
+
+  std::vector<std::thread> m_Workers;
+  std::mutex               m_JobMutex;
+  std::mutex               m_Mutex;
+  std::condition_variable  m_WakeUp;
+  std::condition_variable  m_Done;
+
+  // Current job, protected by m_Mutex except the chunk counter
+  const std::function<void(std::size_t,std::size_t)>* m_Func;
+  std::size_t              m_Count;
+  std::size_t              m_Grain;
+  std::atomic<std::size_t> m_NextChunk;
+  unsigned int             m_ActiveWorkers;   // Workers allowed to join the current job
+  unsigned int             m_BusyWorkers;
+  unsigned long long       m_Generation;
+  bool                     m_Stop;
+
+  void WorkerLoop(unsigned int aWorkerId);
+  void RunChunks();
+};
+
+
+
+
+inline unsigned int ThreadPool::GetThreadCount() const noexcept
+{
+  return static_cast<unsigned int>(m_Workers.size())+1;
+}
+
+
+
+
+// Pool shared by the layout engines
+ThreadPool& DefaultThreadPool();
+
+
+}
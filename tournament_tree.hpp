@@ -0,0 +1,118 @@
+#pragma once
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+namespace nodesoup
+{
+
+
+// Complete binary tree over a set of values where every inner node holds the index of
+// the biggest value below it, so the maximum is at the root.
+// Update() costs O(log n). After many Set() calls, Rebuild() costs O(n).
+class TournamentTree
+{
+public:
+
+  void Resize(std::size_t aCount);
+
+  std::size_t GetCount() const noexcept;
+
+  double Get(std::size_t aIndex) const noexcept;
+
+  // Changes a value without fixing the tree, call Rebuild() afterwards
+  void Set(std::size_t aIndex,double aValue) noexcept;
+
+  void Update(std::size_t aIndex,double aValue) noexcept;
+  void Rebuild() noexcept;
+
+  std::size_t GetMaxIndex() const noexcept;
+  double      GetMax() const noexcept;
+
+  std::size_t GetMemorySize() const noexcept;
+
+private:
+
+  std::size_t m_Count=0;
+  std::size_t m_LeafCount=0;          // m_Count rounded up to a power of two
+  std::vector<double> m_Values;       // m_LeafCount values, padding is -infinity
+  std::vector<std::size_t> m_Winners; // Node k has children 2k and 2k+1, leaves start at m_LeafCount
+
+  std::size_t Winner(std::size_t aLeft,std::size_t aRight) const noexcept;
+};
+
+
+
+
+inline void TournamentTree::Resize(std::size_t aCount)
+{
+  m_Count=aCount;
+  m_LeafCount=1;
+  while(m_LeafCount<aCount)
+    {
+      m_LeafCount*=2;
+    }
+
+  m_Values.assign(m_LeafCount,-std::numeric_limits<double>::infinity());
+  m_Winners.assign(2*m_LeafCount,0);
+  for(std::size_t k=0; k<m_LeafCount; k++)
+    {
+      m_Winners[m_LeafCount+k]=k;
+    }
+  Rebuild();
+}
+
+inline std::size_t TournamentTree::GetCount() const noexcept
+{
+  return m_Count;
+}
+
+inline double TournamentTree::Get(std::size_t aIndex) const noexcept
+{
+  return m_Values[aIndex];
+}
+
+inline void TournamentTree::Set(std::size_t aIndex,double aValue) noexcept
+{
+  m_Values[aIndex]=aValue;
+}
+
+inline std::size_t TournamentTree::Winner(std::size_t aLeft,std::size_t aRight) const noexcept
+{
+  return m_Values[aRight]>m_Values[aLeft] ? aRight : aLeft;
+}
+
+inline void TournamentTree::Update(std::size_t aIndex,double aValue) noexcept
+{
+  m_Values[aIndex]=aValue;
+  for(std::size_t node=(m_LeafCount+aIndex)/2; node>0; node/=2)
+    {
+      m_Winners[node]=Winner(m_Winners[2*node],m_Winners[2*node+1]);
+    }
+}
+
+inline void TournamentTree::Rebuild() noexcept
+{
+  for(std::size_t node=m_LeafCount-1; node>0; node--)
+    {
+      m_Winners[node]=Winner(m_Winners[2*node],m_Winners[2*node+1]);
+    }
+}
+
+inline std::size_t TournamentTree::GetMaxIndex() const noexcept
+{
+  return m_LeafCount>1 ? m_Winners[1] : 0;
+}
+
+inline double TournamentTree::GetMax() const noexcept
+{
+  return m_Values[GetMaxIndex()];
+}
+
+inline std::size_t TournamentTree::GetMemorySize() const noexcept
+{
+  return m_Values.capacity()*sizeof(double)+m_Winners.capacity()*sizeof(std::size_t);
+}
+
+
+}